@@ -1,6 +1,7 @@
 #include "analyzer.hpp"
 #include "parser/AST-node.hpp"
 #include <memory>
+#include <stdexcept>
 
 /*
  * Collect symbol table
@@ -8,3 +9,183 @@
 Analyzer::Analyzer(std::shared_ptr<parsing::Program> program) : m_program(program)
 {
 }
+
+Analyzer& Analyzer::withThreads(size_t threads)
+{
+    m_threads = threads;
+    m_pool.reset();
+    return *this;
+}
+
+Analyzer& Analyzer::withBudget(size_t iterations, std::chrono::milliseconds time)
+{
+    m_max_iterations = iterations;
+    m_max_time = time;
+    return *this;
+}
+
+Analyzer& Analyzer::withStats(bool enabled)
+{
+    m_stats = enabled;
+    return *this;
+}
+
+Analyzer& Analyzer::withReportsTo(std::ostream& out)
+{
+    m_reports = &out;
+    return *this;
+}
+
+ThreadPool& Analyzer::pool()
+{
+    // created lazily, so withThreads() can be called anywhere in the chain
+    if (!m_pool)
+    {
+        m_pool = std::make_unique<ThreadPool>(m_threads);
+    }
+    return *m_pool;
+}
+
+std::vector<parsing::Routine*> Analyzer::routines() const
+{
+    std::vector<parsing::Routine*> result;
+    for (auto& decl : m_program->m_declarations)
+    {
+        if (auto* routine = dynamic_cast<parsing::Routine*>(decl.get()))
+        {
+            result.push_back(routine);
+        }
+    }
+    return result;
+}
+
+void Analyzer::done()
+{
+    if (!m_errors.empty())
+    {
+        throw std::runtime_error("Analysis failed with " + std::to_string(m_errors.size()) + " error(s)");
+    }
+
+    // on the first round every pass looks at every routine
+    for (auto& pass : m_passes)
+    {
+        for (auto* routine : routines())
+        {
+            pass.m_dirty.insert(routine->m_name);
+        }
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    size_t iterations = 0;
+    bool converged = false;
+    while (m_max_iterations == 0 || iterations < m_max_iterations)
+    {
+        if (m_max_time.count() != 0 && std::chrono::steady_clock::now() - started >= m_max_time)
+        {
+            break;
+        }
+        ++iterations;
+        if (!runPasses())
+        {
+            converged = true;
+            break;
+        }
+    }
+
+    if (m_stats)
+    {
+        printStats(iterations, converged);
+    }
+}
+
+bool Analyzer::runPasses()
+{
+    bool changed = false;
+    for (size_t idx = 0; idx < m_passes.size(); ++idx)
+    {
+        auto& pass = m_passes[idx];
+
+        if (pass.m_on_program)
+        {
+            if (!pass.m_program_dirty)
+            {
+                continue;
+            }
+            pass.m_program_dirty = false;
+            pass.m_dirty.clear();
+
+            PassResult result = pass.m_on_program(pass.m_stats.m_remarks);
+            pass.m_stats.m_runs++;
+            if (result.m_changed)
+            {
+                pass.m_stats.m_changes++;
+                markChanged(idx, result.m_dirty);
+                changed = true;
+            }
+            continue;
+        }
+
+        std::vector<parsing::Routine*> todo;
+        for (auto* routine : routines())
+        {
+            if (pass.m_dirty.contains(routine->m_name))
+            {
+                todo.push_back(routine);
+            }
+        }
+        pass.m_dirty.clear();
+        pass.m_program_dirty = false;
+
+        auto outcomes = forEachRoutine(todo, pass.m_on_routine);
+
+        std::unordered_set<std::string> touched;
+        for (size_t routine_idx = 0; routine_idx < todo.size(); ++routine_idx)
+        {
+            auto& outcome = outcomes[routine_idx];
+            pass.m_stats.m_runs++;
+            pass.m_stats.m_remarks.insert(
+                pass.m_stats.m_remarks.end(), outcome.m_remarks.begin(), outcome.m_remarks.end());
+            if (outcome.m_changed)
+            {
+                pass.m_stats.m_changes++;
+                touched.insert(todo[routine_idx]->m_name);
+            }
+        }
+
+        if (!touched.empty())
+        {
+            markChanged(idx, touched);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+void Analyzer::markChanged(size_t by_pass, const std::unordered_set<std::string>& routines)
+{
+    for (size_t idx = 0; idx < m_passes.size(); ++idx)
+    {
+        if (idx == by_pass)
+        {
+            continue;
+        }
+        m_passes[idx].m_dirty.insert(routines.begin(), routines.end());
+        m_passes[idx].m_program_dirty = true;
+    }
+}
+
+void Analyzer::printStats(size_t iterations, bool converged) const
+{
+    *m_reports << "\nOptimization pipeline " << (converged ? "converged after " : "stopped (budget) after ")
+              << iterations << " iteration(s):\n";
+    for (const auto& pass : m_passes)
+    {
+        const auto& stats = pass.m_stats;
+        *m_reports << "  " << stats.m_name << ": " << stats.m_runs << " run(s), " << stats.m_changes
+                  << " change(s)\n";
+        for (const auto& remark : stats.m_remarks)
+        {
+            *m_reports << "      " << remark << '\n';
+        }
+    }
+}
@@ -1,57 +1,277 @@
 #pragma once
 
+#include "analyzer/thread-pool.hpp"
 #include "parser/AST-node.hpp"
+#include "parser/routine.hpp"
 
+#include <chrono>
+#include <concepts>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <functional>
+#include <iostream>
 #include <memory>
+#include <optional>
+#include <string>
+#include <typeinfo>
+#include <unordered_set>
 #include <vector>
 
 /*
- *  This class is responsible for application of various 
+ *  Checks that build the global environment (top-level types and
+ *  routine signatures) first, and then check each routine on its own.
+*/
+template <typename Check>
+concept RoutineLocalCheck = requires(Check& check, parsing::Routine& routine) {
+    {
+        check.collectGlobals()
+    } -> std::same_as<std::vector<std::string>>;
+    {
+        check.checkErrors(routine)
+    } -> std::same_as<std::vector<std::string>>;
+};
+
+/*
+ *  What a whole-program optimisation reports back to the pipeline:
+ *  whether it changed anything and which routines it touched.
+*/
+struct PassResult
+{
+    bool m_changed = false;
+    std::unordered_set<std::string> m_dirty;
+};
+
+/*
+ *  Optimisations that only ever look inside a single routine.
+ *  apply() tells whether the routine was changed.
+*/
+template <typename Optimization>
+concept RoutineLocalOptimization = requires(Optimization& opt, parsing::Routine& routine) {
+    {
+        opt.apply(routine)
+    } -> std::convertible_to<bool>;
+};
+
+/*
+ *  Optimisations that need the whole program (call graph and such).
+*/
+template <typename Optimization>
+concept ProgramOptimization = requires(Optimization& opt) {
+    {
+        opt.apply()
+    } -> std::same_as<PassResult>;
+};
+
+/*
+ *  Optimisations may explain what they did, it is printed with --stats.
+*/
+template <typename Optimization>
+concept HasRemarks = requires(Optimization& opt) {
+    {
+        opt.m_remarks
+    } -> std::convertible_to<std::vector<std::string>>;
+};
+
+struct PassStatistics
+{
+    std::string m_name;
+    size_t m_runs = 0;
+    size_t m_changes = 0;
+    std::vector<std::string> m_remarks;
+};
+
+/*
+ *  This class is responsible for application of various
  *  checks and optimisation techniques to the program AST.
  *
- *       It is supposed to be used in cascading. 
+ *       It is supposed to be used in cascading.
  *          (our favourite builder pattern)
+ *
+ *  Routines are independent once the global environment is known,
+ *  so routine-local checks and optimisations run on a thread pool.
+ *  Errors are still reported in source order.
+ *
+ *  Checks are applied right away. Optimisations are only registered,
+ *  done() runs them as a pipeline until nothing changes anymore
+ *  (or the budget runs out). After the first round a pass is re-run
+ *  only on the routines some other pass has changed since.
 */
 class Analyzer
 {
 public:
     explicit Analyzer(std::shared_ptr<parsing::Program> program);
 
+    /*
+     * 0 means "as many as the hardware has"
+    */
+    Analyzer& withThreads(size_t threads);
+
+    /*
+     * Limits of the optimisation pipeline, 0 means no limit.
+    */
+    Analyzer& withBudget(size_t iterations, std::chrono::milliseconds time);
+
+    Analyzer& withStats(bool enabled);
+
+    /*
+     * Where the errors of the checks and the statistics are printed,
+     * std::cout unless told otherwise.
+    */
+    Analyzer& withReportsTo(std::ostream& out);
+
     template <typename Check>
     Analyzer& withCheckOf()
     {
-        Check instance(m_program);
-        std::vector<std::string> errors = instance.checkErrors();
-        if (!errors.empty())
+        std::vector<std::string> errors;
+        if constexpr (RoutineLocalCheck<Check>)
         {
-            for (auto& err : errors)
+            Check global(m_program);
+            errors = global.collectGlobals();
+            if (errors.empty())
             {
-                std::cout << err << '\n';
-                m_errors.push_back(err);
+                auto per_routine = forEachRoutine(
+                    routines(),
+                    [&global](parsing::Routine& routine)
+                    {
+                        Check local(global);
+                        return local.checkErrors(routine);
+                    });
+                for (auto& routine_errors : per_routine)
+                {
+                    errors.insert(errors.end(), routine_errors.begin(), routine_errors.end());
+                }
             }
         }
+        else
+        {
+            Check instance(m_program);
+            errors = instance.checkErrors();
+        }
+
+        for (auto& err : errors)
+        {
+            *m_reports << err << '\n';
+            m_errors.push_back(err);
+        }
         return *this;
     }
 
     template <class Optimization>
     Analyzer& withOptimizationOf()
     {
-        /* 
-         * No need to apply any operations 
-         * as program contains errors
-        */
-        if (!m_errors.empty())
+        Pass pass;
+        pass.m_stats.m_name = passName<Optimization>();
+
+        if constexpr (RoutineLocalOptimization<Optimization>)
         {
-            return *this;
+            pass.m_on_routine = [program = m_program](parsing::Routine& routine)
+            {
+                Optimization opt(program);
+                RoutineOutcome outcome;
+                outcome.m_changed = opt.apply(routine);
+                if constexpr (HasRemarks<Optimization>)
+                {
+                    outcome.m_remarks = std::move(opt.m_remarks);
+                }
+                return outcome;
+            };
         }
-        Optimization opt(m_program);
-        opt.apply();
+        else
+        {
+            static_assert(ProgramOptimization<Optimization>, "an optimization must implement apply()");
+            pass.m_on_program = [program = m_program](std::vector<std::string>& remarks)
+            {
+                Optimization opt(program);
+                PassResult result = opt.apply();
+                if constexpr (HasRemarks<Optimization>)
+                {
+                    remarks.insert(remarks.end(), opt.m_remarks.begin(), opt.m_remarks.end());
+                }
+                return result;
+            };
+        }
+
+        m_passes.push_back(std::move(pass));
         return *this;
     }
 
+    /*
+     * Runs the optimisation pipeline.
+     * Throws if any of the checks reported an error.
+    */
     void done();
 
 private:
+    struct RoutineOutcome
+    {
+        bool m_changed = false;
+        std::vector<std::string> m_remarks;
+    };
+
+    struct Pass
+    {
+        std::function<RoutineOutcome(parsing::Routine&)> m_on_routine;
+        std::function<PassResult(std::vector<std::string>&)> m_on_program;
+
+        // routines changed by other passes since this one last looked at them
+        std::unordered_set<std::string> m_dirty;
+        bool m_program_dirty = true;
+
+        PassStatistics m_stats;
+    };
+
+    template <typename T>
+    static std::string passName()
+    {
+        int status = 0;
+        char* demangled = abi::__cxa_demangle(typeid(T).name(), nullptr, nullptr, &status);
+        std::string name = status == 0 ? demangled : typeid(T).name();
+        std::free(demangled);
+        return name;
+    }
+
+    std::vector<parsing::Routine*> routines() const;
+
+    /*
+     * Runs fn on the given routines concurrently.
+     * Results are returned in the same order as the routines.
+    */
+    template <typename Fn>
+    auto forEachRoutine(const std::vector<parsing::Routine*>& routines, Fn&& fn)
+        -> std::vector<std::invoke_result_t<Fn, parsing::Routine&>>
+    {
+        // optional<> keeps every slot a separate object, even for bool results
+        using Result = std::invoke_result_t<Fn, parsing::Routine&>;
+        std::vector<std::optional<Result>> slots(routines.size());
+        pool().forEach(routines.size(), [&](size_t idx) { slots[idx] = fn(*routines[idx]); });
+
+        std::vector<Result> results;
+        results.reserve(slots.size());
+        for (auto& slot : slots)
+        {
+            results.push_back(std::move(*slot));
+        }
+        return results;
+    }
+
+    /*
+     * One round over all the passes, returns whether anything changed.
+    */
+    bool runPasses();
+    void markChanged(size_t by_pass, const std::unordered_set<std::string>& routines);
+    void printStats(size_t iterations, bool converged) const;
+
+    ThreadPool& pool();
+
     std::shared_ptr<parsing::Program> m_program;
     std::vector<std::string> m_errors;
+    std::vector<Pass> m_passes;
+
+    size_t m_threads = 0;
+    std::unique_ptr<ThreadPool> m_pool;
+
+    size_t m_max_iterations = 8;
+    std::chrono::milliseconds m_max_time { 0 };
+    bool m_stats = false;
+    std::ostream* m_reports = &std::cout;
 };
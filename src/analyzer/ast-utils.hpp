@@ -0,0 +1,536 @@
+#pragma once
+
+#include "parser/routine.hpp"
+#include "parser/visitor/recursive-visitor.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/*
+ *  Small read-only queries over the AST shared by the strategies.
+*/
+namespace analysis
+{
+
+/*
+ * Names of all the variables that are assigned to somewhere inside a node
+ * (only the head of a chain, `a[1].x := 5` assigns to `a`).
+*/
+struct AssignedNames : public parsing::RecursiveVisitor
+{
+    void visit(parsing::Assignment& node) override
+    {
+        m_names.insert(node.m_modifiable->m_head_name);
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    std::unordered_set<std::string> m_names;
+};
+
+inline std::unordered_set<std::string> assignedNames(parsing::ASTNode& node)
+{
+    AssignedNames collector;
+    node.accept(collector);
+    return std::move(collector.m_names);
+}
+
+/*
+ * Names of the user routines called inside a node, once per call site.
+ * Std functions are not included.
+*/
+struct CalledNames : public parsing::RecursiveVisitor
+{
+    void visit(parsing::RoutineCall& node) override
+    {
+        m_names.push_back(node.m_routine_name);
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    std::vector<std::string> m_names;
+};
+
+inline std::vector<std::string> calledNames(parsing::ASTNode& node)
+{
+    CalledNames collector;
+    node.accept(collector);
+    return std::move(collector.m_names);
+}
+
+/*
+ * Names of all the variables read or written inside a node.
+*/
+struct UsedNames : public parsing::RecursiveVisitor
+{
+    void visit(parsing::Modifiable& node) override
+    {
+        m_names.insert(node.m_head_name);
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    std::unordered_set<std::string> m_names;
+};
+
+inline std::unordered_set<std::string> usedNames(parsing::ASTNode& node)
+{
+    UsedNames collector;
+    node.accept(collector);
+    return std::move(collector.m_names);
+}
+
+/*
+ * Names of all the types a node refers to: variable and parameter types,
+ * field types of records, element types of arrays and so on.
+*/
+struct ReferencedTypes : public parsing::RecursiveVisitor
+{
+    void visit(parsing::Type& node) override
+    {
+        m_names.insert(node.m_name);
+    }
+
+    void visit(parsing::RecordType& node) override
+    {
+        m_names.insert(node.m_name);
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    void visit(parsing::PrimitiveVariable& node) override
+    {
+        node.m_type->accept(*this);
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    void visit(parsing::RoutineParameter& node) override
+    {
+        m_names.insert(node.m_type);
+    }
+
+    void visit(parsing::Routine& node) override
+    {
+        m_names.insert(node.return_type);
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    std::unordered_set<std::string> m_names;
+};
+
+inline std::unordered_set<std::string> referencedTypes(parsing::ASTNode& node)
+{
+    ReferencedTypes collector;
+    node.accept(collector);
+    return std::move(collector.m_names);
+}
+
+/*
+ * Names of all the variables declared inside a node, loop iterators included.
+*/
+struct DeclaredNames : public parsing::RecursiveVisitor
+{
+    void visit(parsing::PrimitiveVariable& node) override
+    {
+        m_names.insert(node.m_name);
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    void visit(parsing::ArrayVariable& node) override
+    {
+        m_names.insert(node.m_name);
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    void visit(parsing::For& node) override
+    {
+        m_names.insert(node.m_identifier->m_name);
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    std::unordered_set<std::string> m_names;
+};
+
+inline std::unordered_set<std::string> declaredNames(parsing::ASTNode& node)
+{
+    DeclaredNames collector;
+    node.accept(collector);
+    return std::move(collector.m_names);
+}
+
+/*
+ * The first N such that no variable in the node is called `<prefix>N`
+ * or ends with it. Passes use it to name the variables they introduce.
+*/
+inline size_t firstFreeIndex(parsing::ASTNode& node, const std::string& prefix)
+{
+    size_t next = 1;
+    for (auto& name : declaredNames(node))
+    {
+        auto at = name.rfind(prefix);
+        if (at == std::string::npos)
+        {
+            continue;
+        }
+        auto digits = name.substr(at + prefix.size());
+        if (!digits.empty() && std::all_of(digits.begin(), digits.end(), [](unsigned char c) { return std::isdigit(c); }))
+        {
+            next = std::max(next, static_cast<size_t>(std::stoul(digits)) + 1);
+        }
+    }
+    return next;
+}
+
+/*
+ * Whether two expressions are written the same way. Calls are never
+ * the same, they may return something else every time.
+*/
+inline bool sameExpression(parsing::Expression& left, parsing::Expression& right)
+{
+    if (auto* integer = dynamic_cast<parsing::Integer*>(&left))
+    {
+        auto* other = dynamic_cast<parsing::Integer*>(&right);
+        return other && other->m_value == integer->m_value;
+    }
+    if (auto* real = dynamic_cast<parsing::Real*>(&left))
+    {
+        auto* other = dynamic_cast<parsing::Real*>(&right);
+        return other && other->m_value == real->m_value;
+    }
+    if (auto* boolean = dynamic_cast<parsing::Boolean*>(&left))
+    {
+        auto* other = dynamic_cast<parsing::Boolean*>(&right);
+        return other && other->m_value == boolean->m_value;
+    }
+    if (auto* math = dynamic_cast<parsing::Math*>(&left))
+    {
+        auto* other = dynamic_cast<parsing::Math*>(&right);
+        return other && other->m_grammar == math->m_grammar && sameExpression(*math->m_left, *other->m_left)
+            && sameExpression(*math->m_right, *other->m_right);
+    }
+    auto* modifiable = dynamic_cast<parsing::Modifiable*>(&left);
+    auto* other = dynamic_cast<parsing::Modifiable*>(&right);
+    if (!modifiable || !other || modifiable->m_head_name != other->m_head_name
+        || modifiable->m_chain.size() != other->m_chain.size())
+    {
+        return false;
+    }
+    for (size_t idx = 0; idx < modifiable->m_chain.size(); ++idx)
+    {
+        auto* index = dynamic_cast<parsing::ArrayAccess*>(modifiable->m_chain[idx].get());
+        auto* other_index = dynamic_cast<parsing::ArrayAccess*>(other->m_chain[idx].get());
+        auto* field = dynamic_cast<parsing::RecordAccess*>(modifiable->m_chain[idx].get());
+        auto* other_field = dynamic_cast<parsing::RecordAccess*>(other->m_chain[idx].get());
+        if (index && other_index && sameExpression(*index->access, *other_index->access))
+        {
+            continue;
+        }
+        if (field && other_field && field->identifier == other_field->identifier)
+        {
+            continue;
+        }
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Whether an expression may be evaluated where the program would not
+ * evaluate it: it calls nothing, divides only by non-zero constants
+ * (and never by -1) and reads arrays only at indices proven in bounds.
+*/
+inline bool isSpeculatable(parsing::Expression& expr)
+{
+    if (auto* modifiable = dynamic_cast<parsing::Modifiable*>(&expr))
+    {
+        for (auto& item : modifiable->m_chain)
+        {
+            auto* index = dynamic_cast<parsing::ArrayAccess*>(item.get());
+            if (index && (!index->m_in_bounds || !isSpeculatable(*index->access)))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    if (auto* math = dynamic_cast<parsing::Math*>(&expr))
+    {
+        if (!isSpeculatable(*math->m_left) || !isSpeculatable(*math->m_right))
+        {
+            return false;
+        }
+        if (math->m_grammar == GrammarUnit::DIVISION || math->m_grammar == GrammarUnit::MOD)
+        {
+            auto* integer = dynamic_cast<parsing::Integer*>(math->m_right.get());
+            auto* real = dynamic_cast<parsing::Real*>(math->m_right.get());
+            return (integer && integer->m_value != 0 && integer->m_value != -1) || (real && real->m_value != 0);
+        }
+        return true;
+    }
+    return dynamic_cast<parsing::Integer*>(&expr) || dynamic_cast<parsing::Real*>(&expr)
+        || dynamic_cast<parsing::Boolean*>(&expr);
+}
+
+/*
+ * Resolves type names against the top-level declarations of the program:
+ * aliases are followed down to arrays, records and primitive types.
+*/
+struct TypeResolver
+{
+    explicit TypeResolver(std::shared_ptr<parsing::Program> program) : m_ast(std::move(program))
+    {
+    }
+
+    static bool isPrimitive(const std::string& name)
+    {
+        return name == "integer" || name == "real" || name == "boolean";
+    }
+
+    std::shared_ptr<parsing::Type> resolve(std::shared_ptr<parsing::Type> type) const
+    {
+        // aliases can't be cyclic, but a broken program should not hang us
+        for (int depth = 0; type && depth < 64; ++depth)
+        {
+            if (std::dynamic_pointer_cast<parsing::ArrayType>(type)
+                || std::dynamic_pointer_cast<parsing::RecordType>(type))
+            {
+                return type;
+            }
+            if (auto alias = std::dynamic_pointer_cast<parsing::TypeAliasing>(type))
+            {
+                type = alias->m_from;
+                continue;
+            }
+            if (m_hidden.contains(type->m_name))
+            {
+                return nullptr;
+            }
+            if (isPrimitive(type->m_name))
+            {
+                return type;
+            }
+            type = global(type->m_name);
+        }
+        return nullptr;
+    }
+
+    std::shared_ptr<parsing::ArrayType> asArray(std::shared_ptr<parsing::Type> type) const
+    {
+        return std::dynamic_pointer_cast<parsing::ArrayType>(resolve(std::move(type)));
+    }
+
+    /*
+     * "integer", "real" or "boolean", empty for anything else.
+    */
+    std::string primitiveName(std::shared_ptr<parsing::Type> type) const
+    {
+        type = resolve(std::move(type));
+        if (!type || !isPrimitive(type->m_name))
+        {
+            return "";
+        }
+        return type->m_name;
+    }
+
+    std::shared_ptr<parsing::Type> fieldType(std::shared_ptr<parsing::Type> type, const std::string& field) const
+    {
+        auto record = std::dynamic_pointer_cast<parsing::RecordType>(resolve(std::move(type)));
+        if (!record)
+        {
+            return nullptr;
+        }
+        for (auto& decl : record->m_fields)
+        {
+            if (decl->m_name != field)
+            {
+                continue;
+            }
+            if (auto array = std::dynamic_pointer_cast<parsing::ArrayVariable>(decl))
+            {
+                return array->m_type;
+            }
+            if (auto var = std::dynamic_pointer_cast<parsing::Variable>(decl))
+            {
+                return var->m_type;
+            }
+        }
+        return nullptr;
+    }
+
+    /*
+     * Type of the element a chain like `a[1].x` ends at.
+    */
+    std::shared_ptr<parsing::Type> chainType(std::shared_ptr<parsing::Type> type, parsing::Modifiable& node) const
+    {
+        for (auto& item : node.m_chain)
+        {
+            if (dynamic_cast<parsing::ArrayAccess*>(item.get()))
+            {
+                auto array = asArray(type);
+                type = array ? array->m_type : nullptr;
+            }
+            else if (auto* field = dynamic_cast<parsing::RecordAccess*>(item.get()))
+            {
+                type = fieldType(type, field->identifier);
+            }
+        }
+        return type;
+    }
+
+    static std::optional<int64_t> sizeOf(parsing::ArrayType& array)
+    {
+        if (auto* size = dynamic_cast<parsing::Integer*>(array.m_size.get()))
+        {
+            return size->m_value;
+        }
+        return std::nullopt;
+    }
+
+    std::shared_ptr<parsing::Type> global(const std::string& name) const
+    {
+        for (auto& decl : m_ast->m_declarations)
+        {
+            if (decl->m_name == name)
+            {
+                return std::dynamic_pointer_cast<parsing::Type>(decl);
+            }
+        }
+        return nullptr;
+    }
+
+    std::shared_ptr<parsing::Program> m_ast;
+    // type names declared locally, they may hide a global type
+    std::unordered_set<std::string> m_hidden;
+};
+
+/*
+ * Who calls whom. Only calls between routines of the program are edges.
+*/
+struct CallGraph
+{
+    explicit CallGraph(parsing::Program& program)
+    {
+        for (auto& decl : program.m_declarations)
+        {
+            if (auto* routine = dynamic_cast<parsing::Routine*>(decl.get()))
+            {
+                m_routines.push_back(routine);
+                m_by_name[routine->m_name] = routine;
+            }
+        }
+        for (auto* routine : m_routines)
+        {
+            auto& callees = m_calls[routine->m_name];
+            for (auto& name : calledNames(*routine->m_body))
+            {
+                if (m_by_name.contains(name))
+                {
+                    callees.push_back(name);
+                }
+            }
+        }
+    }
+
+    /*
+     * Strongly connected components, every component comes
+     * after all the components it calls into.
+    */
+    std::vector<std::vector<std::string>> bottomUp() const
+    {
+        std::unordered_map<std::string, size_t> index;
+        std::unordered_map<std::string, size_t> lowlink;
+        std::unordered_set<std::string> on_stack;
+        std::vector<std::string> stack;
+        std::vector<std::vector<std::string>> components;
+
+        // Tarjan's algorithm, it emits the components in reverse topological order
+        std::function<void(const std::string&)> connect = [&](const std::string& name)
+        {
+            size_t next = index.size();
+            index[name] = next;
+            lowlink[name] = next;
+            stack.push_back(name);
+            on_stack.insert(name);
+
+            for (auto& callee : m_calls.at(name))
+            {
+                if (!index.contains(callee))
+                {
+                    connect(callee);
+                    lowlink[name] = std::min(lowlink[name], lowlink[callee]);
+                }
+                else if (on_stack.contains(callee))
+                {
+                    lowlink[name] = std::min(lowlink[name], index[callee]);
+                }
+            }
+
+            if (lowlink[name] == index[name])
+            {
+                std::vector<std::string> component;
+                std::string member;
+                do
+                {
+                    member = stack.back();
+                    stack.pop_back();
+                    on_stack.erase(member);
+                    component.push_back(member);
+                } while (member != name);
+                components.push_back(std::move(component));
+            }
+        };
+
+        for (auto* routine : m_routines)
+        {
+            if (!index.contains(routine->m_name))
+            {
+                connect(routine->m_name);
+            }
+        }
+        return components;
+    }
+
+    /*
+     * Routines that may end up calling themselves.
+    */
+    std::unordered_set<std::string> recursive() const
+    {
+        std::unordered_set<std::string> result;
+        for (auto& component : bottomUp())
+        {
+            const auto& calls = m_calls.at(component.front());
+            bool self_call = std::find(calls.begin(), calls.end(), component.front()) != calls.end();
+            if (component.size() > 1 || self_call)
+            {
+                result.insert(component.begin(), component.end());
+            }
+        }
+        return result;
+    }
+
+    /*
+     * How many call sites each routine has in the whole program.
+    */
+    std::unordered_map<std::string, size_t> callSites() const
+    {
+        std::unordered_map<std::string, size_t> result;
+        for (const auto& [caller, callees] : m_calls)
+        {
+            for (const auto& callee : callees)
+            {
+                result[callee]++;
+            }
+        }
+        return result;
+    }
+
+    std::vector<parsing::Routine*> m_routines;
+    std::unordered_map<std::string, parsing::Routine*> m_by_name;
+    std::unordered_map<std::string, std::vector<std::string>> m_calls;
+};
+
+} // namespace analysis
@@ -0,0 +1,520 @@
+#pragma once
+
+#include "analyzer/ast-utils.hpp"
+#include "analyzer/strategies/constant-fold.hpp"
+#include "analyzer/strategies/inline-routines.hpp"
+#include "parser/AST-node.hpp"
+#include "parser/body.hpp"
+#include "parser/declaration.hpp"
+#include "parser/expression.hpp"
+#include "parser/return.hpp"
+#include "parser/routine.hpp"
+#include "parser/statement.hpp"
+#include "parser/std-function.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ *  Compile-time evaluation of routine calls.
+*/
+namespace evaluation
+{
+
+/*
+ *  The call can't be evaluated at compile time: it prints, traps, reads
+ *  a variable that was never set or runs over the limits.
+*/
+struct Unevaluable : public std::runtime_error
+{
+    using std::runtime_error::runtime_error;
+};
+
+/*
+ *  Contents of a variable: a scalar, or the elements of an array and the
+ *  fields of a record (in declaration order) together with their type.
+*/
+struct Value
+{
+    std::shared_ptr<parsing::Type> m_type;
+    std::optional<folding::Constant> m_scalar;
+    std::vector<Value> m_items;
+};
+
+/*
+ *  How much work one evaluation may do before it is given up.
+*/
+struct Limits
+{
+    // statements and expressions evaluated
+    size_t m_max_steps = 1000000;
+    // scalars alive at once, array elements and record fields included
+    size_t m_max_cells = 1 << 16;
+    size_t m_max_depth = 64;
+};
+
+/*
+ *  An interpreter over the AST, with the semantics of the generated code:
+ *  32 bit wrapping integers, arrays indexed from 0, arguments passed by
+ *  value. Anything it can't reproduce exactly makes the call Unevaluable.
+*/
+class Interpreter
+{
+public:
+    explicit Interpreter(std::shared_ptr<parsing::Program> program) : m_types(program), m_graph(*program)
+    {
+    }
+
+    std::optional<folding::Constant> call(
+        const std::string& routine, const std::vector<folding::Constant>& args) noexcept
+    {
+        m_steps = 0;
+        m_cells = 0;
+        m_depth = 0;
+        m_frame.clear();
+        m_failure.clear();
+        try
+        {
+            std::vector<Value> values;
+            for (auto& arg : args)
+            {
+                values.push_back({ nullptr, arg, {} });
+            }
+            auto result = invoke(routine, std::move(values));
+            if (!result.m_scalar)
+            {
+                m_failure = "result is not a scalar";
+                return std::nullopt;
+            }
+            return result.m_scalar;
+        }
+        catch (const Unevaluable& err)
+        {
+            m_failure = err.what();
+            return std::nullopt;
+        }
+    }
+
+    Limits m_limits;
+
+    // why the last call could not be evaluated
+    std::string m_failure;
+
+private:
+    using Scope = std::unordered_map<std::string, Value>;
+
+    enum class Flow
+    {
+        NEXT,
+        RETURN
+    };
+
+    Value invoke(const std::string& name, std::vector<Value> args)
+    {
+        if (!m_graph.m_by_name.contains(name))
+        {
+            throw Unevaluable("unknown routine " + name);
+        }
+        auto& routine = *m_graph.m_by_name.at(name);
+        if (m_depth >= m_limits.m_max_depth)
+        {
+            throw Unevaluable("too deep");
+        }
+        // a local type would have to hide the global of the same name
+        if (inlining::shapeOf(*routine.m_body).m_declares_types)
+        {
+            throw Unevaluable(name + " declares types");
+        }
+
+        std::vector<Scope> frame(1);
+        for (size_t idx = 0; idx < routine.m_params.size(); ++idx)
+        {
+            auto type = std::make_shared<parsing::PrimitiveType>(routine.m_params[idx]->m_type);
+            auto& value = frame.front()[routine.m_params[idx]->m_name];
+            value = make(type);
+            store(value, std::move(args.at(idx)));
+        }
+
+        m_depth++;
+        std::swap(m_frame, frame);
+        m_result.reset();
+        auto flow = execute(*routine.m_body);
+        std::swap(m_frame, frame);
+        m_depth--;
+        release(frame.front());
+
+        if (flow != Flow::RETURN && !routine.return_type.empty())
+        {
+            throw Unevaluable(name + " ends without a return");
+        }
+        auto result = flow == Flow::RETURN && m_result ? std::move(*m_result) : Value {};
+        m_result.reset();
+        return result;
+    }
+
+    Flow execute(parsing::Body& body)
+    {
+        m_frame.emplace_back();
+        for (auto& item : body.m_items)
+        {
+            if (execute(*item) == Flow::RETURN)
+            {
+                release(m_frame.back());
+                m_frame.pop_back();
+                return Flow::RETURN;
+            }
+        }
+        release(m_frame.back());
+        m_frame.pop_back();
+        return Flow::NEXT;
+    }
+
+    Flow execute(parsing::ASTNode& item)
+    {
+        step();
+        if (auto* var = dynamic_cast<parsing::Variable*>(&item))
+        {
+            // the type of an array declared in place is in the ArrayVariable, Variable has its elements
+            auto* array = dynamic_cast<parsing::ArrayVariable*>(var);
+            auto value = make(array ? array->m_type : var->m_type);
+            if (var->m_value)
+            {
+                store(value, evaluate(*var->m_value));
+            }
+            // declared twice in the same body, the first one is gone
+            if (auto old = m_frame.back().find(var->m_name); old != m_frame.back().end())
+            {
+                m_cells -= cellsOf(old->second);
+            }
+            m_frame.back()[var->m_name] = std::move(value);
+        }
+        else if (auto* assignment = dynamic_cast<parsing::Assignment*>(&item))
+        {
+            auto value = evaluate(*assignment->m_expression);
+            store(locate(*assignment->m_modifiable), std::move(value));
+        }
+        else if (auto* ret = dynamic_cast<parsing::ReturnStatement*>(&item))
+        {
+            m_result = ret->m_expr ? evaluate(*ret->m_expr) : Value {};
+            return Flow::RETURN;
+        }
+        else if (dynamic_cast<parsing::StdFunction*>(&item))
+        {
+            throw Unevaluable("prints");
+        }
+        else if (auto* call = dynamic_cast<parsing::RoutineCall*>(&item))
+        {
+            invoke(call->m_routine_name, arguments(*call));
+        }
+        else if (auto* branch = dynamic_cast<parsing::If*>(&item))
+        {
+            if (condition(*branch->m_condition))
+            {
+                return execute(*branch->m_then);
+            }
+            return branch->m_else ? execute(*branch->m_else) : Flow::NEXT;
+        }
+        else if (auto* loop = dynamic_cast<parsing::While*>(&item))
+        {
+            while (condition(*loop->m_condition))
+            {
+                if (execute(*loop->m_body) == Flow::RETURN)
+                {
+                    return Flow::RETURN;
+                }
+            }
+        }
+        else if (auto* loop = dynamic_cast<parsing::For*>(&item))
+        {
+            return execute(*loop);
+        }
+        else if (auto* nested = dynamic_cast<parsing::Body*>(&item))
+        {
+            return execute(*nested);
+        }
+        else if (!dynamic_cast<parsing::Type*>(&item))
+        {
+            throw Unevaluable("unknown statement");
+        }
+        return Flow::NEXT;
+    }
+
+    /*
+     * The iterator is an ordinary variable, read back after every
+     * iteration. The ends are evaluated once, a reverse loop walks the
+     * same half-open range from end - 1 down to begin.
+    */
+    Flow execute(parsing::For& loop)
+    {
+        auto begin = integer(*loop.m_range->m_begin);
+        auto end = integer(*loop.m_range->m_end);
+        bool reverse = loop.m_range->m_reverse;
+        if (begin >= end)
+        {
+            return Flow::NEXT;
+        }
+
+        auto& name = loop.m_identifier->m_name;
+        m_frame.emplace_back();
+        m_frame.back()[name] = {
+            std::make_shared<parsing::PrimitiveType>("integer"),
+            folding::Constant::ofInteger(reverse ? static_cast<int64_t>(end) - 1 : begin), {}
+        };
+        while (true)
+        {
+            if (execute(*loop.m_body) == Flow::RETURN)
+            {
+                m_frame.pop_back();
+                return Flow::RETURN;
+            }
+            // like the generated code, the iterator is tested before the step, which never wraps
+            auto& iterator = m_frame.back().at(name);
+            auto current = iterator.m_scalar->m_int;
+            if (reverse ? current <= begin : current >= static_cast<int64_t>(end) - 1)
+            {
+                break;
+            }
+            iterator.m_scalar = folding::Constant::ofInteger(static_cast<int64_t>(current) + (reverse ? -1 : 1));
+        }
+        m_frame.pop_back();
+        return Flow::NEXT;
+    }
+
+    Value evaluate(parsing::Expression& expr)
+    {
+        step();
+        if (auto value = folding::asConstant(expr))
+        {
+            return { nullptr, value, {} };
+        }
+        if (auto* modifiable = dynamic_cast<parsing::Modifiable*>(&expr))
+        {
+            auto& value = locate(*modifiable);
+            if (value.m_items.empty() && !value.m_scalar)
+            {
+                throw Unevaluable("reads " + modifiable->m_head_name + " before it is set");
+            }
+            return value;
+        }
+        if (auto* math = dynamic_cast<parsing::Math*>(&expr))
+        {
+            auto left = scalar(*math->m_left);
+            // the right operand of and/or is only evaluated when it decides
+            bool is_and = math->m_grammar == GrammarUnit::AND;
+            if ((is_and || math->m_grammar == GrammarUnit::OR) && left.m_kind == folding::Constant::Kind::BOOLEAN
+                && left.m_bool != is_and)
+            {
+                return { nullptr, left, {} };
+            }
+            auto result = folding::evaluate(math->m_grammar, left, scalar(*math->m_right));
+            if (!result)
+            {
+                throw Unevaluable("operation traps or mixes types");
+            }
+            return { nullptr, result, {} };
+        }
+        if (auto* result = dynamic_cast<parsing::RoutineCallResult*>(&expr))
+        {
+            auto& call = *result->m_routine_call;
+            return invoke(call.m_routine_name, arguments(call));
+        }
+        throw Unevaluable("unknown expression");
+    }
+
+    std::vector<Value> arguments(parsing::RoutineCall& call)
+    {
+        std::vector<Value> args;
+        for (auto& param : call.m_parameters)
+        {
+            args.push_back(evaluate(*param));
+        }
+        return args;
+    }
+
+    folding::Constant scalar(parsing::Expression& expr)
+    {
+        auto value = evaluate(expr);
+        if (!value.m_scalar)
+        {
+            throw Unevaluable("aggregate where a scalar is expected");
+        }
+        return *value.m_scalar;
+    }
+
+    bool condition(parsing::Expression& expr)
+    {
+        auto value = scalar(expr);
+        if (value.m_kind != folding::Constant::Kind::BOOLEAN)
+        {
+            throw Unevaluable("condition is not a boolean");
+        }
+        return value.m_bool;
+    }
+
+    int32_t integer(parsing::Expression& expr)
+    {
+        auto value = scalar(expr);
+        if (value.m_kind != folding::Constant::Kind::INTEGER)
+        {
+            throw Unevaluable("not an integer");
+        }
+        return value.m_int;
+    }
+
+    /*
+     * The variable, element or field a modifiable refers to.
+    */
+    Value& locate(parsing::Modifiable& modifiable)
+    {
+        Value* value = nullptr;
+        for (auto scope = m_frame.rbegin(); scope != m_frame.rend() && !value; ++scope)
+        {
+            auto found = scope->find(modifiable.m_head_name);
+            value = found != scope->end() ? &found->second : nullptr;
+        }
+        if (!value)
+        {
+            throw Unevaluable("unknown variable " + modifiable.m_head_name);
+        }
+
+        for (auto& item : modifiable.m_chain)
+        {
+            if (auto* index = dynamic_cast<parsing::ArrayAccess*>(item.get()))
+            {
+                auto at = integer(*index->access);
+                if (!m_types.asArray(value->m_type) || at < 0 || static_cast<size_t>(at) >= value->m_items.size())
+                {
+                    throw Unevaluable("index out of bounds");
+                }
+                value = &value->m_items[at];
+            }
+            else if (auto* field = dynamic_cast<parsing::RecordAccess*>(item.get()))
+            {
+                value = &value->m_items.at(fieldIndex(value->m_type, field->identifier));
+            }
+        }
+        return *value;
+    }
+
+    size_t fieldIndex(const std::shared_ptr<parsing::Type>& type, const std::string& name) const
+    {
+        auto record = std::dynamic_pointer_cast<parsing::RecordType>(m_types.resolve(type));
+        for (size_t idx = 0; record && idx < record->m_fields.size(); ++idx)
+        {
+            if (record->m_fields[idx]->m_name == name)
+            {
+                return idx;
+            }
+        }
+        throw Unevaluable("unknown field " + name);
+    }
+
+    /*
+     * The variables of a scope that ends give their cells back.
+    */
+    void release(const Scope& scope)
+    {
+        for (auto& [name, value] : scope)
+        {
+            m_cells -= cellsOf(value);
+        }
+    }
+
+    static size_t cellsOf(const Value& value)
+    {
+        size_t cells = 1;
+        for (auto& item : value.m_items)
+        {
+            cells += cellsOf(item);
+        }
+        return cells;
+    }
+
+    /*
+     * A variable of the given type with nothing set yet.
+    */
+    Value make(const std::shared_ptr<parsing::Type>& type)
+    {
+        if (++m_cells > m_limits.m_max_cells)
+        {
+            throw Unevaluable("too much memory");
+        }
+        auto resolved = m_types.resolve(type);
+        if (!resolved)
+        {
+            throw Unevaluable("unknown type");
+        }
+
+        Value value { resolved, std::nullopt, {} };
+        if (auto array = std::dynamic_pointer_cast<parsing::ArrayType>(resolved))
+        {
+            auto size = integer(*array->m_size);
+            if (size < 0 || m_cells + static_cast<size_t>(size) > m_limits.m_max_cells)
+            {
+                throw Unevaluable("too much memory");
+            }
+            for (int32_t idx = 0; idx < size; ++idx)
+            {
+                value.m_items.push_back(make(array->m_type));
+            }
+        }
+        else if (auto record = std::dynamic_pointer_cast<parsing::RecordType>(resolved))
+        {
+            for (auto& field : record->m_fields)
+            {
+                auto var = std::dynamic_pointer_cast<parsing::Variable>(field);
+                if (!var)
+                {
+                    throw Unevaluable("unknown field type");
+                }
+                value.m_items.push_back(make(var->m_type));
+            }
+        }
+        return value;
+    }
+
+    /*
+     * Assignment, the generator does no conversions so neither do we.
+    */
+    void store(Value& target, Value value)
+    {
+        if (!target.m_items.empty() || !value.m_items.empty())
+        {
+            if (target.m_items.size() != value.m_items.size())
+            {
+                throw Unevaluable("aggregates of different shapes");
+            }
+            target.m_items = std::move(value.m_items);
+            return;
+        }
+        if (!value.m_scalar || value.m_scalar->typeName() != m_types.primitiveName(target.m_type))
+        {
+            throw Unevaluable("value of another type");
+        }
+        target.m_scalar = value.m_scalar;
+    }
+
+    void step()
+    {
+        if (++m_steps > m_limits.m_max_steps)
+        {
+            throw Unevaluable("too many steps");
+        }
+    }
+
+    analysis::TypeResolver m_types;
+    analysis::CallGraph m_graph;
+
+    std::vector<Scope> m_frame;
+    std::optional<Value> m_result;
+    size_t m_depth = 0;
+    size_t m_steps = 0;
+    size_t m_cells = 0;
+};
+
+} // namespace evaluation
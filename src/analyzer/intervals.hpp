@@ -0,0 +1,126 @@
+#pragma once
+
+#include "analyzer/ast-utils.hpp"
+#include "parser/expression.hpp"
+#include "parser/statement.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+/*
+ *  Integer intervals of expressions inside loops.
+*/
+namespace intervals
+{
+
+/*
+ *  All the values an integer expression may take, bounds included.
+*/
+struct Interval
+{
+    int64_t m_low;
+    int64_t m_high;
+
+    static std::optional<Interval> of(int64_t low, int64_t high)
+    {
+        // anything that could wrap around in 32 bits is unknown
+        if (low < std::numeric_limits<int32_t>::min() || high > std::numeric_limits<int32_t>::max())
+        {
+            return std::nullopt;
+        }
+        return Interval { low, high };
+    }
+
+    bool nonNegative() const
+    {
+        return m_low >= 0;
+    }
+};
+
+// intervals of the loop iterators in scope
+using Environment = std::unordered_map<std::string, Interval>;
+
+inline std::optional<Interval> evaluate(parsing::Expression& expr, const Environment& env)
+{
+    if (auto* integer = dynamic_cast<parsing::Integer*>(&expr))
+    {
+        return Interval { integer->m_value, integer->m_value };
+    }
+    if (auto* modifiable = dynamic_cast<parsing::Modifiable*>(&expr))
+    {
+        auto found = env.find(modifiable->m_head_name);
+        if (!modifiable->m_chain.empty() || found == env.end())
+        {
+            return std::nullopt;
+        }
+        return found->second;
+    }
+
+    auto* math = dynamic_cast<parsing::Math*>(&expr);
+    if (!math)
+    {
+        return std::nullopt;
+    }
+    auto left = evaluate(*math->m_left, env);
+    auto right = evaluate(*math->m_right, env);
+    if (!left || !right)
+    {
+        return std::nullopt;
+    }
+
+    switch (math->m_grammar)
+    {
+        case GrammarUnit::PLUS:
+            return Interval::of(left->m_low + right->m_low, left->m_high + right->m_high);
+        case GrammarUnit::MINUS:
+            return Interval::of(left->m_low - right->m_high, left->m_high - right->m_low);
+        case GrammarUnit::MULTIPLICATE:
+        {
+            int64_t corners[] = { left->m_low * right->m_low, left->m_low * right->m_high,
+                                  left->m_high * right->m_low, left->m_high * right->m_high };
+            return Interval::of(
+                *std::min_element(std::begin(corners), std::end(corners)),
+                *std::max_element(std::begin(corners), std::end(corners)));
+        }
+        case GrammarUnit::DIVISION:
+            if (left->nonNegative() && right->m_low > 0)
+            {
+                return Interval { left->m_low / right->m_high, left->m_high / right->m_low };
+            }
+            return std::nullopt;
+        case GrammarUnit::MOD:
+            if (left->nonNegative() && right->m_low > 0)
+            {
+                return Interval { 0, std::min(left->m_high, right->m_high - 1) };
+            }
+            return std::nullopt;
+        default:
+            return std::nullopt;
+    }
+}
+
+/*
+ *  Values the iterator of a loop takes inside its body. Only forward loops
+ *  whose body leaves the iterator alone are understood.
+*/
+inline std::optional<Interval> iteratorOf(parsing::For& loop, const Environment& env)
+{
+    if (loop.m_range->m_reverse || analysis::assignedNames(*loop.m_body).contains(loop.m_identifier->m_name))
+    {
+        return std::nullopt;
+    }
+    auto begin = evaluate(*loop.m_range->m_begin, env);
+    auto end = evaluate(*loop.m_range->m_end, env);
+    if (!begin || !end)
+    {
+        return std::nullopt;
+    }
+    return Interval { begin->m_low, end->m_high - 1 };
+}
+
+} // namespace intervals
@@ -0,0 +1,532 @@
+#pragma once
+
+#include "analyzer/ast-utils.hpp"
+#include "parser/AST-node.hpp"
+#include "parser/body.hpp"
+#include "parser/declaration.hpp"
+#include "parser/expression.hpp"
+#include "parser/return.hpp"
+#include "parser/routine.hpp"
+#include "parser/statement.hpp"
+#include "parser/std-function.hpp"
+
+#include "parser/visitor/abstract-visitor.hpp"
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace folding
+{
+
+/*
+ *  A compile-time known value of one of the primitive types.
+*/
+struct Constant
+{
+    enum class Kind
+    {
+        INTEGER,
+        REAL,
+        BOOLEAN
+    };
+
+    Kind m_kind;
+    int m_int = 0;
+    double m_real = 0;
+    bool m_bool = false;
+
+    static Constant ofInteger(int64_t value)
+    {
+        // integers are 32 bit in the generated code, so wrap around the same way
+        return { Kind::INTEGER, static_cast<int32_t>(static_cast<uint32_t>(value)) };
+    }
+
+    static Constant ofReal(double value)
+    {
+        return { Kind::REAL, 0, value };
+    }
+
+    static Constant ofBoolean(bool value)
+    {
+        return { Kind::BOOLEAN, 0, 0, value };
+    }
+
+    const char* typeName() const
+    {
+        switch (m_kind)
+        {
+            case Kind::INTEGER:
+                return "integer";
+            case Kind::REAL:
+                return "real";
+            default:
+                return "boolean";
+        }
+    }
+};
+
+inline std::optional<Constant> asConstant(parsing::Expression& expr)
+{
+    if (auto* integer = dynamic_cast<parsing::Integer*>(&expr))
+    {
+        return Constant::ofInteger(integer->m_value);
+    }
+    if (auto* real = dynamic_cast<parsing::Real*>(&expr))
+    {
+        return Constant::ofReal(real->m_value);
+    }
+    if (auto* boolean = dynamic_cast<parsing::Boolean*>(&expr))
+    {
+        return Constant::ofBoolean(boolean->m_value);
+    }
+    return std::nullopt;
+}
+
+inline std::shared_ptr<parsing::Expression> toLiteral(const Constant& value)
+{
+    switch (value.m_kind)
+    {
+        case Constant::Kind::INTEGER:
+            return std::make_shared<parsing::Integer>(value.m_int);
+        case Constant::Kind::REAL:
+            return std::make_shared<parsing::Real>(value.m_real);
+        default:
+            if (value.m_bool)
+            {
+                return std::make_shared<parsing::True>();
+            }
+            return std::make_shared<parsing::False>();
+    }
+}
+
+/*
+ *  Applies a binary operator the same way the Generator would.
+ *  Returns nothing when the result is not known at compile time
+ *  (mixed operand types, division by zero and so on).
+*/
+inline std::optional<Constant> evaluate(GrammarUnit op, const Constant& left, const Constant& right)
+{
+    if (left.m_kind != right.m_kind)
+    {
+        return std::nullopt;
+    }
+
+    if (left.m_kind == Constant::Kind::INTEGER)
+    {
+        int64_t lhs = left.m_int;
+        int64_t rhs = right.m_int;
+        switch (op)
+        {
+            case GrammarUnit::PLUS:
+                return Constant::ofInteger(lhs + rhs);
+            case GrammarUnit::MINUS:
+                return Constant::ofInteger(lhs - rhs);
+            case GrammarUnit::MULTIPLICATE:
+                return Constant::ofInteger(lhs * rhs);
+            case GrammarUnit::DIVISION:
+            case GrammarUnit::MOD:
+                // both trap at runtime, leave them there
+                if (rhs == 0 || (lhs == std::numeric_limits<int32_t>::min() && rhs == -1))
+                {
+                    return std::nullopt;
+                }
+                return Constant::ofInteger(op == GrammarUnit::DIVISION ? lhs / rhs : lhs % rhs);
+            case GrammarUnit::GREATER:
+                return Constant::ofBoolean(lhs > rhs);
+            case GrammarUnit::LESS:
+                return Constant::ofBoolean(lhs < rhs);
+            case GrammarUnit::GREATER_EQUAL:
+                return Constant::ofBoolean(lhs >= rhs);
+            case GrammarUnit::LESS_EQUAL:
+                return Constant::ofBoolean(lhs <= rhs);
+            case GrammarUnit::EQUAL:
+                return Constant::ofBoolean(lhs == rhs);
+            case GrammarUnit::NOT_EQUAL:
+                return Constant::ofBoolean(lhs != rhs);
+            default:
+                return std::nullopt;
+        }
+    }
+
+    if (left.m_kind == Constant::Kind::REAL)
+    {
+        double lhs = left.m_real;
+        double rhs = right.m_real;
+        // relations are generated as unordered comparisons, except for (not) equal
+        bool unordered = std::isnan(lhs) || std::isnan(rhs);
+        switch (op)
+        {
+            case GrammarUnit::PLUS:
+                return Constant::ofReal(lhs + rhs);
+            case GrammarUnit::MINUS:
+                return Constant::ofReal(lhs - rhs);
+            case GrammarUnit::MULTIPLICATE:
+                return Constant::ofReal(lhs * rhs);
+            case GrammarUnit::DIVISION:
+                return Constant::ofReal(lhs / rhs);
+            case GrammarUnit::GREATER:
+                return Constant::ofBoolean(unordered || lhs > rhs);
+            case GrammarUnit::LESS:
+                return Constant::ofBoolean(unordered || lhs < rhs);
+            case GrammarUnit::GREATER_EQUAL:
+                return Constant::ofBoolean(unordered || lhs >= rhs);
+            case GrammarUnit::LESS_EQUAL:
+                return Constant::ofBoolean(unordered || lhs <= rhs);
+            case GrammarUnit::EQUAL:
+                return Constant::ofBoolean(!unordered && lhs == rhs);
+            case GrammarUnit::NOT_EQUAL:
+                return Constant::ofBoolean(!unordered && lhs != rhs);
+            default:
+                return std::nullopt;
+        }
+    }
+
+    switch (op)
+    {
+        case GrammarUnit::AND:
+            return Constant::ofBoolean(left.m_bool && right.m_bool);
+        case GrammarUnit::OR:
+            return Constant::ofBoolean(left.m_bool || right.m_bool);
+        case GrammarUnit::XOR:
+            return Constant::ofBoolean(left.m_bool != right.m_bool);
+        default:
+            return std::nullopt;
+    }
+}
+
+} // namespace folding
+
+/*
+ *  Folds constant subexpressions into literals, propagates the
+ *  initialisers of scalar variables that are never assigned to,
+ *  and drops the dead arm of ifs and whiles with a constant condition.
+*/
+struct ConstantFold : public parsing::IVisitor
+{
+    explicit ConstantFold(std::shared_ptr<parsing::Program> program) : m_ast(program)
+    {
+    }
+
+    void visit(parsing::ASTNode& node) override
+    {
+    }
+
+    void visit(parsing::Program& node) override
+    {
+        for (auto& entity : node.m_declarations)
+        {
+            entity->accept(*this);
+        }
+    }
+
+    void visit(parsing::Declaration& node) override
+    {
+    }
+
+    void visit(parsing::Variable& node) override
+    {
+    }
+
+    void visit(parsing::Type& node) override
+    {
+    }
+
+    void visit(parsing::TypeAliasing& node) override
+    {
+        node.m_from->accept(*this);
+    }
+
+    void visit(parsing::ArrayType& node) override
+    {
+        fold(node.m_size);
+        node.m_type->accept(*this);
+    }
+
+    void visit(parsing::ArrayVariable& node) override
+    {
+        node.m_type->accept(*this);
+        // shadows whatever was known under this name
+        m_constants.erase(node.m_name);
+    }
+
+    void visit(parsing::PrimitiveVariable& node) override
+    {
+        m_constants.erase(node.m_name);
+        if (!node.m_value)
+        {
+            return;
+        }
+        fold(node.m_value);
+
+        auto value = folding::asConstant(*node.m_value);
+        if (value && !m_assigned.contains(node.m_name) && node.m_type->m_name == value->typeName())
+        {
+            m_constants[node.m_name] = *value;
+        }
+    }
+
+    void visit(parsing::Body& node) override
+    {
+        auto outer_scope = m_constants;
+
+        for (size_t idx = 0; idx < node.m_items.size(); ++idx)
+        {
+            m_replacement.reset();
+            m_remove = false;
+            node.m_items[idx]->accept(*this);
+
+            if (m_remove)
+            {
+                node.m_items.erase(node.m_items.begin() + idx);
+                --idx;
+                m_changed = true;
+            }
+            else if (m_replacement)
+            {
+                auto branch = std::dynamic_pointer_cast<parsing::Body>(m_replacement);
+                if (branch && !declaresAnything(*branch))
+                {
+                    // nothing can clash with the outer scope, so the branch can be spliced in
+                    node.m_items.erase(node.m_items.begin() + idx);
+                    node.m_items.insert(node.m_items.begin() + idx, branch->m_items.begin(), branch->m_items.end());
+                    idx += branch->m_items.size();
+                    --idx;
+                }
+                else
+                {
+                    node.m_items[idx] = m_replacement;
+                }
+                m_changed = true;
+            }
+        }
+        m_replacement.reset();
+        m_remove = false;
+
+        m_constants = std::move(outer_scope);
+    }
+
+    void visit(parsing::Routine& node) override
+    {
+        node.m_body->accept(*this);
+    }
+
+    void visit(parsing::RoutineCall& node) override
+    {
+        for (auto& param : node.m_parameters)
+        {
+            fold(param);
+        }
+    }
+
+    void visit(parsing::StdFunction& node) override
+    {
+        for (auto& param : node.m_parameters)
+        {
+            fold(param);
+        }
+    }
+
+    void visit(parsing::RoutineCallResult& node) override
+    {
+        node.m_routine_call->accept(*this);
+    }
+
+    void visit(parsing::RoutineParameter& node) override
+    {
+    }
+
+    void visit(parsing::Statement& node) override
+    {
+    }
+
+    void visit(parsing::Expression& node) override
+    {
+    }
+
+    void visit(parsing::True&) override
+    {
+    }
+
+    void visit(parsing::False&) override
+    {
+    }
+
+    void visit(parsing::Math& node) override
+    {
+        fold(node.m_left);
+        fold(node.m_right);
+
+        auto left = folding::asConstant(*node.m_left);
+        auto right = folding::asConstant(*node.m_right);
+        if (!left || !right)
+        {
+            return;
+        }
+
+        if (auto value = folding::evaluate(node.m_grammar, *left, *right))
+        {
+            m_folded = folding::toLiteral(*value);
+        }
+    }
+
+    void visit(parsing::Real& node) override
+    {
+    }
+
+    void visit(parsing::Boolean& node) override
+    {
+    }
+
+    void visit(parsing::Integer& node) override
+    {
+    }
+
+    void visit(parsing::Modifiable& node) override
+    {
+        if (node.m_chain.empty() && m_constants.contains(node.m_head_name))
+        {
+            m_folded = folding::toLiteral(m_constants.at(node.m_head_name));
+            return;
+        }
+        for (auto& access : node.m_chain)
+        {
+            access->accept(*this);
+        }
+    }
+
+    void visit(parsing::ArrayAccess& node) override
+    {
+        fold(node.access);
+    }
+
+    void visit(parsing::RecordAccess& node) override
+    {
+    }
+
+    void visit(parsing::ReturnStatement& node) override
+    {
+        fold(node.m_expr);
+    }
+
+    void visit(parsing::If& node) override
+    {
+        fold(node.m_condition);
+        node.m_then->accept(*this);
+        if (node.m_else.get())
+        {
+            node.m_else->accept(*this);
+        }
+
+        auto condition = folding::asConstant(*node.m_condition);
+        if (!condition || condition->m_kind != folding::Constant::Kind::BOOLEAN)
+        {
+            return;
+        }
+
+        if (condition->m_bool)
+        {
+            m_replacement = node.m_then;
+        }
+        else if (node.m_else)
+        {
+            m_replacement = node.m_else;
+        }
+        else
+        {
+            m_remove = true;
+        }
+    }
+
+    void visit(parsing::Range& node) override
+    {
+        fold(node.m_begin);
+        fold(node.m_end);
+    }
+
+    void visit(parsing::For& node) override
+    {
+        node.m_range->accept(*this);
+
+        auto outer_scope = m_constants;
+        m_constants.erase(node.m_identifier->m_name);
+        node.m_body->accept(*this);
+        m_constants = std::move(outer_scope);
+    }
+
+    void visit(parsing::While& node) override
+    {
+        fold(node.m_condition);
+        node.m_body->accept(*this);
+
+        auto condition = folding::asConstant(*node.m_condition);
+        if (condition && condition->m_kind == folding::Constant::Kind::BOOLEAN && !condition->m_bool)
+        {
+            m_remove = true;
+        }
+    }
+
+    void visit(parsing::Assignment& node) override
+    {
+        // the head is being written to, only the indices are folded
+        for (auto& access : node.m_modifiable->m_chain)
+        {
+            access->accept(*this);
+        }
+        fold(node.m_expression);
+    }
+
+    void visit(parsing::RecordType& node) override
+    {
+    }
+
+    bool apply(parsing::Routine& routine)
+    {
+        m_assigned = analysis::assignedNames(routine);
+        routine.accept(*this);
+        return m_changed;
+    }
+
+    /*
+     * Folds the expression held in the slot, replacing it when it became a literal.
+    */
+    void fold(std::shared_ptr<parsing::Expression>& slot)
+    {
+        m_folded.reset();
+        slot->accept(*this);
+        if (m_folded)
+        {
+            slot = m_folded;
+            m_folded.reset();
+            m_changed = true;
+        }
+    }
+
+    static bool declaresAnything(parsing::Body& body)
+    {
+        for (auto& item : body.m_items)
+        {
+            if (item->isVariableDecl() || dynamic_cast<parsing::Type*>(item.get()))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::shared_ptr<parsing::Program> m_ast;
+    bool m_changed = false;
+
+    // names assigned anywhere in the routine, their initialisers can not be propagated
+    std::unordered_set<std::string> m_assigned;
+    std::unordered_map<std::string, folding::Constant> m_constants;
+
+    // results of visiting an expression / a statement
+    std::shared_ptr<parsing::Expression> m_folded;
+    std::shared_ptr<parsing::ASTNode> m_replacement;
+    bool m_remove = false;
+};
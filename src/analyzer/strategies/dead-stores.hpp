@@ -0,0 +1,536 @@
+#pragma once
+
+#include "analyzer/ast-utils.hpp"
+#include "analyzer/strategies/inline-routines.hpp"
+#include "parser/AST-node.hpp"
+#include "parser/body.hpp"
+#include "parser/declaration.hpp"
+#include "parser/expression.hpp"
+#include "parser/return.hpp"
+#include "parser/routine.hpp"
+#include "parser/statement.hpp"
+#include "parser/visitor/clone-visitor.hpp"
+#include "parser/visitor/recursive-visitor.hpp"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace stores
+{
+
+/*
+ *  How many times each name is declared in a routine body.
+*/
+struct Declarations : public parsing::RecursiveVisitor
+{
+    void visit(parsing::PrimitiveVariable& node) override
+    {
+        m_count[node.m_name]++;
+        m_scalars[node.m_name] = &node;
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    void visit(parsing::ArrayVariable& node) override
+    {
+        m_count[node.m_name]++;
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    void visit(parsing::For& node) override
+    {
+        m_count[node.m_identifier->m_name]++;
+        m_iterators.push_back(node.m_identifier->m_name);
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    std::unordered_map<std::string, size_t> m_count;
+    std::unordered_map<std::string, parsing::PrimitiveVariable*> m_scalars;
+    std::vector<std::string> m_iterators;
+};
+
+/*
+ *  Scalar variables of a routine that a name alone tells apart: declared
+ *  once, not shadowing a global. Every use of such a name refers to them.
+*/
+struct Scalars
+{
+    // primitive type name of each of them
+    std::unordered_map<std::string, std::string> m_types;
+    // the ones declared in the body, the rest are parameters and loop iterators
+    std::unordered_set<std::string> m_locals;
+};
+
+inline Scalars scalarsOf(parsing::Routine& routine, parsing::Program& program, const analysis::TypeResolver& types)
+{
+    Scalars result;
+    // local types could give a type name another meaning
+    if (inlining::shapeOf(*routine.m_body).m_declares_types)
+    {
+        return result;
+    }
+
+    Declarations declarations;
+    routine.m_body->accept(declarations);
+    for (auto& param : routine.m_params)
+    {
+        declarations.m_count[param->m_name]++;
+    }
+    for (auto& decl : program.m_declarations)
+    {
+        if (decl->isVariableDecl())
+        {
+            declarations.m_count[decl->m_name]++;
+        }
+    }
+
+    for (auto& [name, var] : declarations.m_scalars)
+    {
+        auto type = types.primitiveName(var->m_type);
+        if (declarations.m_count.at(name) == 1 && !type.empty())
+        {
+            result.m_types[name] = type;
+            result.m_locals.insert(name);
+        }
+    }
+    for (auto& param : routine.m_params)
+    {
+        auto type = types.primitiveName(std::make_shared<parsing::PrimitiveType>(param->m_type));
+        if (declarations.m_count.at(param->m_name) == 1 && !type.empty())
+        {
+            result.m_types[param->m_name] = type;
+        }
+    }
+    for (auto& name : declarations.m_iterators)
+    {
+        if (declarations.m_count.at(name) == 1)
+        {
+            result.m_types[name] = "integer";
+        }
+    }
+    return result;
+}
+
+} // namespace stores
+
+/*
+ *  Copy propagation for scalar variables.
+ *
+ *  After `x := y` or `var x is y`, with x and y of the same type, reads of
+ *  x are replaced by y until either of them changes. Literal values are
+ *  propagated the same way. Copies known on both arms of an `if` survive
+ *  it. A loop starts without the copies it breaks anywhere in its body,
+ *  and a block forgets the copies involving its own locals when it ends.
+ *
+ *  Only variables that their name alone identifies are touched, see
+ *  stores::scalarsOf. The assignments left unread are removed by
+ *  RemoveDeadStores, the variables themselves by RemoveUnusedDeclarations.
+*/
+struct PropagateCopies
+{
+    explicit PropagateCopies(std::shared_ptr<parsing::Program> program) : m_ast(program), m_types(program)
+    {
+    }
+
+    bool apply(parsing::Routine& routine)
+    {
+        m_scalars = stores::scalarsOf(routine, *m_ast, m_types);
+        if (m_scalars.m_types.empty())
+        {
+            return false;
+        }
+
+        Copies copies;
+        propagateIn(*routine.m_body, copies);
+
+        if (m_propagated != 0)
+        {
+            m_remarks.push_back(
+                routine.m_name + ": " + std::to_string(m_propagated) + " read(s) replaced by the copied value");
+        }
+        return m_propagated != 0;
+    }
+
+    std::vector<std::string> m_remarks;
+
+private:
+    // variable -> the plain variable or literal it currently holds
+    using Copies = std::unordered_map<std::string, std::shared_ptr<parsing::Expression>>;
+
+    void propagateIn(parsing::Body& body, Copies& copies)
+    {
+        std::vector<std::string> locals;
+        for (auto& item : body.m_items)
+        {
+            if (auto* var = dynamic_cast<parsing::PrimitiveVariable*>(item.get()))
+            {
+                if (var->m_value)
+                {
+                    substitute(var->m_value, copies);
+                }
+                kill(var->m_name, copies);
+                locals.push_back(var->m_name);
+                if (var->m_value)
+                {
+                    record(var->m_name, var->m_value, copies);
+                }
+            }
+            else if (auto* var = dynamic_cast<parsing::ArrayVariable*>(item.get()))
+            {
+                kill(var->m_name, copies);
+            }
+            else if (auto* assignment = dynamic_cast<parsing::Assignment*>(item.get()))
+            {
+                substituteChain(*assignment->m_modifiable, copies);
+                substitute(assignment->m_expression, copies);
+                kill(assignment->m_modifiable->m_head_name, copies);
+                if (assignment->m_modifiable->m_chain.empty())
+                {
+                    record(assignment->m_modifiable->m_head_name, assignment->m_expression, copies);
+                }
+            }
+            else if (auto* ret = dynamic_cast<parsing::ReturnStatement*>(item.get()))
+            {
+                if (ret->m_expr)
+                {
+                    substitute(ret->m_expr, copies);
+                }
+            }
+            else if (auto* call = dynamic_cast<parsing::RoutineCall*>(item.get()))
+            {
+                // arguments are passed by value, a call changes no variable of the caller
+                for (auto& param : call->m_parameters)
+                {
+                    substitute(param, copies);
+                }
+            }
+            else if (auto* branch = dynamic_cast<parsing::If*>(item.get()))
+            {
+                substitute(branch->m_condition, copies);
+                auto then_copies = copies;
+                propagateIn(*branch->m_then, then_copies);
+                auto else_copies = copies;
+                if (branch->m_else)
+                {
+                    propagateIn(*branch->m_else, else_copies);
+                }
+                copies = meet(then_copies, else_copies);
+            }
+            else if (auto* loop = dynamic_cast<parsing::For*>(item.get()))
+            {
+                substitute(loop->m_range->m_begin, copies);
+                substitute(loop->m_range->m_end, copies);
+                forgetChangedIn(*loop->m_body, copies);
+                kill(loop->m_identifier->m_name, copies);
+                auto inner = copies;
+                propagateIn(*loop->m_body, inner);
+            }
+            else if (auto* loop = dynamic_cast<parsing::While*>(item.get()))
+            {
+                // the condition is evaluated again after every iteration
+                forgetChangedIn(*loop->m_body, copies);
+                substitute(loop->m_condition, copies);
+                auto inner = copies;
+                propagateIn(*loop->m_body, inner);
+            }
+            else if (auto* nested = dynamic_cast<parsing::Body*>(item.get()))
+            {
+                propagateIn(*nested, copies);
+            }
+        }
+
+        for (auto& name : locals)
+        {
+            kill(name, copies);
+        }
+    }
+
+    void record(const std::string& name, const std::shared_ptr<parsing::Expression>& value, Copies& copies) const
+    {
+        if (!m_scalars.m_types.contains(name))
+        {
+            return;
+        }
+        auto& type = m_scalars.m_types.at(name);
+
+        if (auto* source = dynamic_cast<parsing::Modifiable*>(value.get()))
+        {
+            auto found = m_scalars.m_types.find(source->m_head_name);
+            if (source->m_chain.empty() && source->m_head_name != name && found != m_scalars.m_types.end()
+                && found->second == type)
+            {
+                copies[name] = value;
+            }
+            return;
+        }
+
+        bool literal = (type == "integer" && dynamic_cast<parsing::Integer*>(value.get()))
+            || (type == "real" && dynamic_cast<parsing::Real*>(value.get()))
+            || (type == "boolean" && dynamic_cast<parsing::Boolean*>(value.get()));
+        if (literal)
+        {
+            copies[name] = value;
+        }
+    }
+
+    /*
+     * Forgets what `name` holds and every copy taken from it.
+    */
+    static void kill(const std::string& name, Copies& copies)
+    {
+        copies.erase(name);
+        std::erase_if(
+            copies,
+            [&](const auto& copy)
+            {
+                auto* source = dynamic_cast<parsing::Modifiable*>(copy.second.get());
+                return source && source->m_head_name == name;
+            });
+    }
+
+    static void forgetChangedIn(parsing::Body& body, Copies& copies)
+    {
+        auto changed = analysis::assignedNames(body);
+        auto declared = analysis::declaredNames(body);
+        changed.insert(declared.begin(), declared.end());
+        for (auto& name : changed)
+        {
+            kill(name, copies);
+        }
+    }
+
+    static Copies meet(const Copies& left, const Copies& right)
+    {
+        Copies result;
+        for (auto& [name, value] : left)
+        {
+            auto found = right.find(name);
+            if (found != right.end() && analysis::sameExpression(*value, *found->second))
+            {
+                result[name] = value;
+            }
+        }
+        return result;
+    }
+
+    void substitute(std::shared_ptr<parsing::Expression>& slot, const Copies& copies)
+    {
+        if (auto* modifiable = dynamic_cast<parsing::Modifiable*>(slot.get()))
+        {
+            auto found = copies.find(modifiable->m_head_name);
+            if (modifiable->m_chain.empty() && found != copies.end())
+            {
+                slot = parsing::Cloner().clone(found->second);
+                m_propagated++;
+                return;
+            }
+            substituteChain(*modifiable, copies);
+        }
+        else if (auto* math = dynamic_cast<parsing::Math*>(slot.get()))
+        {
+            substitute(math->m_left, copies);
+            substitute(math->m_right, copies);
+        }
+        else if (auto* result = dynamic_cast<parsing::RoutineCallResult*>(slot.get()))
+        {
+            for (auto& param : result->m_routine_call->m_parameters)
+            {
+                substitute(param, copies);
+            }
+        }
+    }
+
+    void substituteChain(parsing::Modifiable& modifiable, const Copies& copies)
+    {
+        for (auto& item : modifiable.m_chain)
+        {
+            if (auto* index = dynamic_cast<parsing::ArrayAccess*>(item.get()))
+            {
+                substitute(index->access, copies);
+            }
+        }
+    }
+
+    std::shared_ptr<parsing::Program> m_ast;
+    analysis::TypeResolver m_types;
+    stores::Scalars m_scalars;
+    size_t m_propagated = 0;
+};
+
+/*
+ *  Dead store elimination for scalar locals.
+ *
+ *  A backward liveness analysis over the routine body finds assignments
+ *  and initialisers whose value is overwritten or goes out of scope before
+ *  anything reads it. Loops are iterated until the variables live at their
+ *  head settle. A dead assignment is removed and a dead initialiser is
+ *  dropped from its declaration, unless computing the value could trap or
+ *  call something (see analysis::isSpeculatable).
+*/
+struct RemoveDeadStores
+{
+    explicit RemoveDeadStores(std::shared_ptr<parsing::Program> program) : m_ast(program), m_types(program)
+    {
+    }
+
+    bool apply(parsing::Routine& routine)
+    {
+        m_scalars = stores::scalarsOf(routine, *m_ast, m_types);
+        if (m_scalars.m_locals.empty())
+        {
+            return false;
+        }
+
+        liveIn(*routine.m_body, {}, true);
+
+        if (m_removed != 0)
+        {
+            m_remarks.push_back(routine.m_name + ": removed " + std::to_string(m_removed) + " dead store(s)");
+        }
+        return m_removed != 0;
+    }
+
+    std::vector<std::string> m_remarks;
+
+private:
+    using Live = std::unordered_set<std::string>;
+
+    /*
+     * Variables live before the body given those live after it.
+     * Dead stores are only removed once `remove` is set, inside loops
+     * that is after their liveness settled.
+    */
+    Live liveIn(parsing::Body& body, Live live, bool remove)
+    {
+        auto& items = body.m_items;
+        for (size_t idx = items.size(); idx-- > 0;)
+        {
+            auto* item = items[idx].get();
+            if (auto* var = dynamic_cast<parsing::PrimitiveVariable*>(item))
+            {
+                if (remove && var->m_value && isDead(var->m_name, *var->m_value, live))
+                {
+                    var->m_value = nullptr;
+                    m_removed++;
+                }
+                live.erase(var->m_name);
+                if (var->m_value)
+                {
+                    use(*var->m_value, live);
+                }
+            }
+            else if (auto* assignment = dynamic_cast<parsing::Assignment*>(item))
+            {
+                auto& target = *assignment->m_modifiable;
+                if (!target.m_chain.empty())
+                {
+                    // a partial write keeps the rest of the aggregate
+                    use(target, live);
+                    use(*assignment->m_expression, live);
+                    continue;
+                }
+                if (remove && isDead(target.m_head_name, *assignment->m_expression, live))
+                {
+                    items.erase(items.begin() + idx);
+                    m_removed++;
+                    continue;
+                }
+                live.erase(target.m_head_name);
+                use(*assignment->m_expression, live);
+            }
+            else if (auto* ret = dynamic_cast<parsing::ReturnStatement*>(item))
+            {
+                // nothing after a return is run
+                live.clear();
+                if (ret->m_expr)
+                {
+                    use(*ret->m_expr, live);
+                }
+            }
+            else if (auto* branch = dynamic_cast<parsing::If*>(item))
+            {
+                size_t removed = m_removed;
+                auto then_live = liveIn(*branch->m_then, live, remove);
+                if (branch->m_else)
+                {
+                    live = liveIn(*branch->m_else, live, remove);
+                }
+                live.insert(then_live.begin(), then_live.end());
+                use(*branch->m_condition, live);
+                // the arms may no longer be what the if-conversion has seen
+                branch->m_branchless = branch->m_branchless && removed == m_removed;
+            }
+            else if (auto* loop = dynamic_cast<parsing::For*>(item))
+            {
+                auto head = settle(*loop->m_body, live, nullptr);
+                if (remove)
+                {
+                    liveIn(*loop->m_body, head, true);
+                }
+                live = std::move(head);
+                live.erase(loop->m_identifier->m_name);
+                use(*loop->m_range->m_begin, live);
+                use(*loop->m_range->m_end, live);
+            }
+            else if (auto* loop = dynamic_cast<parsing::While*>(item))
+            {
+                auto head = settle(*loop->m_body, live, loop->m_condition.get());
+                if (remove)
+                {
+                    liveIn(*loop->m_body, head, true);
+                }
+                live = std::move(head);
+            }
+            else if (auto* nested = dynamic_cast<parsing::Body*>(item))
+            {
+                live = liveIn(*nested, std::move(live), remove);
+            }
+            else
+            {
+                use(*item, live);
+            }
+        }
+        return live;
+    }
+
+    /*
+     * Variables live at the head of a loop: after it, in the condition,
+     * or before the body for the next iteration.
+    */
+    Live settle(parsing::Body& body, const Live& after, parsing::Expression* condition)
+    {
+        Live head = after;
+        if (condition)
+        {
+            use(*condition, head);
+        }
+        while (true)
+        {
+            auto next = liveIn(body, head, false);
+            next.insert(head.begin(), head.end());
+            if (next.size() == head.size())
+            {
+                return head;
+            }
+            head = std::move(next);
+        }
+    }
+
+    bool isDead(const std::string& name, parsing::Expression& value, const Live& live) const
+    {
+        return m_scalars.m_locals.contains(name) && !live.contains(name) && analysis::isSpeculatable(value);
+    }
+
+    static void use(parsing::ASTNode& node, Live& live)
+    {
+        auto names = analysis::usedNames(node);
+        live.insert(names.begin(), names.end());
+    }
+
+    std::shared_ptr<parsing::Program> m_ast;
+    analysis::TypeResolver m_types;
+    stores::Scalars m_scalars;
+    size_t m_removed = 0;
+};
@@ -0,0 +1,189 @@
+#pragma once
+
+#include "analyzer/analyzer.hpp"
+#include "analyzer/ast-utils.hpp"
+#include "parser/AST-node.hpp"
+#include "parser/expression.hpp"
+#include "parser/routine.hpp"
+#include "parser/statement.hpp"
+#include "parser/std-function.hpp"
+#include "parser/visitor/recursive-visitor.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace effects
+{
+
+/*
+ *  What the body of one routine does by itself, callees aside.
+*/
+struct LocalEffects : public parsing::RecursiveVisitor
+{
+    explicit LocalEffects(std::unordered_set<std::string> aggregates) : m_aggregates(std::move(aggregates))
+    {
+    }
+
+    void visit(parsing::Assignment& node) override
+    {
+        m_writes = m_writes || m_aggregates.contains(node.m_modifiable->m_head_name);
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    void visit(parsing::Modifiable& node) override
+    {
+        m_reads = m_reads || m_aggregates.contains(node.m_head_name);
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    void visit(parsing::StdFunction& node) override
+    {
+        m_prints = true;
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    void visit(parsing::While& node) override
+    {
+        m_loops = true;
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    // array and record parameters, the only memory a caller can hand over
+    std::unordered_set<std::string> m_aggregates;
+
+    bool m_reads = false;
+    bool m_writes = false;
+    bool m_prints = false;
+    bool m_loops = false;
+};
+
+} // namespace effects
+
+/*
+ *  Finds out what each routine may do besides computing its result.
+ *
+ *  A routine that prints, or calls one that does, has input/output.
+ *  Otherwise it only touches its own frame and its array and record
+ *  parameters, and is classified by whether it reads or writes those.
+ *  Callees are handled bottom-up over the call graph, a cycle of
+ *  recursive routines shares one classification.
+ *
+ *  A routine surely returns when it has no `while` loop, is not recursive
+ *  and only calls routines that surely return. `for` loops always end.
+ *
+ *  The results are stored in the routines for the generator, which turns
+ *  them into LLVM function attributes. They are recomputed on every run,
+ *  so the pass goes after everything that rewrites routines.
+*/
+struct EffectAnalysis
+{
+    explicit EffectAnalysis(std::shared_ptr<parsing::Program> program) : m_types(program), m_graph(*program)
+    {
+    }
+
+    PassResult apply()
+    {
+        PassResult result;
+        auto recursive = m_graph.recursive();
+
+        for (auto& component : m_graph.bottomUp())
+        {
+            auto effects = parsing::Effects::NONE;
+            bool will_return = true;
+            for (auto& name : component)
+            {
+                auto& routine = *m_graph.m_by_name.at(name);
+                auto local = localEffectsOf(routine);
+                effects = std::max(effects, local);
+                will_return = will_return && !m_loops.contains(name) && !recursive.contains(name);
+
+                for (auto& callee : m_graph.m_calls.at(name))
+                {
+                    if (std::find(component.begin(), component.end(), callee) != component.end())
+                    {
+                        continue;
+                    }
+                    // arguments are passed by value, what a callee does to its own is not seen here
+                    auto& called = *m_graph.m_by_name.at(callee);
+                    if (called.m_effects == parsing::Effects::INPUT_OUTPUT)
+                    {
+                        effects = parsing::Effects::INPUT_OUTPUT;
+                    }
+                    will_return = will_return && called.m_will_return;
+                }
+            }
+
+            for (auto& name : component)
+            {
+                auto& routine = *m_graph.m_by_name.at(name);
+                if (routine.m_effects == effects && routine.m_will_return == will_return)
+                {
+                    continue;
+                }
+                routine.m_effects = effects;
+                routine.m_will_return = will_return;
+                result.m_changed = true;
+                result.m_dirty.insert(name);
+                m_remarks.push_back(name + ": " + describe(effects) + (will_return ? ", always returns" : ""));
+            }
+        }
+        return result;
+    }
+
+    std::vector<std::string> m_remarks;
+
+private:
+    parsing::Effects localEffectsOf(parsing::Routine& routine)
+    {
+        std::unordered_set<std::string> aggregates;
+        for (auto& param : routine.m_params)
+        {
+            if (m_types.primitiveName(std::make_shared<parsing::PrimitiveType>(param->m_type)).empty())
+            {
+                aggregates.insert(param->m_name);
+            }
+        }
+
+        effects::LocalEffects local(std::move(aggregates));
+        routine.m_body->accept(local);
+        if (local.m_loops)
+        {
+            m_loops.insert(routine.m_name);
+        }
+
+        if (local.m_prints)
+        {
+            return parsing::Effects::INPUT_OUTPUT;
+        }
+        if (local.m_writes)
+        {
+            return parsing::Effects::WRITES_ARGUMENTS;
+        }
+        return local.m_reads ? parsing::Effects::READS_ARGUMENTS : parsing::Effects::NONE;
+    }
+
+    static std::string describe(parsing::Effects effects)
+    {
+        switch (effects)
+        {
+        case parsing::Effects::NONE:
+            return "no side effects";
+        case parsing::Effects::READS_ARGUMENTS:
+            return "reads arguments";
+        case parsing::Effects::WRITES_ARGUMENTS:
+            return "writes arguments";
+        case parsing::Effects::INPUT_OUTPUT:
+            return "input/output";
+        default:
+            return "unknown";
+        }
+    }
+
+    analysis::TypeResolver m_types;
+    analysis::CallGraph m_graph;
+    std::unordered_set<std::string> m_loops;
+};
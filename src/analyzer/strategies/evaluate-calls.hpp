@@ -0,0 +1,231 @@
+#pragma once
+
+#include "analyzer/analyzer.hpp"
+#include "analyzer/evaluator.hpp"
+#include "analyzer/strategies/constant-fold.hpp"
+#include "parser/AST-node.hpp"
+#include "parser/declaration.hpp"
+#include "parser/expression.hpp"
+#include "parser/return.hpp"
+#include "parser/routine.hpp"
+#include "parser/statement.hpp"
+#include "parser/std-function.hpp"
+#include "parser/visitor/recursive-visitor.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ *  Replaces calls with constant arguments by their result.
+ *
+ *  `f(3, true)` in an expression, or in the size of an array type, is run
+ *  at compile time by evaluation::Interpreter. When it comes back with a
+ *  scalar within m_limits, the call becomes a literal, and constant
+ *  folding takes it from there. Calls that print, trap or run over the
+ *  limits stay, at most m_max_calls different calls are tried per run.
+ *
+ *  It goes first in the pipeline: the inliner would otherwise copy the
+ *  calls away, and array sizes have to be literals for the generator.
+ *
+ *  Calls with an array or record result stay calls. Precomputed tables
+ *  would need a constant initialiser for the internal globals the
+ *  generator puts large slots in, which the AST has no literal for yet.
+*/
+struct EvaluateCalls : public parsing::RecursiveVisitor
+{
+    explicit EvaluateCalls(std::shared_ptr<parsing::Program> program)
+        : m_ast(program), m_interpreter(program)
+    {
+    }
+
+    PassResult apply()
+    {
+        for (auto& decl : m_ast->m_declarations)
+        {
+            m_routine = dynamic_cast<parsing::Routine*>(decl.get());
+            decl->accept(*this);
+        }
+        return m_result;
+    }
+
+    void visit(parsing::ArrayType& node) override
+    {
+        node.m_type->accept(*this);
+        fold(node.m_size);
+    }
+
+    void visit(parsing::PrimitiveVariable& node) override
+    {
+        if (node.m_value)
+        {
+            fold(node.m_value);
+        }
+    }
+
+    void visit(parsing::RoutineCall& node) override
+    {
+        for (auto& param : node.m_parameters)
+        {
+            fold(param);
+        }
+    }
+
+    void visit(parsing::StdFunction& node) override
+    {
+        for (auto& param : node.m_parameters)
+        {
+            fold(param);
+        }
+    }
+
+    void visit(parsing::Math& node) override
+    {
+        fold(node.m_left);
+        fold(node.m_right);
+    }
+
+    void visit(parsing::ArrayAccess& node) override
+    {
+        fold(node.access);
+    }
+
+    void visit(parsing::ReturnStatement& node) override
+    {
+        if (node.m_expr)
+        {
+            fold(node.m_expr);
+        }
+    }
+
+    void visit(parsing::If& node) override
+    {
+        fold(node.m_condition);
+        node.m_then->accept(*this);
+        if (node.m_else)
+        {
+            node.m_else->accept(*this);
+        }
+    }
+
+    void visit(parsing::Range& node) override
+    {
+        fold(node.m_begin);
+        fold(node.m_end);
+    }
+
+    void visit(parsing::While& node) override
+    {
+        fold(node.m_condition);
+        node.m_body->accept(*this);
+    }
+
+    void visit(parsing::Assignment& node) override
+    {
+        node.m_modifiable->accept(*this);
+        fold(node.m_expression);
+    }
+
+    evaluation::Limits m_limits;
+    size_t m_max_calls = 64;
+
+    std::vector<std::string> m_remarks;
+
+private:
+    /*
+     * Arguments are folded first, so nested calls go inside out.
+    */
+    void fold(std::shared_ptr<parsing::Expression>& slot)
+    {
+        slot->accept(*this);
+
+        auto* result = dynamic_cast<parsing::RoutineCallResult*>(slot.get());
+        if (!result)
+        {
+            return;
+        }
+        auto& call = *result->m_routine_call;
+
+        std::vector<folding::Constant> args;
+        std::string key = call.m_routine_name;
+        for (auto& param : call.m_parameters)
+        {
+            auto value = folding::asConstant(*param);
+            if (!value)
+            {
+                return;
+            }
+            args.push_back(*value);
+            key += "," + spell(*value);
+        }
+
+        auto found = m_evaluated.find(key);
+        if (found == m_evaluated.end())
+        {
+            if (m_evaluated.size() >= m_max_calls)
+            {
+                return;
+            }
+            m_interpreter.m_limits = m_limits;
+            auto value = m_interpreter.call(call.m_routine_name, args);
+            if (!value)
+            {
+                m_remarks.push_back("not evaluating " + call.m_routine_name + ": " + m_interpreter.m_failure);
+            }
+            found = m_evaluated.emplace(key, value).first;
+        }
+        if (!found->second)
+        {
+            return;
+        }
+
+        slot = folding::toLiteral(*found->second);
+        m_result.m_changed = true;
+        if (m_routine)
+        {
+            m_result.m_dirty.insert(m_routine->m_name);
+        }
+        else
+        {
+            // a type changed, every routine may be using it
+            for (auto& decl : m_ast->m_declarations)
+            {
+                if (dynamic_cast<parsing::Routine*>(decl.get()))
+                {
+                    m_result.m_dirty.insert(decl->m_name);
+                }
+            }
+        }
+        m_remarks.push_back("evaluated a call to " + call.m_routine_name);
+    }
+
+    /*
+     * Tells every two different values apart, reals by their bits.
+    */
+    static std::string spell(const folding::Constant& value)
+    {
+        if (value.m_kind == folding::Constant::Kind::REAL)
+        {
+            uint64_t bits = 0;
+            std::memcpy(&bits, &value.m_real, sizeof(bits));
+            return "r" + std::to_string(bits);
+        }
+        if (value.m_kind == folding::Constant::Kind::BOOLEAN)
+        {
+            return value.m_bool ? "true" : "false";
+        }
+        return std::to_string(value.m_int);
+    }
+
+    std::shared_ptr<parsing::Program> m_ast;
+    evaluation::Interpreter m_interpreter;
+    parsing::Routine* m_routine = nullptr;
+
+    // results by routine and arguments, nothing when it could not be evaluated
+    std::unordered_map<std::string, std::optional<folding::Constant>> m_evaluated;
+    PassResult m_result;
+};
@@ -0,0 +1,346 @@
+#pragma once
+
+#include "analyzer/ast-utils.hpp"
+#include "parser/AST-node.hpp"
+#include "parser/body.hpp"
+#include "parser/expression.hpp"
+#include "parser/return.hpp"
+#include "parser/routine.hpp"
+#include "parser/statement.hpp"
+#include "parser/std-function.hpp"
+#include "parser/visitor/clone-visitor.hpp"
+#include "parser/visitor/recursive-visitor.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace fusion
+{
+
+/*
+ *  Every read and write of every variable inside a loop body.
+*/
+struct Accesses : public parsing::RecursiveVisitor
+{
+    struct Access
+    {
+        parsing::Modifiable* m_node;
+        bool m_write;
+    };
+
+    void visit(parsing::Assignment& node) override
+    {
+        m_accesses[node.m_modifiable->m_head_name].push_back({ node.m_modifiable.get(), true });
+        for (auto& item : node.m_modifiable->m_chain)
+        {
+            item->accept(*this);
+        }
+        node.m_expression->accept(*this);
+    }
+
+    void visit(parsing::Modifiable& node) override
+    {
+        m_accesses[node.m_head_name].push_back({ &node, false });
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    std::unordered_map<std::string, std::vector<Access>> m_accesses;
+};
+
+/*
+ *  What a loop body does besides reading and writing variables.
+*/
+struct Effects : public parsing::RecursiveVisitor
+{
+    void visit(parsing::RoutineCall& node) override
+    {
+        m_calls = true;
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    void visit(parsing::StdFunction& node) override
+    {
+        m_prints = true;
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    void visit(parsing::ReturnStatement& node) override
+    {
+        m_returns = true;
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    bool m_calls = false;
+    bool m_prints = false;
+    bool m_returns = false;
+};
+
+inline Effects effectsOf(parsing::Body& body)
+{
+    Effects effects;
+    body.accept(effects);
+    return effects;
+}
+
+/*
+ *  c in `a[i + c]`, `a[i - c]` or `a[i]`, where i is the iterator.
+*/
+inline std::optional<int64_t> offsetOf(parsing::Modifiable& access, const std::string& iterator)
+{
+    if (access.m_chain.empty())
+    {
+        return std::nullopt;
+    }
+    auto* index = dynamic_cast<parsing::ArrayAccess*>(access.m_chain.front().get());
+    if (!index)
+    {
+        return std::nullopt;
+    }
+
+    auto isIterator = [&](parsing::Expression& expr)
+    {
+        auto* modifiable = dynamic_cast<parsing::Modifiable*>(&expr);
+        return modifiable && modifiable->m_chain.empty() && modifiable->m_head_name == iterator;
+    };
+    if (isIterator(*index->access))
+    {
+        return 0;
+    }
+
+    auto* math = dynamic_cast<parsing::Math*>(index->access.get());
+    if (!math)
+    {
+        return std::nullopt;
+    }
+    auto* right = dynamic_cast<parsing::Integer*>(math->m_right.get());
+    auto* left = dynamic_cast<parsing::Integer*>(math->m_left.get());
+    if (math->m_grammar == GrammarUnit::PLUS && right && isIterator(*math->m_left))
+    {
+        return right->m_value;
+    }
+    if (math->m_grammar == GrammarUnit::PLUS && left && isIterator(*math->m_right))
+    {
+        return left->m_value;
+    }
+    if (math->m_grammar == GrammarUnit::MINUS && right && isIterator(*math->m_left))
+    {
+        return -static_cast<int64_t>(right->m_value);
+    }
+    return std::nullopt;
+}
+
+} // namespace fusion
+
+/*
+ *  Fuses adjacent `for` loops over the same range into one.
+ *
+ *  The bounds have to be written the same way and the first loop must not
+ *  change what they read. A variable used by both loops and written by
+ *  either has to be an array indexed by the iterator plus a constant
+ *  everywhere. The fused loop runs iteration k of the second loop right
+ *  after iteration k of the first, so each element must be touched by the
+ *  first loop no later than by the second one.
+ *
+ *  Loops that call routines or return are left alone, and so are two loops
+ *  that both print, their output would interleave.
+*/
+struct FuseLoops
+{
+    explicit FuseLoops(std::shared_ptr<parsing::Program>)
+    {
+    }
+
+    bool apply(parsing::Routine& routine)
+    {
+        processBody(*routine.m_body);
+
+        if (m_fused != 0)
+        {
+            m_remarks.push_back(routine.m_name + ": fused " + std::to_string(m_fused) + " loop(s)");
+        }
+        return m_fused != 0;
+    }
+
+    std::vector<std::string> m_remarks;
+
+private:
+    void processBody(parsing::Body& body)
+    {
+        for (size_t idx = 0; idx < body.m_items.size(); ++idx)
+        {
+            auto item = body.m_items[idx];
+            if (auto* loop = dynamic_cast<parsing::For*>(item.get()))
+            {
+                while (idx + 1 < body.m_items.size())
+                {
+                    auto* next = dynamic_cast<parsing::For*>(body.m_items[idx + 1].get());
+                    if (!next || !canFuse(*loop, *next))
+                    {
+                        break;
+                    }
+                    fuse(*loop, *next);
+                    body.m_items.erase(body.m_items.begin() + idx + 1);
+                    m_fused++;
+                }
+                processBody(*loop->m_body);
+            }
+            else if (auto* loop = dynamic_cast<parsing::While*>(item.get()))
+            {
+                processBody(*loop->m_body);
+            }
+            else if (auto* branch = dynamic_cast<parsing::If*>(item.get()))
+            {
+                processBody(*branch->m_then);
+                if (branch->m_else)
+                {
+                    processBody(*branch->m_else);
+                }
+            }
+            else if (auto* nested = dynamic_cast<parsing::Body*>(item.get()))
+            {
+                processBody(*nested);
+            }
+        }
+    }
+
+    static bool canFuse(parsing::For& first, parsing::For& second)
+    {
+        auto& range = *first.m_range;
+        if (range.m_reverse != second.m_range->m_reverse
+            || !analysis::sameExpression(*range.m_begin, *second.m_range->m_begin)
+            || !analysis::sameExpression(*range.m_end, *second.m_range->m_end))
+        {
+            return false;
+        }
+
+        // the second range is evaluated after the first loop ran
+        auto first_assigned = analysis::assignedNames(*first.m_body);
+        for (auto* bound : { range.m_begin.get(), range.m_end.get() })
+        {
+            for (auto& name : analysis::usedNames(*bound))
+            {
+                if (first_assigned.contains(name))
+                {
+                    return false;
+                }
+            }
+        }
+
+        auto& iterator = first.m_identifier->m_name;
+        auto& second_iterator = second.m_identifier->m_name;
+        if (first_assigned.contains(iterator)
+            || analysis::assignedNames(*second.m_body).contains(second_iterator))
+        {
+            return false;
+        }
+
+        auto first_effects = fusion::effectsOf(*first.m_body);
+        auto second_effects = fusion::effectsOf(*second.m_body);
+        if (first_effects.m_calls || second_effects.m_calls || first_effects.m_returns || second_effects.m_returns
+            || (first_effects.m_prints && second_effects.m_prints))
+        {
+            return false;
+        }
+
+        // the second body ends up in the scope of the first one
+        auto first_declared = analysis::declaredNames(*first.m_body);
+        auto second_declared = analysis::declaredNames(*second.m_body);
+        auto second_used = analysis::usedNames(*second.m_body);
+        if (first_declared.contains(iterator) || second_declared.contains(second_iterator))
+        {
+            return false;
+        }
+        if (iterator != second_iterator && (second_used.contains(iterator) || second_declared.contains(iterator)))
+        {
+            return false;
+        }
+        for (auto& name : first_declared)
+        {
+            if (second_used.contains(name) && !second_declared.contains(name))
+            {
+                return false;
+            }
+        }
+
+        return independent(first, second, first_declared, second_declared);
+    }
+
+    static bool independent(
+        parsing::For& first,
+        parsing::For& second,
+        const std::unordered_set<std::string>& first_declared,
+        const std::unordered_set<std::string>& second_declared)
+    {
+        fusion::Accesses first_accesses;
+        first.m_body->accept(first_accesses);
+        fusion::Accesses second_accesses;
+        second.m_body->accept(second_accesses);
+
+        auto& iterator = first.m_identifier->m_name;
+        auto& second_iterator = second.m_identifier->m_name;
+        bool reverse = first.m_range->m_reverse;
+
+        for (auto& [name, accesses] : first_accesses.m_accesses)
+        {
+            auto found = second_accesses.m_accesses.find(name);
+            if (name == iterator || first_declared.contains(name) || found == second_accesses.m_accesses.end()
+                || second_declared.contains(name))
+            {
+                continue;
+            }
+
+            for (auto& before : accesses)
+            {
+                for (auto& after : found->second)
+                {
+                    if (!before.m_write && !after.m_write)
+                    {
+                        continue;
+                    }
+                    auto before_offset = fusion::offsetOf(*before.m_node, iterator);
+                    auto after_offset = fusion::offsetOf(*after.m_node, second_iterator);
+                    if (!before_offset || !after_offset)
+                    {
+                        return false;
+                    }
+                    // element e is touched in iteration e - before of the first loop
+                    // and in iteration e - after of the second one
+                    if (reverse ? *before_offset > *after_offset : *before_offset < *after_offset)
+                    {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    static void fuse(parsing::For& first, parsing::For& second)
+    {
+        auto body = second.m_body;
+        if (second.m_identifier->m_name != first.m_identifier->m_name)
+        {
+            std::unordered_map<std::string, std::string> renames { { second.m_identifier->m_name,
+                                                                    first.m_identifier->m_name } };
+            body = parsing::Cloner(renames).clone(second.m_body);
+        }
+
+        // locals of the second loop keep a scope of their own
+        auto& items = first.m_body->m_items;
+        if (analysis::declaredNames(*body).empty())
+        {
+            items.insert(items.end(), body->m_items.begin(), body->m_items.end());
+        }
+        else
+        {
+            items.push_back(body);
+        }
+    }
+
+    size_t m_fused = 0;
+};
@@ -0,0 +1,336 @@
+#pragma once
+
+#include "analyzer/ast-utils.hpp"
+#include "parser/AST-node.hpp"
+#include "parser/body.hpp"
+#include "parser/declaration.hpp"
+#include "parser/expression.hpp"
+#include "parser/return.hpp"
+#include "parser/routine.hpp"
+#include "parser/statement.hpp"
+#include "parser/std-function.hpp"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/*
+ *  Loop-invariant code motion.
+ *
+ *  An expression inside a loop is invariant when none of the variables it
+ *  reads is assigned or declared in the loop. Such expressions are computed
+ *  once into a `licm.N` variable declared right before the loop.
+ *
+ *  The loop may run zero times, so only expressions that can not trap are
+ *  moved: no calls, integer division only by non-zero constants and array
+ *  reads only where the range analysis proved the index in bounds.
+*/
+struct HoistLoopInvariants
+{
+    explicit HoistLoopInvariants(std::shared_ptr<parsing::Program> program) : m_types(program)
+    {
+    }
+
+    bool apply(parsing::Routine& routine)
+    {
+        for (auto& param : routine.m_params)
+        {
+            m_variables[param->m_name] = std::make_shared<parsing::PrimitiveType>(param->m_type);
+        }
+        m_next = analysis::firstFreeIndex(*routine.m_body, "licm.");
+
+        processBody(*routine.m_body);
+
+        if (m_hoisted != 0)
+        {
+            m_remarks.push_back(
+                routine.m_name + ": hoisted " + std::to_string(m_hoisted) + " loop-invariant expression(s)");
+        }
+        return m_hoisted != 0;
+    }
+
+    std::vector<std::string> m_remarks;
+
+private:
+    using Items = std::vector<std::shared_ptr<parsing::ASTNode>>;
+
+    void processBody(parsing::Body& body)
+    {
+        auto outer_variables = m_variables;
+
+        for (size_t idx = 0; idx < body.m_items.size(); ++idx)
+        {
+            auto item = body.m_items[idx];
+            Items hoisted;
+
+            if (auto* loop = dynamic_cast<parsing::For*>(item.get()))
+            {
+                m_variant = analysis::assignedNames(*loop->m_body);
+                auto declared = analysis::declaredNames(*loop->m_body);
+                m_variant.insert(declared.begin(), declared.end());
+                m_variant.insert(loop->m_identifier->m_name);
+                hoistFrom(*loop->m_body, hoisted);
+
+                // outer invariants are gone by now, inner loops get the rest
+                auto scope = m_variables;
+                m_variables[loop->m_identifier->m_name] = loop->m_identifier->m_type;
+                processBody(*loop->m_body);
+                m_variables = std::move(scope);
+            }
+            else if (auto* loop = dynamic_cast<parsing::While*>(item.get()))
+            {
+                m_variant = analysis::assignedNames(*loop->m_body);
+                auto declared = analysis::declaredNames(*loop->m_body);
+                m_variant.insert(declared.begin(), declared.end());
+                hoistSlot(loop->m_condition, hoisted);
+                hoistFrom(*loop->m_body, hoisted);
+
+                processBody(*loop->m_body);
+            }
+            else if (auto* branch = dynamic_cast<parsing::If*>(item.get()))
+            {
+                processBody(*branch->m_then);
+                if (branch->m_else)
+                {
+                    processBody(*branch->m_else);
+                }
+            }
+            else if (auto* nested = dynamic_cast<parsing::Body*>(item.get()))
+            {
+                processBody(*nested);
+            }
+            else if (auto* var = dynamic_cast<parsing::ArrayVariable*>(item.get()))
+            {
+                m_variables[var->m_name] = var->m_type;
+            }
+            else if (auto* var = dynamic_cast<parsing::Variable*>(item.get()))
+            {
+                m_variables[var->m_name] = var->m_type;
+            }
+            else if (auto* type = dynamic_cast<parsing::Type*>(item.get()))
+            {
+                m_types.m_hidden.insert(type->m_name);
+            }
+
+            body.m_items.insert(body.m_items.begin() + idx, hoisted.begin(), hoisted.end());
+            idx += hoisted.size();
+        }
+
+        m_variables = std::move(outer_variables);
+    }
+
+    /*
+     * Every expression slot of a loop body, nested statements included.
+    */
+    void hoistFrom(parsing::Body& body, Items& hoisted)
+    {
+        for (auto& item : body.m_items)
+        {
+            if (auto* var = dynamic_cast<parsing::PrimitiveVariable*>(item.get()))
+            {
+                if (var->m_value)
+                {
+                    hoistSlot(var->m_value, hoisted);
+                }
+            }
+            else if (auto* assignment = dynamic_cast<parsing::Assignment*>(item.get()))
+            {
+                hoistChain(*assignment->m_modifiable, hoisted);
+                hoistSlot(assignment->m_expression, hoisted);
+            }
+            else if (auto* ret = dynamic_cast<parsing::ReturnStatement*>(item.get()))
+            {
+                hoistSlot(ret->m_expr, hoisted);
+            }
+            else if (auto* call = dynamic_cast<parsing::RoutineCall*>(item.get()))
+            {
+                for (auto& param : call->m_parameters)
+                {
+                    hoistSlot(param, hoisted);
+                }
+            }
+            else if (auto* branch = dynamic_cast<parsing::If*>(item.get()))
+            {
+                hoistSlot(branch->m_condition, hoisted);
+                hoistFrom(*branch->m_then, hoisted);
+                if (branch->m_else)
+                {
+                    hoistFrom(*branch->m_else, hoisted);
+                }
+            }
+            else if (auto* loop = dynamic_cast<parsing::For*>(item.get()))
+            {
+                hoistSlot(loop->m_range->m_begin, hoisted);
+                hoistSlot(loop->m_range->m_end, hoisted);
+                hoistFrom(*loop->m_body, hoisted);
+            }
+            else if (auto* loop = dynamic_cast<parsing::While*>(item.get()))
+            {
+                hoistSlot(loop->m_condition, hoisted);
+                hoistFrom(*loop->m_body, hoisted);
+            }
+            else if (auto* nested = dynamic_cast<parsing::Body*>(item.get()))
+            {
+                hoistFrom(*nested, hoisted);
+            }
+        }
+    }
+
+    /*
+     * Hoists the largest invariant subexpressions of the slot.
+    */
+    void hoistSlot(std::shared_ptr<parsing::Expression>& slot, Items& hoisted)
+    {
+        if (isInvariant(*slot) && analysis::isSpeculatable(*slot) && isWorthHoisting(*slot))
+        {
+            auto type = typeOf(*slot);
+            if (!type.empty())
+            {
+                std::string name = "licm." + std::to_string(m_next++);
+                hoisted.push_back(std::make_shared<parsing::PrimitiveVariable>(
+                    name, std::make_shared<parsing::PrimitiveType>(type), slot));
+                slot = std::make_shared<parsing::Modifiable>(name);
+                m_hoisted++;
+                return;
+            }
+        }
+
+        if (auto* math = dynamic_cast<parsing::Math*>(slot.get()))
+        {
+            hoistSlot(math->m_left, hoisted);
+            hoistSlot(math->m_right, hoisted);
+        }
+        else if (auto* modifiable = dynamic_cast<parsing::Modifiable*>(slot.get()))
+        {
+            hoistChain(*modifiable, hoisted);
+        }
+        else if (auto* result = dynamic_cast<parsing::RoutineCallResult*>(slot.get()))
+        {
+            for (auto& param : result->m_routine_call->m_parameters)
+            {
+                hoistSlot(param, hoisted);
+            }
+        }
+    }
+
+    void hoistChain(parsing::Modifiable& modifiable, Items& hoisted)
+    {
+        for (auto& item : modifiable.m_chain)
+        {
+            if (auto* index = dynamic_cast<parsing::ArrayAccess*>(item.get()))
+            {
+                hoistSlot(index->access, hoisted);
+            }
+        }
+    }
+
+    bool isInvariant(parsing::Expression& expr) const
+    {
+        if (dynamic_cast<parsing::Integer*>(&expr) || dynamic_cast<parsing::Real*>(&expr)
+            || dynamic_cast<parsing::Boolean*>(&expr))
+        {
+            return true;
+        }
+        if (auto* modifiable = dynamic_cast<parsing::Modifiable*>(&expr))
+        {
+            if (m_variant.contains(modifiable->m_head_name) || !m_variables.contains(modifiable->m_head_name))
+            {
+                return false;
+            }
+            for (auto& item : modifiable->m_chain)
+            {
+                auto* index = dynamic_cast<parsing::ArrayAccess*>(item.get());
+                if (index && !isInvariant(*index->access))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+        if (auto* math = dynamic_cast<parsing::Math*>(&expr))
+        {
+            return isInvariant(*math->m_left) && isInvariant(*math->m_right);
+        }
+        return false;
+    }
+
+    /*
+     * Literals and plain variable reads are as cheap as a hoisted variable.
+    */
+    static bool isWorthHoisting(parsing::Expression& expr)
+    {
+        if (auto* modifiable = dynamic_cast<parsing::Modifiable*>(&expr))
+        {
+            return !modifiable->m_chain.empty();
+        }
+        if (auto* math = dynamic_cast<parsing::Math*>(&expr))
+        {
+            return readsVariables(*math);
+        }
+        return false;
+    }
+
+    static bool readsVariables(parsing::Expression& expr)
+    {
+        if (dynamic_cast<parsing::Modifiable*>(&expr))
+        {
+            return true;
+        }
+        if (auto* math = dynamic_cast<parsing::Math*>(&expr))
+        {
+            return readsVariables(*math->m_left) || readsVariables(*math->m_right);
+        }
+        return false;
+    }
+
+    std::string typeOf(parsing::Expression& expr) const
+    {
+        if (dynamic_cast<parsing::Integer*>(&expr))
+        {
+            return "integer";
+        }
+        if (dynamic_cast<parsing::Real*>(&expr))
+        {
+            return "real";
+        }
+        if (dynamic_cast<parsing::Boolean*>(&expr))
+        {
+            return "boolean";
+        }
+        if (auto* modifiable = dynamic_cast<parsing::Modifiable*>(&expr))
+        {
+            auto found = m_variables.find(modifiable->m_head_name);
+            if (found == m_variables.end())
+            {
+                return "";
+            }
+            return m_types.primitiveName(m_types.chainType(found->second, *modifiable));
+        }
+        if (auto* math = dynamic_cast<parsing::Math*>(&expr))
+        {
+            switch (math->m_grammar)
+            {
+                case GrammarUnit::PLUS:
+                case GrammarUnit::MINUS:
+                case GrammarUnit::MULTIPLICATE:
+                case GrammarUnit::DIVISION:
+                case GrammarUnit::MOD:
+                    return typeOf(*math->m_left);
+                default:
+                    return "boolean";
+            }
+        }
+        return "";
+    }
+
+    analysis::TypeResolver m_types;
+    std::unordered_map<std::string, std::shared_ptr<parsing::Type>> m_variables;
+
+    // names that may change while the current loop runs
+    std::unordered_set<std::string> m_variant;
+
+    size_t m_next = 1;
+    size_t m_hoisted = 0;
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "analyzer/ast-utils.hpp"
+#include "analyzer/strategies/inline-routines.hpp"
+#include "parser/AST-node.hpp"
+#include "parser/body.hpp"
+#include "parser/expression.hpp"
+#include "parser/routine.hpp"
+#include "parser/statement.hpp"
+#include "parser/visitor/recursive-visitor.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ *  Chooses how conditionals are lowered.
+ *
+ *  `if c then x := a else x := b end` and `if c then x := a end` become
+ *  a select when both values are cheap and safe to compute whatever `c`
+ *  is, see analysis::isSpeculatable. Data-dependent conditions then cost
+ *  no mispredicted branches.
+ *
+ *  `and`/`or` are evaluated eagerly, without branches, when the right
+ *  operand is speculatable too. Otherwise it is short-circuited: calls
+ *  and traps in it only happen when the left operand does not decide.
+ *
+ *  Both are flags for the generator, recomputed on every run. The pass
+ *  reads the array bounds proven by RangeAnalysis and goes after it.
+*/
+struct IfConversion : public parsing::RecursiveVisitor
+{
+    explicit IfConversion(std::shared_ptr<parsing::Program>)
+    {
+    }
+
+    bool apply(parsing::Routine& routine)
+    {
+        routine.m_body->accept(*this);
+
+        if (m_changed && m_converted != 0)
+        {
+            m_remarks.push_back(routine.m_name + ": " + std::to_string(m_converted) + " if(s) lowered to select");
+        }
+        return m_changed;
+    }
+
+    void visit(parsing::If& node) override
+    {
+        parsing::RecursiveVisitor::visit(node);
+
+        bool branchless = isConvertible(node);
+        m_converted += branchless;
+        m_changed = m_changed || node.m_branchless != branchless;
+        node.m_branchless = branchless;
+    }
+
+    void visit(parsing::Math& node) override
+    {
+        parsing::RecursiveVisitor::visit(node);
+
+        if (auto* logic = dynamic_cast<parsing::Logic*>(&node))
+        {
+            bool short_circuit = (node.m_grammar == GrammarUnit::AND || node.m_grammar == GrammarUnit::OR)
+                && !analysis::isSpeculatable(*node.m_right);
+            m_changed = m_changed || logic->m_short_circuit != short_circuit;
+            logic->m_short_circuit = short_circuit;
+        }
+    }
+
+    // nodes each arm may have to still be worth computing unconditionally
+    size_t m_max_arm_size = 8;
+
+    std::vector<std::string> m_remarks;
+
+private:
+    bool isConvertible(parsing::If& node) const
+    {
+        auto* then_arm = singleAssignment(*node.m_then);
+        if (!then_arm || !isCheap(*then_arm->m_expression))
+        {
+            return false;
+        }
+        if (!node.m_else)
+        {
+            return true;
+        }
+        auto* else_arm = singleAssignment(*node.m_else);
+        return else_arm && else_arm->m_modifiable->m_head_name == then_arm->m_modifiable->m_head_name
+            && isCheap(*else_arm->m_expression);
+    }
+
+    /*
+     * The only statement of an arm when it assigns a plain variable.
+    */
+    static parsing::Assignment* singleAssignment(parsing::Body& arm)
+    {
+        if (arm.m_items.size() != 1)
+        {
+            return nullptr;
+        }
+        auto* assignment = dynamic_cast<parsing::Assignment*>(arm.m_items.front().get());
+        return assignment && assignment->m_modifiable->m_chain.empty() ? assignment : nullptr;
+    }
+
+    bool isCheap(parsing::Expression& expr) const
+    {
+        inlining::BodyShape shape;
+        expr.accept(shape);
+        return shape.m_size <= m_max_arm_size && analysis::isSpeculatable(expr);
+    }
+
+    bool m_changed = false;
+    size_t m_converted = 0;
+};
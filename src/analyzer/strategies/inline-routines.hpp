@@ -0,0 +1,569 @@
+#pragma once
+
+#include "analyzer/analyzer.hpp"
+#include "analyzer/ast-utils.hpp"
+#include "parser/AST-node.hpp"
+#include "parser/body.hpp"
+#include "parser/declaration.hpp"
+#include "parser/expression.hpp"
+#include "parser/return.hpp"
+#include "parser/routine.hpp"
+#include "parser/statement.hpp"
+#include "parser/std-function.hpp"
+#include "parser/visitor/clone-visitor.hpp"
+#include "parser/visitor/recursive-visitor.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace inlining
+{
+
+/*
+ *  What the inliner needs to know about a routine body:
+ *  its size, where it returns and which names it declares.
+*/
+struct BodyShape : public parsing::RecursiveVisitor
+{
+    void visit(parsing::Body& node) override
+    {
+        for (auto& item : node.m_items)
+        {
+            if (dynamic_cast<parsing::Type*>(item.get()))
+            {
+                m_declares_types = true;
+            }
+        }
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    void visit(parsing::PrimitiveVariable& node) override
+    {
+        m_size++;
+        m_locals.insert(node.m_name);
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    void visit(parsing::ArrayVariable& node) override
+    {
+        m_size++;
+        m_locals.insert(node.m_name);
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    void visit(parsing::For& node) override
+    {
+        m_size++;
+        m_locals.insert(node.m_identifier->m_name);
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    void visit(parsing::ReturnStatement& node) override
+    {
+        m_size++;
+        m_returns++;
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    void visit(parsing::RoutineCall& node) override
+    {
+        m_size++;
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    void visit(parsing::StdFunction& node) override
+    {
+        m_size++;
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    void visit(parsing::Assignment& node) override
+    {
+        m_size++;
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    void visit(parsing::If& node) override
+    {
+        m_size++;
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    void visit(parsing::While& node) override
+    {
+        m_size++;
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    void visit(parsing::Math& node) override
+    {
+        m_size++;
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    void visit(parsing::Modifiable& node) override
+    {
+        m_size++;
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    void visit(parsing::ArrayAccess& node) override
+    {
+        m_size++;
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    void visit(parsing::Integer&) override
+    {
+        m_size++;
+    }
+
+    void visit(parsing::Real&) override
+    {
+        m_size++;
+    }
+
+    void visit(parsing::Boolean&) override
+    {
+        m_size++;
+    }
+
+    void visit(parsing::True&) override
+    {
+        m_size++;
+    }
+
+    void visit(parsing::False&) override
+    {
+        m_size++;
+    }
+
+    size_t m_size = 0;
+    size_t m_returns = 0;
+    bool m_declares_types = false;
+    std::unordered_set<std::string> m_locals;
+};
+
+inline BodyShape shapeOf(parsing::Body& body)
+{
+    BodyShape shape;
+    body.accept(shape);
+    return shape;
+}
+
+} // namespace inlining
+
+/*
+ *  Inlines calls to small routines into their callers.
+ *
+ *  Routines are visited bottom-up over the call graph, so callees are
+ *  already as inlined as they get when their size is estimated.
+ *  Routines in recursive cycles are never inlined. The parameters
+ *  become variables initialised with the arguments and every name
+ *  declared in the callee gets a `.inlN` suffix, which can not clash
+ *  with anything written in the source.
+ *
+ *  The call is replaced in place when it is a statement. A call in an
+ *  expression is hoisted in front of the statement it is part of, together
+ *  with the calls evaluated before it, so side effects keep their order.
+ *  The callee must then return once, at its very end. Calls in the right
+ *  operand of `and`/`or` may not happen at all and stay where they are,
+ *  as does everything evaluated after them.
+*/
+struct InlineRoutines
+{
+    explicit InlineRoutines(std::shared_ptr<parsing::Program> program) : m_ast(program), m_graph(*program)
+    {
+    }
+
+    PassResult apply()
+    {
+        PassResult result;
+        m_recursive = m_graph.recursive();
+        m_call_sites = m_graph.callSites();
+
+        for (auto& component : m_graph.bottomUp())
+        {
+            for (auto& name : component)
+            {
+                auto& caller = *m_graph.m_by_name.at(name);
+                if (inlineInto(caller))
+                {
+                    result.m_changed = true;
+                    result.m_dirty.insert(caller.m_name);
+                }
+            }
+        }
+        return result;
+    }
+
+    // size of a callee (in AST nodes) that is always worth inlining
+    size_t m_threshold = 24;
+    // callers stop growing at this size
+    size_t m_max_caller_size = 2000;
+
+    std::vector<std::string> m_remarks;
+
+private:
+    /*
+     * A call site: either an expression slot holding a call
+     * or the call statement itself. Without a call it marks the
+     * point after which nothing can be hoisted.
+    */
+    struct Site
+    {
+        std::shared_ptr<parsing::Expression>* m_slot = nullptr;
+        parsing::RoutineCall* m_call = nullptr;
+    };
+
+    bool inlineInto(parsing::Routine& caller)
+    {
+        m_caller = &caller;
+        m_caller_size = inlining::shapeOf(*caller.m_body).m_size;
+        // the suffixes left by earlier runs must not be reused
+        m_next_suffix = analysis::firstFreeIndex(*caller.m_body, ".inl");
+        m_changed = false;
+
+        processBody(*caller.m_body, false);
+        return m_changed;
+    }
+
+    void processBody(parsing::Body& body, bool in_loop)
+    {
+        for (size_t idx = 0; idx < body.m_items.size(); ++idx)
+        {
+            auto item = body.m_items[idx];
+            std::vector<std::shared_ptr<parsing::ASTNode>> hoisted;
+            bool replaced = false;
+
+            while (true)
+            {
+                auto sites = sitesOf(*item);
+                size_t chosen = 0;
+                while (chosen < sites.size() && !shouldInline(*sites[chosen].m_call, in_loop))
+                {
+                    ++chosen;
+                }
+                if (chosen == sites.size())
+                {
+                    break;
+                }
+
+                // calls evaluated before the inlined one have to stay before it
+                for (size_t before = 0; before < chosen; ++before)
+                {
+                    hoistIntoTemporary(*sites[before].m_slot, hoisted);
+                }
+
+                auto& site = sites[chosen];
+                auto result = expand(*site.m_call, hoisted);
+                m_changed = true;
+                if (!site.m_slot)
+                {
+                    replaced = true;
+                    break;
+                }
+                *site.m_slot = std::make_shared<parsing::Modifiable>(result);
+            }
+
+            if (replaced)
+            {
+                body.m_items.erase(body.m_items.begin() + idx);
+            }
+            body.m_items.insert(body.m_items.begin() + idx, hoisted.begin(), hoisted.end());
+            idx += hoisted.size();
+            if (replaced)
+            {
+                --idx;
+                continue;
+            }
+
+            if (auto* branch = dynamic_cast<parsing::If*>(item.get()))
+            {
+                processBody(*branch->m_then, in_loop);
+                if (branch->m_else)
+                {
+                    processBody(*branch->m_else, in_loop);
+                }
+            }
+            else if (auto* loop = dynamic_cast<parsing::For*>(item.get()))
+            {
+                processBody(*loop->m_body, true);
+            }
+            else if (auto* loop = dynamic_cast<parsing::While*>(item.get()))
+            {
+                processBody(*loop->m_body, true);
+            }
+            else if (auto* nested = dynamic_cast<parsing::Body*>(item.get()))
+            {
+                processBody(*nested, in_loop);
+            }
+        }
+    }
+
+    /*
+     * The calls a body item makes itself (not in nested bodies),
+     * in the order the generator evaluates them.
+     * While conditions are evaluated on every iteration and can't be hoisted.
+    */
+    static std::vector<Site> sitesOf(parsing::ASTNode& item)
+    {
+        std::vector<Site> sites;
+        if (auto* var = dynamic_cast<parsing::PrimitiveVariable*>(&item))
+        {
+            if (var->m_value)
+            {
+                collectSites(var->m_value, sites);
+            }
+        }
+        else if (auto* assignment = dynamic_cast<parsing::Assignment*>(&item))
+        {
+            collectSites(assignment->m_expression, sites);
+            collectChainSites(*assignment->m_modifiable, sites);
+        }
+        else if (auto* ret = dynamic_cast<parsing::ReturnStatement*>(&item))
+        {
+            collectSites(ret->m_expr, sites);
+        }
+        else if (auto* branch = dynamic_cast<parsing::If*>(&item))
+        {
+            collectSites(branch->m_condition, sites);
+        }
+        else if (auto* loop = dynamic_cast<parsing::For*>(&item))
+        {
+            collectSites(loop->m_range->m_begin, sites);
+            collectSites(loop->m_range->m_end, sites);
+        }
+        else if (auto* call = dynamic_cast<parsing::RoutineCall*>(&item))
+        {
+            for (auto& param : call->m_parameters)
+            {
+                collectSites(param, sites);
+            }
+            if (!dynamic_cast<parsing::StdFunction*>(call))
+            {
+                sites.push_back({ nullptr, call });
+            }
+        }
+
+        auto barrier = std::find_if(sites.begin(), sites.end(), [](const Site& site) { return !site.m_call; });
+        sites.erase(barrier, sites.end());
+        return sites;
+    }
+
+    static void collectSites(std::shared_ptr<parsing::Expression>& slot, std::vector<Site>& sites)
+    {
+        if (auto* math = dynamic_cast<parsing::Math*>(slot.get()))
+        {
+            collectSites(math->m_left, sites);
+            bool conditional = math->m_grammar == GrammarUnit::AND || math->m_grammar == GrammarUnit::OR;
+            if (conditional && !analysis::calledNames(*math->m_right).empty())
+            {
+                sites.push_back({});
+                return;
+            }
+            collectSites(math->m_right, sites);
+        }
+        else if (auto* modifiable = dynamic_cast<parsing::Modifiable*>(slot.get()))
+        {
+            collectChainSites(*modifiable, sites);
+        }
+        else if (auto* result = dynamic_cast<parsing::RoutineCallResult*>(slot.get()))
+        {
+            for (auto& param : result->m_routine_call->m_parameters)
+            {
+                collectSites(param, sites);
+            }
+            sites.push_back({ &slot, result->m_routine_call.get() });
+        }
+    }
+
+    static void collectChainSites(parsing::Modifiable& modifiable, std::vector<Site>& sites)
+    {
+        for (auto& access : modifiable.m_chain)
+        {
+            if (auto* index = dynamic_cast<parsing::ArrayAccess*>(access.get()))
+            {
+                collectSites(index->access, sites);
+            }
+        }
+    }
+
+    bool shouldInline(parsing::RoutineCall& call, bool in_loop)
+    {
+        auto found = m_graph.m_by_name.find(call.m_routine_name);
+        if (found == m_graph.m_by_name.end())
+        {
+            return false;
+        }
+        auto& callee = *found->second;
+        std::string where = callee.m_name + " into " + m_caller->m_name;
+
+        if (m_recursive.contains(callee.m_name))
+        {
+            refuse(where, "recursive");
+            return false;
+        }
+        if (!isScalar(callee.return_type, true))
+        {
+            return false;
+        }
+        for (auto& param : callee.m_params)
+        {
+            if (!isScalar(param->m_type, false))
+            {
+                return false;
+            }
+        }
+
+        auto shape = inlining::shapeOf(*callee.m_body);
+        if (shape.m_declares_types || shape.m_returns > 1 || (shape.m_returns == 1 && !endsWithReturn(callee)))
+        {
+            return false;
+        }
+
+        // with a single call site the callee is going to be dead afterwards
+        size_t threshold = m_threshold;
+        if (in_loop)
+        {
+            threshold *= 2;
+        }
+        if (m_call_sites[callee.m_name] == 1)
+        {
+            threshold *= 4;
+        }
+        if (shape.m_size > threshold)
+        {
+            refuse(where, "cost " + std::to_string(shape.m_size) + " exceeds threshold " + std::to_string(threshold));
+            return false;
+        }
+        if (m_caller_size + shape.m_size > m_max_caller_size)
+        {
+            refuse(where, "caller is too large");
+            return false;
+        }
+
+        m_caller_size += shape.m_size;
+        m_remarks.push_back("inlined " + where + " (cost " + std::to_string(shape.m_size) + ")");
+        return true;
+    }
+
+    void refuse(const std::string& where, const std::string& reason)
+    {
+        // the same site is looked at again after every inlining in its statement
+        std::string remark = "not inlining " + where + ": " + reason;
+        if (m_refusals.insert(remark).second)
+        {
+            m_remarks.push_back(remark);
+        }
+    }
+
+    /*
+     * Pastes the callee body into `hoisted`.
+     * Returns the name of the variable holding the result.
+    */
+    std::string expand(parsing::RoutineCall& call, std::vector<std::shared_ptr<parsing::ASTNode>>& hoisted)
+    {
+        auto& callee = *m_graph.m_by_name.at(call.m_routine_name);
+        std::string suffix = ".inl" + std::to_string(m_next_suffix++);
+
+        std::unordered_map<std::string, std::string> renames;
+        for (auto& param : callee.m_params)
+        {
+            renames[param->m_name] = param->m_name + suffix;
+        }
+        for (auto& local : inlining::shapeOf(*callee.m_body).m_locals)
+        {
+            renames[local] = local + suffix;
+        }
+
+        for (size_t idx = 0; idx < callee.m_params.size(); ++idx)
+        {
+            auto& param = callee.m_params[idx];
+            hoisted.push_back(std::make_shared<parsing::PrimitiveVariable>(
+                renames.at(param->m_name),
+                std::make_shared<parsing::PrimitiveType>(param->m_type),
+                call.m_parameters[idx]));
+        }
+
+        parsing::Cloner cloner(renames);
+        auto body = cloner.clone(callee.m_body);
+        std::shared_ptr<parsing::ReturnStatement> ret;
+        if (!body->m_items.empty())
+        {
+            ret = std::dynamic_pointer_cast<parsing::ReturnStatement>(body->m_items.back());
+        }
+        if (ret)
+        {
+            body->m_items.pop_back();
+        }
+        hoisted.insert(hoisted.end(), body->m_items.begin(), body->m_items.end());
+
+        std::string result = "result" + suffix;
+        if (ret)
+        {
+            hoisted.push_back(std::make_shared<parsing::PrimitiveVariable>(
+                result, std::make_shared<parsing::PrimitiveType>(callee.return_type), ret->m_expr));
+        }
+        return result;
+    }
+
+    void hoistIntoTemporary(
+        std::shared_ptr<parsing::Expression>& slot, std::vector<std::shared_ptr<parsing::ASTNode>>& hoisted)
+    {
+        auto& call = *std::dynamic_pointer_cast<parsing::RoutineCallResult>(slot)->m_routine_call;
+        auto& callee = *m_graph.m_by_name.at(call.m_routine_name);
+
+        std::string name = "call.inl" + std::to_string(m_next_suffix++);
+        hoisted.push_back(std::make_shared<parsing::PrimitiveVariable>(
+            name, std::make_shared<parsing::PrimitiveType>(callee.return_type), slot));
+        slot = std::make_shared<parsing::Modifiable>(name);
+    }
+
+    static bool endsWithReturn(parsing::Routine& routine)
+    {
+        auto& items = routine.m_body->m_items;
+        return !items.empty() && dynamic_cast<parsing::ReturnStatement*>(items.back().get());
+    }
+
+    /*
+     * Only values that fit into a register are passed around,
+     * arrays and records are left for the generator.
+    */
+    bool isScalar(const std::string& type_name, bool allow_void) const
+    {
+        if (type_name.empty())
+        {
+            return allow_void;
+        }
+        if (type_name == "integer" || type_name == "real" || type_name == "boolean")
+        {
+            return true;
+        }
+        for (auto& decl : m_ast->m_declarations)
+        {
+            auto* alias = dynamic_cast<parsing::TypeAliasing*>(decl.get());
+            if (alias && alias->m_name == type_name)
+            {
+                return !alias->m_from->isArray() && isScalar(alias->m_from->m_name, false);
+            }
+        }
+        return false;
+    }
+
+    std::shared_ptr<parsing::Program> m_ast;
+    analysis::CallGraph m_graph;
+    std::unordered_set<std::string> m_recursive;
+    std::unordered_map<std::string, size_t> m_call_sites;
+    std::unordered_set<std::string> m_refusals;
+
+    parsing::Routine* m_caller = nullptr;
+    size_t m_caller_size = 0;
+    size_t m_next_suffix = 1;
+    bool m_changed = false;
+};
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "analyzer/ast-utils.hpp"
+#include "analyzer/intervals.hpp"
+#include "parser/AST-node.hpp"
+#include "parser/body.hpp"
+#include "parser/declaration.hpp"
+#include "parser/expression.hpp"
+#include "parser/routine.hpp"
+#include "parser/statement.hpp"
+#include "parser/visitor/recursive-visitor.hpp"
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/*
+ *  Interval analysis of array indices.
+ *
+ *  Iterators of forward `for` loops that are never assigned in the loop
+ *  body take values from [begin, end - 1]. Intervals are propagated
+ *  through integer arithmetic and compared with the constant size of the
+ *  accessed array. Every access that can not go out of bounds gets
+ *  ArrayAccess::m_in_bounds, the generator skips its runtime check.
+ *
+ *  Every flag is recomputed on each run, so it has to come after every
+ *  pass that rewrites the AST.
+*/
+struct RangeAnalysis : public parsing::RecursiveVisitor
+{
+    explicit RangeAnalysis(std::shared_ptr<parsing::Program> program) : m_types(program)
+    {
+    }
+
+    bool apply(parsing::Routine& routine)
+    {
+        m_types.m_hidden.clear();
+        m_variables.clear();
+        m_iterators.clear();
+        for (auto& param : routine.m_params)
+        {
+            m_variables[param->m_name] = std::make_shared<parsing::PrimitiveType>(param->m_type);
+        }
+
+        routine.m_body->accept(*this);
+
+        if (!m_changed)
+        {
+            return false;
+        }
+        m_remarks.push_back(
+            routine.m_name + ": " + std::to_string(m_proven) + " of " + std::to_string(m_accesses)
+            + " array accesses proven in bounds");
+        return true;
+    }
+
+    void visit(parsing::Body& node) override
+    {
+        auto outer_variables = m_variables;
+        auto outer_iterators = m_iterators;
+
+        for (auto& item : node.m_items)
+        {
+            if (auto* var = dynamic_cast<parsing::ArrayVariable*>(item.get()))
+            {
+                declare(var->m_name, var->m_type);
+            }
+            else if (auto* var = dynamic_cast<parsing::Variable*>(item.get()))
+            {
+                declare(var->m_name, var->m_type);
+            }
+            else if (auto* type = dynamic_cast<parsing::Type*>(item.get()))
+            {
+                // a local type may hide a global one with another size
+                m_types.m_hidden.insert(type->m_name);
+            }
+            item->accept(*this);
+        }
+
+        m_variables = std::move(outer_variables);
+        m_iterators = std::move(outer_iterators);
+    }
+
+    void visit(parsing::For& node) override
+    {
+        node.m_range->accept(*this);
+
+        auto outer_iterators = m_iterators;
+        auto iterator = intervals::iteratorOf(node, m_iterators);
+        m_iterators.erase(node.m_identifier->m_name);
+        if (iterator)
+        {
+            m_iterators[node.m_identifier->m_name] = *iterator;
+        }
+
+        node.m_body->accept(*this);
+        m_iterators = std::move(outer_iterators);
+    }
+
+    void visit(parsing::Modifiable& node) override
+    {
+        auto type = lookup(node.m_head_name);
+        for (auto& item : node.m_chain)
+        {
+            if (auto* index = dynamic_cast<parsing::ArrayAccess*>(item.get()))
+            {
+                auto array = m_types.asArray(type);
+                auto size = array ? m_types.sizeOf(*array) : std::nullopt;
+                auto range = intervals::evaluate(*index->access, m_iterators);
+
+                bool proven = size && range && range->m_low >= 0 && range->m_high < *size;
+                m_accesses++;
+                m_proven += proven;
+                m_changed = m_changed || index->m_in_bounds != proven;
+                index->m_in_bounds = proven;
+
+                type = array ? array->m_type : nullptr;
+            }
+            else if (auto* field = dynamic_cast<parsing::RecordAccess*>(item.get()))
+            {
+                type = m_types.fieldType(type, field->identifier);
+            }
+            item->accept(*this);
+        }
+    }
+
+    std::vector<std::string> m_remarks;
+
+private:
+    void declare(const std::string& name, std::shared_ptr<parsing::Type> type)
+    {
+        m_variables[name] = std::move(type);
+        m_iterators.erase(name);
+    }
+
+    std::shared_ptr<parsing::Type> lookup(const std::string& name) const
+    {
+        auto found = m_variables.find(name);
+        return found == m_variables.end() ? nullptr : found->second;
+    }
+
+    analysis::TypeResolver m_types;
+    bool m_changed = false;
+    size_t m_accesses = 0;
+    size_t m_proven = 0;
+
+    std::unordered_map<std::string, std::shared_ptr<parsing::Type>> m_variables;
+    intervals::Environment m_iterators;
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "analyzer/analyzer.hpp"
+#include "analyzer/ast-utils.hpp"
+#include "parser/AST-node.hpp"
+#include "parser/declaration.hpp"
+#include "parser/routine.hpp"
+
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+/*
+ *  Removes the top-level routines and types the program can never reach.
+ *
+ *  Everything reachable from `main` through calls is kept, together with
+ *  the types those routines (and global variables) mention, directly or
+ *  through other types. So are the routines called in the sizes of global
+ *  types and variables. A program without `main` is left as it is,
+ *  there is no way to tell what is used.
+*/
+struct RemoveDeadDeclarations
+{
+    explicit RemoveDeadDeclarations(std::shared_ptr<parsing::Program> program) : m_ast(program)
+    {
+    }
+
+    PassResult apply()
+    {
+        analysis::CallGraph graph(*m_ast);
+        if (!graph.m_by_name.contains("main"))
+        {
+            return {};
+        }
+
+        std::unordered_set<std::string> live_routines { "main" };
+        std::vector<std::string> worklist { "main" };
+        // array sizes may call routines, EvaluateCalls folds those it can evaluate
+        for (auto& decl : m_ast->m_declarations)
+        {
+            if (dynamic_cast<parsing::Routine*>(decl.get()))
+            {
+                continue;
+            }
+            for (auto& callee : analysis::calledNames(*decl))
+            {
+                if (graph.m_by_name.contains(callee) && live_routines.insert(callee).second)
+                {
+                    worklist.push_back(callee);
+                }
+            }
+        }
+        while (!worklist.empty())
+        {
+            auto name = worklist.back();
+            worklist.pop_back();
+            for (auto& callee : graph.m_calls.at(name))
+            {
+                if (live_routines.insert(callee).second)
+                {
+                    worklist.push_back(callee);
+                }
+            }
+        }
+
+        // types are looked up by name, so are the type declarations
+        std::unordered_set<std::string> live_types;
+        auto mention = [&](parsing::ASTNode& node)
+        {
+            for (auto& name : analysis::referencedTypes(node))
+            {
+                if (live_types.insert(name).second)
+                {
+                    worklist.push_back(name);
+                }
+            }
+        };
+
+        for (auto& decl : m_ast->m_declarations)
+        {
+            if (live_routines.contains(decl->m_name) && dynamic_cast<parsing::Routine*>(decl.get()))
+            {
+                mention(*decl);
+            }
+            else if (!isTypeDecl(*decl) && !dynamic_cast<parsing::Routine*>(decl.get()))
+            {
+                mention(*decl);
+            }
+        }
+        while (!worklist.empty())
+        {
+            auto name = worklist.back();
+            worklist.pop_back();
+            for (auto& decl : m_ast->m_declarations)
+            {
+                if (decl->m_name == name && isTypeDecl(*decl))
+                {
+                    mention(*decl);
+                }
+            }
+        }
+
+        size_t removed = std::erase_if(
+            m_ast->m_declarations,
+            [&](const std::shared_ptr<parsing::Declaration>& decl)
+            {
+                if (dynamic_cast<parsing::Routine*>(decl.get()) && !live_routines.contains(decl->m_name))
+                {
+                    m_remarks.push_back("removed routine " + decl->m_name);
+                    return true;
+                }
+                if (isTypeDecl(*decl) && !live_types.contains(decl->m_name))
+                {
+                    m_remarks.push_back("removed type " + decl->m_name);
+                    return true;
+                }
+                return false;
+            });
+
+        PassResult result;
+        result.m_changed = removed != 0;
+        return result;
+    }
+
+    static bool isTypeDecl(parsing::Declaration& decl)
+    {
+        return dynamic_cast<parsing::Type*>(&decl) != nullptr;
+    }
+
+    std::shared_ptr<parsing::Program> m_ast;
+    std::vector<std::string> m_remarks;
+};
@@ -73,7 +73,11 @@ struct RemoveUnreachableCode : public parsing::IVisitor
             node.m_items[idx]->accept(*this);
         }
 
-        node.m_items.erase(node.m_items.begin() + idx_of_return, node.m_items.end());
+        if (idx_of_return < node.m_items.size())
+        {
+            node.m_items.erase(node.m_items.begin() + idx_of_return, node.m_items.end());
+            m_changed = true;
+        }
     }
 
     void visit(parsing::Routine& node) override
@@ -181,5 +185,12 @@ struct RemoveUnreachableCode : public parsing::IVisitor
         m_ast->accept(*this);
     }
 
+    bool apply(parsing::Routine& routine)
+    {
+        routine.accept(*this);
+        return m_changed;
+    }
+
     std::shared_ptr<parsing::Program> m_ast;
+    bool m_changed = false;
 };
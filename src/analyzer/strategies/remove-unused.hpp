@@ -47,10 +47,13 @@ struct RemoveUnusedDeclarations : public parsing::IVisitor
 
     void visit(parsing::ArrayType& node) override
     {
+        node.m_size->accept(*this);
+        node.m_type->accept(*this);
     }
 
     void visit(parsing::ArrayVariable& node) override
     {
+        node.m_type->accept(*this);
     }
 
     void visit(parsing::PrimitiveVariable& node) override
@@ -74,10 +77,8 @@ struct RemoveUnusedDeclarations : public parsing::IVisitor
                 if (outer_scope.contains(var.m_name)){
                     shadows.insert(var.m_name);
                 }
-                if (var.m_value.get())
-                {
-                    var.m_value->accept(*this);
-                }
+                // the initialiser or the array size may refer to other variables
+                stmt->accept(*this);
 
                 this->table.emplace(var.m_name, 0);
                 continue;
@@ -88,7 +89,7 @@ struct RemoveUnusedDeclarations : public parsing::IVisitor
         }
 
         // remove stuff that is not used
-        std::erase_if(
+        size_t removed = std::erase_if(
             node.m_items,
             [this](auto stmt)
             {
@@ -99,6 +100,7 @@ struct RemoveUnusedDeclarations : public parsing::IVisitor
                 }
                 return false;
             });
+        m_changed = m_changed || removed != 0;
 
         // and then update counts in outer table.
         for (const auto& [variable, usages] : this->table)
@@ -179,10 +181,15 @@ struct RemoveUnusedDeclarations : public parsing::IVisitor
     void visit(parsing::Modifiable& node) override
     {
         this->table[node.m_head_name] += 1;
+        for (auto& access : node.m_chain)
+        {
+            access->accept(*this);
+        }
     }
 
     void visit(parsing::ArrayAccess& node) override
     {
+        node.access->accept(*this);
     }
 
     void visit(parsing::RecordAccess& node) override
@@ -196,6 +203,7 @@ struct RemoveUnusedDeclarations : public parsing::IVisitor
 
     void visit(parsing::If& node) override
     {
+        node.m_condition->accept(*this);
         node.m_then->accept(*this);
         if (node.m_else.get())
         {
@@ -205,10 +213,13 @@ struct RemoveUnusedDeclarations : public parsing::IVisitor
 
     void visit(parsing::Range& node) override
     {
+        node.m_begin->accept(*this);
+        node.m_end->accept(*this);
     }
 
     void visit(parsing::For& node) override
     {
+        node.m_range->accept(*this);
         node.m_body->accept(*this);
     }
 
@@ -233,6 +244,13 @@ struct RemoveUnusedDeclarations : public parsing::IVisitor
         m_ast->accept(*this);
     }
 
+    bool apply(parsing::Routine& routine)
+    {
+        routine.accept(*this);
+        return m_changed;
+    }
+
     std::shared_ptr<parsing::Program> m_ast;
     std::unordered_map<std::string, int> table;
+    bool m_changed = false;
 };
\ No newline at end of file
@@ -0,0 +1,235 @@
+#pragma once
+
+#include "analyzer/analyzer.hpp"
+#include "analyzer/ast-utils.hpp"
+#include "analyzer/strategies/inline-routines.hpp"
+#include "parser/AST-node.hpp"
+#include "parser/declaration.hpp"
+#include "parser/expression.hpp"
+#include "parser/routine.hpp"
+#include "parser/std-function.hpp"
+#include "parser/visitor/clone-visitor.hpp"
+#include "parser/visitor/recursive-visitor.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace specializing
+{
+
+/*
+ *  Calls to user routines together with the routine making them.
+*/
+struct CallSites : public parsing::RecursiveVisitor
+{
+    void visit(parsing::RoutineCall& node) override
+    {
+        m_calls.push_back({ m_caller, &node });
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    std::string m_caller;
+    std::vector<std::pair<std::string, parsing::RoutineCall*>> m_calls;
+};
+
+/*
+ *  Spelling of an integer or boolean literal, nothing for anything else.
+ *  Reals are left out, their text would not tell close values apart.
+*/
+inline std::optional<std::string> literalText(parsing::Expression& expr)
+{
+    if (auto* integer = dynamic_cast<parsing::Integer*>(&expr))
+    {
+        return std::to_string(integer->m_value);
+    }
+    if (auto* boolean = dynamic_cast<parsing::Boolean*>(&expr))
+    {
+        return boolean->m_value ? "true" : "false";
+    }
+    return std::nullopt;
+}
+
+} // namespace specializing
+
+/*
+ *  Clones routines for the constant arguments they are called with.
+ *
+ *  A call `f(3, x)` is redirected to `f<3,_>`, a copy of `f` without its
+ *  first parameter that starts with `var first is 3`. Constant folding and
+ *  unreachable code removal then simplify the copy, and the original is
+ *  removed once nothing calls it. The name of a clone spells its constants,
+ *  so later calls with the same ones share it.
+ *
+ *  Only routines up to m_max_size nodes are cloned, at most
+ *  m_max_per_routine times each and m_max_total times in the program.
+*/
+struct SpecializeRoutines
+{
+    explicit SpecializeRoutines(std::shared_ptr<parsing::Program> program) : m_ast(program), m_graph(*program)
+    {
+    }
+
+    PassResult apply()
+    {
+        PassResult result;
+
+        specializing::CallSites sites;
+        for (auto* routine : m_graph.m_routines)
+        {
+            sites.m_caller = routine->m_name;
+            routine->m_body->accept(sites);
+        }
+
+        for (auto& [caller, call] : sites.m_calls)
+        {
+            if (dynamic_cast<parsing::StdFunction*>(call) || !m_graph.m_by_name.contains(call->m_routine_name))
+            {
+                continue;
+            }
+            auto& callee = *m_graph.m_by_name.at(call->m_routine_name);
+
+            std::vector<std::optional<std::string>> constants;
+            std::string name = callee.m_name + "<";
+            bool any = false;
+            for (size_t idx = 0; idx < call->m_parameters.size(); ++idx)
+            {
+                constants.push_back(specializing::literalText(*call->m_parameters[idx]));
+                any = any || constants.back();
+                name += (idx == 0 ? "" : ",") + constants.back().value_or("_");
+            }
+            name += ">";
+            if (!any)
+            {
+                continue;
+            }
+
+            if (!m_graph.m_by_name.contains(name))
+            {
+                if (!mayClone(callee))
+                {
+                    continue;
+                }
+                specialize(callee, *call, constants, name);
+                result.m_dirty.insert(name);
+            }
+
+            std::vector<std::shared_ptr<parsing::Expression>> remaining;
+            for (size_t idx = 0; idx < constants.size(); ++idx)
+            {
+                if (!constants[idx])
+                {
+                    remaining.push_back(call->m_parameters[idx]);
+                }
+            }
+            call->m_parameters = std::move(remaining);
+            call->m_routine_name = name;
+
+            result.m_changed = true;
+            result.m_dirty.insert(caller);
+        }
+        return result;
+    }
+
+    // routines larger than this (in AST nodes) are never cloned
+    size_t m_max_size = 400;
+    size_t m_max_per_routine = 4;
+    size_t m_max_total = 16;
+
+    std::vector<std::string> m_remarks;
+
+private:
+    bool mayClone(parsing::Routine& callee)
+    {
+        if (inlining::shapeOf(*callee.m_body).m_size > m_max_size)
+        {
+            refuse(callee.m_name, "too large");
+            return false;
+        }
+
+        size_t total = 0;
+        size_t own = 0;
+        for (auto* routine : m_graph.m_routines)
+        {
+            size_t open = routine->m_name.find('<');
+            if (open != std::string::npos)
+            {
+                total++;
+                own += routine->m_name.substr(0, open) == baseName(callee.m_name);
+            }
+        }
+        if (own >= m_max_per_routine)
+        {
+            refuse(callee.m_name, "routine budget spent");
+            return false;
+        }
+        if (total >= m_max_total)
+        {
+            refuse(callee.m_name, "program budget spent");
+            return false;
+        }
+        return true;
+    }
+
+    void specialize(
+        parsing::Routine& callee,
+        parsing::RoutineCall& call,
+        const std::vector<std::optional<std::string>>& constants,
+        const std::string& name)
+    {
+        // right after the original, so it is declared before every caller the original is
+        auto position = std::find_if(
+            m_ast->m_declarations.begin(),
+            m_ast->m_declarations.end(),
+            [&](const std::shared_ptr<parsing::Declaration>& decl) { return decl.get() == &callee; });
+        auto clone = parsing::Cloner().clone(std::static_pointer_cast<parsing::Routine>(*position));
+        clone->m_name = name;
+
+        std::vector<std::shared_ptr<parsing::ASTNode>> prologue;
+        std::vector<std::shared_ptr<parsing::RoutineParameter>> params;
+        for (size_t idx = 0; idx < constants.size(); ++idx)
+        {
+            auto& param = clone->m_params[idx];
+            if (!constants[idx])
+            {
+                params.push_back(param);
+                continue;
+            }
+            prologue.push_back(std::make_shared<parsing::PrimitiveVariable>(
+                param->m_name,
+                std::make_shared<parsing::PrimitiveType>(param->m_type),
+                parsing::Cloner().clone(call.m_parameters[idx])));
+        }
+        clone->m_params = std::move(params);
+        auto& items = clone->m_body->m_items;
+        items.insert(items.begin(), prologue.begin(), prologue.end());
+
+        m_ast->m_declarations.insert(std::next(position), clone);
+
+        m_graph.m_routines.push_back(clone.get());
+        m_graph.m_by_name[name] = clone.get();
+        m_remarks.push_back("specialized " + callee.m_name + " as " + name);
+    }
+
+    void refuse(const std::string& callee, const std::string& reason)
+    {
+        std::string remark = "not specializing " + callee + ": " + reason;
+        if (std::find(m_remarks.begin(), m_remarks.end(), remark) == m_remarks.end())
+        {
+            m_remarks.push_back(remark);
+        }
+    }
+
+    // a clone of a clone counts against the budget of the original
+    static std::string baseName(const std::string& name)
+    {
+        return name.substr(0, name.find('<'));
+    }
+
+    std::shared_ptr<parsing::Program> m_ast;
+    analysis::CallGraph m_graph;
+};
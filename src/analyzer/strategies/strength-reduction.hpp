@@ -0,0 +1,338 @@
+#pragma once
+
+#include "analyzer/ast-utils.hpp"
+#include "analyzer/intervals.hpp"
+#include "parser/AST-node.hpp"
+#include "parser/body.hpp"
+#include "parser/declaration.hpp"
+#include "parser/expression.hpp"
+#include "parser/routine.hpp"
+#include "parser/statement.hpp"
+#include "parser/visitor/clone-visitor.hpp"
+#include "parser/visitor/recursive-visitor.hpp"
+
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+/*
+ *  Strength reduction of induction arithmetic.
+ *
+ *  In a forward `for` loop that leaves its iterator alone, `i * n` with `n`
+ *  a local or a parameter unchanged by the loop is replaced by an `iv.N`
+ *  variable, globals may change in any call. It starts at
+ *  `begin * n` and grows by `n` at the end of every iteration. Products
+ *  with literals are left to the generator, which turns powers of two into
+ *  shifts and keeps them visible to the range analysis.
+ *
+ *  Integer divisions whose operands are proven non-negative are marked with
+ *  Math::m_non_negative, so the generator can use unsigned division, shifts
+ *  and masks. The marks are recomputed on every run.
+*/
+struct StrengthReduction : public parsing::RecursiveVisitor
+{
+    explicit StrengthReduction(std::shared_ptr<parsing::Program>)
+    {
+    }
+
+    bool apply(parsing::Routine& routine)
+    {
+        for (auto& param : routine.m_params)
+        {
+            m_locals.insert(param->m_name);
+        }
+        m_next = analysis::firstFreeIndex(*routine.m_body, "iv.");
+        reduceIn(*routine.m_body);
+
+        routine.m_body->accept(*this);
+
+        if (m_reduced != 0)
+        {
+            m_remarks.push_back(
+                routine.m_name + ": reduced " + std::to_string(m_reduced) + " induction product(s)");
+        }
+        return m_reduced != 0 || m_marked;
+    }
+
+    void visit(parsing::Body& node) override
+    {
+        auto outer_iterators = m_iterators;
+        for (auto& item : node.m_items)
+        {
+            if (auto* var = dynamic_cast<parsing::Variable*>(item.get()))
+            {
+                m_iterators.erase(var->m_name);
+            }
+            item->accept(*this);
+        }
+        m_iterators = std::move(outer_iterators);
+    }
+
+    void visit(parsing::For& node) override
+    {
+        node.m_range->accept(*this);
+
+        auto outer_iterators = m_iterators;
+        auto iterator = intervals::iteratorOf(node, m_iterators);
+        m_iterators.erase(node.m_identifier->m_name);
+        if (iterator)
+        {
+            m_iterators[node.m_identifier->m_name] = *iterator;
+        }
+
+        node.m_body->accept(*this);
+        m_iterators = std::move(outer_iterators);
+    }
+
+    void visit(parsing::Math& node) override
+    {
+        parsing::RecursiveVisitor::visit(node);
+
+        if (node.m_grammar != GrammarUnit::DIVISION && node.m_grammar != GrammarUnit::MOD)
+        {
+            return;
+        }
+        auto left = intervals::evaluate(*node.m_left, m_iterators);
+        auto right = intervals::evaluate(*node.m_right, m_iterators);
+        bool non_negative = left && right && left->nonNegative() && right->m_low > 0;
+
+        m_marked = m_marked || node.m_non_negative != non_negative;
+        node.m_non_negative = non_negative;
+    }
+
+    std::vector<std::string> m_remarks;
+
+private:
+    void reduceIn(parsing::Body& body)
+    {
+        auto outer_locals = m_locals;
+
+        for (size_t idx = 0; idx < body.m_items.size(); ++idx)
+        {
+            auto item = body.m_items[idx];
+            std::vector<std::shared_ptr<parsing::ASTNode>> before;
+
+            if (auto* loop = dynamic_cast<parsing::For*>(item.get()))
+            {
+                auto scope = m_locals;
+                m_locals.insert(loop->m_identifier->m_name);
+                reduceIn(*loop->m_body);
+                m_locals = std::move(scope);
+                before = reduceLoop(*loop);
+            }
+            else if (auto* loop = dynamic_cast<parsing::While*>(item.get()))
+            {
+                reduceIn(*loop->m_body);
+            }
+            else if (auto* branch = dynamic_cast<parsing::If*>(item.get()))
+            {
+                reduceIn(*branch->m_then);
+                if (branch->m_else)
+                {
+                    reduceIn(*branch->m_else);
+                }
+            }
+            else if (auto* nested = dynamic_cast<parsing::Body*>(item.get()))
+            {
+                reduceIn(*nested);
+            }
+            else if (auto* var = dynamic_cast<parsing::Variable*>(item.get()))
+            {
+                m_locals.insert(var->m_name);
+            }
+
+            body.m_items.insert(body.m_items.begin() + idx, before.begin(), before.end());
+            idx += before.size();
+        }
+
+        m_locals = std::move(outer_locals);
+    }
+
+    /*
+     * Rewrites the products of one loop, returns the declarations of the
+     * induction variables to put before it.
+    */
+    std::vector<std::shared_ptr<parsing::ASTNode>> reduceLoop(parsing::For& loop)
+    {
+        auto& iterator = loop.m_identifier->m_name;
+        m_variant = analysis::assignedNames(*loop.m_body);
+        auto declared = analysis::declaredNames(*loop.m_body);
+        m_variant.insert(declared.begin(), declared.end());
+        // the start value repeats the begin of the range, calls there can not be repeated
+        if (loop.m_range->m_reverse || m_variant.contains(iterator)
+            || !analysis::calledNames(*loop.m_range->m_begin).empty())
+        {
+            return {};
+        }
+
+        m_loop = &loop;
+        m_inductions.clear();
+        visitSlots(*loop.m_body);
+
+        std::vector<std::shared_ptr<parsing::ASTNode>> declarations;
+        for (auto& [step, name] : m_inductions)
+        {
+            auto start = std::make_shared<parsing::Multiplication>();
+            start->m_left = parsing::Cloner().clone(loop.m_range->m_begin);
+            start->m_right = std::make_shared<parsing::Modifiable>(step);
+            declarations.push_back(std::make_shared<parsing::PrimitiveVariable>(
+                name, std::make_shared<parsing::PrimitiveType>("integer"), start));
+
+            auto next = std::make_shared<parsing::Plus>();
+            next->m_left = std::make_shared<parsing::Modifiable>(name);
+            next->m_right = std::make_shared<parsing::Modifiable>(step);
+            auto step_up = std::make_shared<parsing::Assignment>();
+            step_up->m_modifiable = std::make_shared<parsing::Modifiable>(name);
+            step_up->m_expression = next;
+            loop.m_body->m_items.push_back(step_up);
+        }
+        return declarations;
+    }
+
+    void visitSlots(parsing::Body& body)
+    {
+        for (auto& item : body.m_items)
+        {
+            if (auto* var = dynamic_cast<parsing::PrimitiveVariable*>(item.get()))
+            {
+                if (var->m_value)
+                {
+                    reduceSlot(var->m_value);
+                }
+            }
+            else if (auto* assignment = dynamic_cast<parsing::Assignment*>(item.get()))
+            {
+                reduceChain(*assignment->m_modifiable);
+                reduceSlot(assignment->m_expression);
+            }
+            else if (auto* ret = dynamic_cast<parsing::ReturnStatement*>(item.get()))
+            {
+                reduceSlot(ret->m_expr);
+            }
+            else if (auto* call = dynamic_cast<parsing::RoutineCall*>(item.get()))
+            {
+                for (auto& param : call->m_parameters)
+                {
+                    reduceSlot(param);
+                }
+            }
+            else if (auto* branch = dynamic_cast<parsing::If*>(item.get()))
+            {
+                reduceSlot(branch->m_condition);
+                visitSlots(*branch->m_then);
+                if (branch->m_else)
+                {
+                    visitSlots(*branch->m_else);
+                }
+            }
+            else if (auto* loop = dynamic_cast<parsing::For*>(item.get()))
+            {
+                reduceSlot(loop->m_range->m_begin);
+                reduceSlot(loop->m_range->m_end);
+                visitSlots(*loop->m_body);
+            }
+            else if (auto* loop = dynamic_cast<parsing::While*>(item.get()))
+            {
+                reduceSlot(loop->m_condition);
+                visitSlots(*loop->m_body);
+            }
+            else if (auto* nested = dynamic_cast<parsing::Body*>(item.get()))
+            {
+                visitSlots(*nested);
+            }
+        }
+    }
+
+    void reduceSlot(std::shared_ptr<parsing::Expression>& slot)
+    {
+        if (auto step = stepOf(*slot))
+        {
+            auto [found, inserted] = m_inductions.try_emplace(*step, "iv." + std::to_string(m_next));
+            m_next += inserted;
+            m_reduced++;
+            slot = std::make_shared<parsing::Modifiable>(found->second);
+            return;
+        }
+
+        if (auto* math = dynamic_cast<parsing::Math*>(slot.get()))
+        {
+            reduceSlot(math->m_left);
+            reduceSlot(math->m_right);
+        }
+        else if (auto* modifiable = dynamic_cast<parsing::Modifiable*>(slot.get()))
+        {
+            reduceChain(*modifiable);
+        }
+        else if (auto* result = dynamic_cast<parsing::RoutineCallResult*>(slot.get()))
+        {
+            for (auto& param : result->m_routine_call->m_parameters)
+            {
+                reduceSlot(param);
+            }
+        }
+    }
+
+    void reduceChain(parsing::Modifiable& modifiable)
+    {
+        for (auto& item : modifiable.m_chain)
+        {
+            if (auto* index = dynamic_cast<parsing::ArrayAccess*>(item.get()))
+            {
+                reduceSlot(index->access);
+            }
+        }
+    }
+
+    /*
+     * The invariant variable `n` of `i * n` or `n * i`, a global may be
+     * assigned by a routine the loop calls.
+    */
+    std::optional<std::string> stepOf(parsing::Expression& expr) const
+    {
+        auto* product = dynamic_cast<parsing::Math*>(&expr);
+        if (!product || product->m_grammar != GrammarUnit::MULTIPLICATE)
+        {
+            return std::nullopt;
+        }
+        auto* left = plainVariable(*product->m_left);
+        auto* right = plainVariable(*product->m_right);
+        if (!left || !right)
+        {
+            return std::nullopt;
+        }
+        if (right->m_head_name == m_loop->m_identifier->m_name)
+        {
+            std::swap(left, right);
+        }
+        if (left->m_head_name != m_loop->m_identifier->m_name || m_variant.contains(right->m_head_name)
+            || !m_locals.contains(right->m_head_name) || right->m_head_name == left->m_head_name)
+        {
+            return std::nullopt;
+        }
+        return right->m_head_name;
+    }
+
+    static parsing::Modifiable* plainVariable(parsing::Expression& expr)
+    {
+        auto* modifiable = dynamic_cast<parsing::Modifiable*>(&expr);
+        return modifiable && modifiable->m_chain.empty() ? modifiable : nullptr;
+    }
+
+    size_t m_next = 1;
+    size_t m_reduced = 0;
+    bool m_marked = false;
+
+    // state of the loop being reduced
+    parsing::For* m_loop = nullptr;
+    std::unordered_set<std::string> m_variant;
+    std::map<std::string, std::string> m_inductions;
+
+    // locals and parameters in scope, only they can't change behind a call
+    std::unordered_set<std::string> m_locals;
+
+    intervals::Environment m_iterators;
+};
@@ -0,0 +1,290 @@
+#pragma once
+
+#include "analyzer/ast-utils.hpp"
+#include "parser/AST-node.hpp"
+#include "parser/body.hpp"
+#include "parser/declaration.hpp"
+#include "parser/expression.hpp"
+#include "parser/return.hpp"
+#include "parser/routine.hpp"
+#include "parser/statement.hpp"
+#include "parser/std-function.hpp"
+#include "parser/visitor/clone-visitor.hpp"
+#include "parser/visitor/recursive-visitor.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace tail_calls
+{
+
+/*
+ *  Whether a node contains `return f(...)`, f being the given routine.
+*/
+struct SelfReturns : public parsing::RecursiveVisitor
+{
+    explicit SelfReturns(std::string routine) : m_routine(std::move(routine))
+    {
+    }
+
+    void visit(parsing::ReturnStatement& node) override
+    {
+        auto* result = dynamic_cast<parsing::RoutineCallResult*>(node.m_expr.get());
+        m_found = m_found || (result && result->m_routine_call->m_routine_name == m_routine);
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    std::string m_routine;
+    bool m_found = false;
+};
+
+} // namespace tail_calls
+
+/*
+ *  Turns self tail calls into a loop.
+ *
+ *  The body is wrapped into `while tre.N loop tre.N := false; ... end`.
+ *  `return f(a, b)` becomes `var tre.M is a; ... p := tre.M; ...;
+ *  tre.N := true`, so the loop runs the body again with the new
+ *  parameters. In a routine without a result a call to itself as its
+ *  very last statement is handled the same way.
+ *
+ *  A tail call in an `if` arm must not fall through to the statements
+ *  after the `if`, so those are moved into the other arm when it does
+ *  not end with a return. Tail calls in loops, or in an `if` with both
+ *  arms falling through, would need a `break` the language doesn't have,
+ *  such routines are left alone. So are routines with array or record
+ *  parameters, which can't be reassigned, and routines declaring a local
+ *  with the name of a parameter.
+*/
+struct EliminateTailRecursion
+{
+    explicit EliminateTailRecursion(std::shared_ptr<parsing::Program> program) : m_types(program)
+    {
+    }
+
+    bool apply(parsing::Routine& routine)
+    {
+        m_routine = &routine;
+        if (!hasTailCall(*routine.m_body))
+        {
+            return false;
+        }
+        auto declared = analysis::declaredNames(*routine.m_body);
+        for (auto& param : routine.m_params)
+        {
+            if (m_types.primitiveName(std::make_shared<parsing::PrimitiveType>(param->m_type)).empty())
+            {
+                m_remarks.push_back("not eliminating tail calls of " + routine.m_name + ": aggregate parameters");
+                return false;
+            }
+            // the new arguments are assigned by name, a local of the same name would get them
+            if (declared.contains(param->m_name))
+            {
+                m_remarks.push_back(
+                    "not eliminating tail calls of " + routine.m_name + ": " + param->m_name + " is redeclared");
+                return false;
+            }
+        }
+
+        m_next = analysis::firstFreeIndex(*routine.m_body, "tre.");
+        m_again = "tre." + std::to_string(m_next++);
+
+        // worked on a copy, the routine stays as it is if any tail call can't be handled
+        auto body = parsing::Cloner().clone(routine.m_body);
+        std::vector<std::shared_ptr<parsing::ASTNode>> transformed;
+        if (!transform(body->m_items, transformed))
+        {
+            m_remarks.push_back("not eliminating tail calls of " + routine.m_name + ": tail call can't jump back");
+            return false;
+        }
+        if (m_eliminated == 0)
+        {
+            return false;
+        }
+
+        auto reset = std::make_shared<parsing::Assignment>();
+        reset->m_modifiable = std::make_shared<parsing::Modifiable>(m_again);
+        reset->m_expression = std::make_shared<parsing::False>();
+        transformed.insert(transformed.begin(), reset);
+
+        auto loop = std::make_shared<parsing::While>();
+        loop->m_condition = std::make_shared<parsing::Modifiable>(m_again);
+        loop->m_body = std::make_shared<parsing::Body>();
+        loop->m_body->m_items = std::move(transformed);
+
+        routine.m_body->m_items = {
+            std::make_shared<parsing::PrimitiveVariable>(
+                m_again, std::make_shared<parsing::PrimitiveType>("boolean"), std::make_shared<parsing::True>()),
+            loop
+        };
+
+        m_remarks.push_back(
+            routine.m_name + ": " + std::to_string(m_eliminated) + " tail call(s) turned into a loop");
+        return true;
+    }
+
+    std::vector<std::string> m_remarks;
+
+private:
+    using Items = std::vector<std::shared_ptr<parsing::ASTNode>>;
+
+    bool isVoid() const
+    {
+        return m_routine->return_type.empty();
+    }
+
+    bool hasTailCall(parsing::ASTNode& node) const
+    {
+        if (isVoid())
+        {
+            auto called = analysis::calledNames(node);
+            return std::find(called.begin(), called.end(), m_routine->m_name) != called.end();
+        }
+        tail_calls::SelfReturns finder(m_routine->m_name);
+        node.accept(finder);
+        return finder.m_found;
+    }
+
+    /*
+     * The self call made by a tail position item, if it is one.
+    */
+    parsing::RoutineCall* selfCall(parsing::ASTNode& item, bool last) const
+    {
+        if (auto* ret = dynamic_cast<parsing::ReturnStatement*>(&item))
+        {
+            auto* result = dynamic_cast<parsing::RoutineCallResult*>(ret->m_expr.get());
+            if (result && result->m_routine_call->m_routine_name == m_routine->m_name)
+            {
+                return result->m_routine_call.get();
+            }
+        }
+        auto* call = dynamic_cast<parsing::RoutineCall*>(&item);
+        if (last && isVoid() && call && !dynamic_cast<parsing::StdFunction*>(call)
+            && call->m_routine_name == m_routine->m_name)
+        {
+            return call;
+        }
+        return nullptr;
+    }
+
+    /*
+     * Rewrites items that end the routine when control falls off them.
+    */
+    bool transform(const Items& items, Items& out)
+    {
+        for (size_t idx = 0; idx < items.size(); ++idx)
+        {
+            auto& item = items[idx];
+            bool last = idx + 1 == items.size();
+
+            if (auto* call = selfCall(*item, last))
+            {
+                jumpBack(*call, out);
+                // whatever follows a return is never run
+                return true;
+            }
+
+            auto* branch = dynamic_cast<parsing::If*>(item.get());
+            bool descend = branch && hasTailCall(*item) && (!isVoid() || last);
+            if (!descend)
+            {
+                // a self return anywhere else would have to leave a loop
+                if (!isVoid() && hasTailCall(*item))
+                {
+                    return false;
+                }
+                out.push_back(item);
+                continue;
+            }
+
+            Items rest(items.begin() + idx + 1, items.end());
+            bool then_returns = endsWithReturn(*branch->m_then);
+            bool else_returns = branch->m_else && endsWithReturn(*branch->m_else);
+            if (!rest.empty() && !then_returns && !else_returns)
+            {
+                return false;
+            }
+
+            Items then_items = branch->m_then->m_items;
+            Items else_items = branch->m_else ? branch->m_else->m_items : Items {};
+            if (!then_returns)
+            {
+                then_items.insert(then_items.end(), rest.begin(), rest.end());
+            }
+            else if (!else_returns)
+            {
+                else_items.insert(else_items.end(), rest.begin(), rest.end());
+            }
+
+            Items new_then;
+            Items new_else;
+            if (!transform(then_items, new_then) || !transform(else_items, new_else))
+            {
+                return false;
+            }
+            branch->m_then->m_items = std::move(new_then);
+            if (!new_else.empty())
+            {
+                branch->m_else = branch->m_else ? branch->m_else : std::make_shared<parsing::Body>();
+                branch->m_else->m_items = std::move(new_else);
+            }
+            out.push_back(item);
+            return true;
+        }
+        return true;
+    }
+
+    static bool endsWithReturn(parsing::Body& body)
+    {
+        if (body.m_items.empty())
+        {
+            return false;
+        }
+        auto& last = body.m_items.back();
+        if (dynamic_cast<parsing::ReturnStatement*>(last.get()))
+        {
+            return true;
+        }
+        auto* branch = dynamic_cast<parsing::If*>(last.get());
+        return branch && branch->m_else && endsWithReturn(*branch->m_then) && endsWithReturn(*branch->m_else);
+    }
+
+    /*
+     * Arguments are all evaluated before any parameter changes,
+     * they may read the parameters.
+    */
+    void jumpBack(parsing::RoutineCall& call, Items& out)
+    {
+        std::vector<std::string> temporaries;
+        for (size_t idx = 0; idx < call.m_parameters.size(); ++idx)
+        {
+            temporaries.push_back("tre." + std::to_string(m_next++));
+            out.push_back(std::make_shared<parsing::PrimitiveVariable>(
+                temporaries.back(),
+                std::make_shared<parsing::PrimitiveType>(m_routine->m_params[idx]->m_type),
+                call.m_parameters[idx]));
+        }
+        for (size_t idx = 0; idx < call.m_parameters.size(); ++idx)
+        {
+            auto assignment = std::make_shared<parsing::Assignment>();
+            assignment->m_modifiable = std::make_shared<parsing::Modifiable>(m_routine->m_params[idx]->m_name);
+            assignment->m_expression = std::make_shared<parsing::Modifiable>(temporaries[idx]);
+            out.push_back(assignment);
+        }
+
+        auto again = std::make_shared<parsing::Assignment>();
+        again->m_modifiable = std::make_shared<parsing::Modifiable>(m_again);
+        again->m_expression = std::make_shared<parsing::True>();
+        out.push_back(again);
+        m_eliminated++;
+    }
+
+    analysis::TypeResolver m_types;
+    parsing::Routine* m_routine = nullptr;
+    std::string m_again;
+    size_t m_next = 1;
+    size_t m_eliminated = 0;
+};
@@ -21,7 +21,12 @@ struct TypeCheck : parsing::IVisitor
     {
     }
 
-    std::vector<std::string> checkErrors()
+    /*
+     *  Builds the global environment: every top-level type (in order)
+     *  and the signatures of all routines. Routine bodies are not
+     *  visited here, see checkErrors(routine).
+    */
+    std::vector<std::string> collectGlobals()
     {
         // what this table is supposed to hold?
         // typename -> object of the type
@@ -31,19 +36,56 @@ struct TypeCheck : parsing::IVisitor
         m_type_table.emplace("boolean", std::make_shared<parsing::PrimitiveType>("boolean"));
         m_type_table.emplace("array", std::make_shared<parsing::PrimitiveType>("array"));
 
+        for (auto& decl : m_ast->m_declarations)
+        {
+            try
+            {
+                if (auto routine = std::dynamic_pointer_cast<parsing::Routine>(decl))
+                {
+                    registerSignature(*routine);
+                    continue;
+                }
+                decl->accept(*this);
+            }
+            catch (const std::exception& err)
+            {
+                // the rest of the environment may depend on this declaration
+                return { "in declaration of " + decl->m_name + ": " + err.what() };
+            }
+        }
+        return {};
+    }
+
+    /*
+     *  Checks a single routine against the global environment.
+     *  Is called on a copy of the instance collectGlobals() was run on.
+    */
+    std::vector<std::string> checkErrors(parsing::Routine& routine)
+    {
         try
         {
-            m_ast->accept(*this);
+            routine.accept(*this);
         }
         catch (const std::exception& err)
         {
-            throw;
-            return { err.what() };
+            return { "in routine " + routine.m_name + ": " + err.what() };
         }
-        std::cout << "TypeCheck reports no errors.\n";
         return {};
     }
 
+    void registerSignature(parsing::Routine& node)
+    {
+        for (auto& param : node.m_params)
+        {
+            param->accept(*this);
+        }
+        if (!node.return_type.empty() && !m_type_table.contains(node.return_type))
+        {
+            throw std::runtime_error("function returns an unknown type: " + node.return_type);
+        }
+        m_var_table.insert({ node.m_name, std::make_shared<parsing::Routine>(node) });
+    }
+
     void visit(parsing::ASTNode& node) override
     {
         // this enables double-dispatching in our code.
@@ -86,11 +128,35 @@ struct TypeCheck : parsing::IVisitor
         {
             throw std::runtime_error("Unknown type: " + node.m_type->m_name);
         }
-        if (!node.m_size->isConst()) {
+        if (!isConstantSize(*node.m_size)) {
             throw std::runtime_error("Arrays can be of constant size only");
         }
     }
 
+    /*
+     *  Constant expressions, calls with constant arguments included:
+     *  EvaluateCalls replaces those by their result before generation.
+    */
+    static bool isConstantSize(parsing::Expression& size)
+    {
+        if (auto* result = dynamic_cast<parsing::RoutineCallResult*>(&size))
+        {
+            for (auto& param : result->m_routine_call->m_parameters)
+            {
+                if (!isConstantSize(*param))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+        if (auto* math = dynamic_cast<parsing::Math*>(&size))
+        {
+            return isConstantSize(*math->m_left) && isConstantSize(*math->m_right);
+        }
+        return size.isConst();
+    }
+
     void visit(parsing::Variable& node) override {
 
     }
@@ -291,6 +357,10 @@ struct TypeCheck : parsing::IVisitor
 
     void visit(parsing::ReturnStatement& node) override
     {
+        if (!m_current_return_type)
+        {
+            throw std::runtime_error("return from a routine that does not return a value");
+        }
         node.m_expr->accept(*this);
         auto type = node.m_expr->deduceType(m_var_table, m_type_table);
         if (*type != *m_current_return_type) {
@@ -0,0 +1,277 @@
+#pragma once
+
+#include "analyzer/ast-utils.hpp"
+#include "analyzer/strategies/inline-routines.hpp"
+#include "parser/AST-node.hpp"
+#include "parser/body.hpp"
+#include "parser/expression.hpp"
+#include "parser/routine.hpp"
+#include "parser/statement.hpp"
+#include "parser/visitor/clone-visitor.hpp"
+#include "parser/visitor/recursive-visitor.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+/*
+ *  Loop unswitching.
+ *
+ *  An `if` in a loop body whose condition reads nothing the loop assigns
+ *  or declares is decided once: the loop becomes
+ *  `if c then <loop with the then arm> else <loop with the else arm> end`.
+ *  Each copy runs without the test, which leaves straight-line bodies for
+ *  the if-conversion and the vectorizer.
+ *
+ *  The condition is evaluated even when the loop runs zero times, so it
+ *  has to be speculatable, see analysis::isSpeculatable. Inner loops are
+ *  unswitched first. Every unswitching doubles a loop, so only loops up to
+ *  m_max_loop_size nodes are copied, and not once the routine has grown
+ *  past m_max_routine_size nodes.
+*/
+struct UnswitchLoops
+{
+    explicit UnswitchLoops(std::shared_ptr<parsing::Program>)
+    {
+    }
+
+    bool apply(parsing::Routine& routine)
+    {
+        m_routine = &routine;
+        m_routine_size = inlining::shapeOf(*routine.m_body).m_size;
+        processBody(*routine.m_body);
+
+        if (m_unswitched != 0)
+        {
+            m_remarks.push_back(routine.m_name + ": unswitched " + std::to_string(m_unswitched) + " loop(s)");
+        }
+        return m_unswitched != 0;
+    }
+
+    size_t m_max_loop_size = 80;
+    size_t m_max_routine_size = 600;
+
+    std::vector<std::string> m_remarks;
+
+private:
+    /*
+     * Where an invariant `if` sits: the body holding it and its position.
+    */
+    struct Position
+    {
+        parsing::Body* m_body = nullptr;
+        size_t m_index = 0;
+    };
+
+    void processBody(parsing::Body& body)
+    {
+        for (auto& item : body.m_items)
+        {
+            if (auto* loop = dynamic_cast<parsing::For*>(item.get()))
+            {
+                processBody(*loop->m_body);
+                unswitch(item);
+            }
+            else if (auto* loop = dynamic_cast<parsing::While*>(item.get()))
+            {
+                processBody(*loop->m_body);
+                unswitch(item);
+            }
+            else if (auto* branch = dynamic_cast<parsing::If*>(item.get()))
+            {
+                processBody(*branch->m_then);
+                if (branch->m_else)
+                {
+                    processBody(*branch->m_else);
+                }
+            }
+            else if (auto* nested = dynamic_cast<parsing::Body*>(item.get()))
+            {
+                processBody(*nested);
+            }
+        }
+    }
+
+    void unswitch(std::shared_ptr<parsing::ASTNode>& loop)
+    {
+        auto variant = variantNames(*loop);
+        auto found = findBranch(bodyOf(*loop), variant, isFor(*loop));
+        if (!found.m_body)
+        {
+            return;
+        }
+
+        inlining::BodyShape shape;
+        loop->accept(shape);
+        if (shape.m_size > m_max_loop_size || m_routine_size + shape.m_size > m_max_routine_size)
+        {
+            std::string remark = "not unswitching a loop of " + m_routine->m_name + ": too large";
+            if (std::find(m_remarks.begin(), m_remarks.end(), remark) == m_remarks.end())
+            {
+                m_remarks.push_back(remark);
+            }
+            return;
+        }
+
+        auto& branch = static_cast<parsing::If&>(*found.m_body->m_items[found.m_index]);
+        auto guard = std::make_shared<parsing::If>();
+        guard->m_condition = parsing::Cloner().clone(branch.m_condition);
+        guard->m_then = std::make_shared<parsing::Body>();
+        guard->m_then->m_items.push_back(specialize(loop, variant, true));
+        guard->m_else = std::make_shared<parsing::Body>();
+        guard->m_else->m_items.push_back(specialize(loop, variant, false));
+
+        loop = guard;
+        m_routine_size += shape.m_size;
+        m_unswitched++;
+    }
+
+    /*
+     * A copy of the loop keeping only one arm of its invariant `if`.
+     * The copy is searched again, it has the same shape as the original.
+    */
+    static std::shared_ptr<parsing::ASTNode> specialize(
+        const std::shared_ptr<parsing::ASTNode>& loop, const std::unordered_set<std::string>& variant, bool taken)
+    {
+        std::shared_ptr<parsing::ASTNode> copy;
+        if (auto for_loop = std::dynamic_pointer_cast<parsing::For>(loop))
+        {
+            copy = parsing::Cloner().clone(for_loop);
+        }
+        else
+        {
+            copy = parsing::Cloner().clone(std::static_pointer_cast<parsing::While>(loop));
+        }
+
+        auto found = findBranch(bodyOf(*copy), variant, isFor(*copy));
+        auto& items = found.m_body->m_items;
+        auto arm = taken ? static_cast<parsing::If&>(*items[found.m_index]).m_then
+                         : static_cast<parsing::If&>(*items[found.m_index]).m_else;
+        items.erase(items.begin() + found.m_index);
+        if (!arm)
+        {
+            return copy;
+        }
+
+        // locals of the arm keep a scope of their own
+        if (analysis::declaredNames(*arm).empty())
+        {
+            items.insert(items.begin() + found.m_index, arm->m_items.begin(), arm->m_items.end());
+        }
+        else
+        {
+            items.insert(items.begin() + found.m_index, arm);
+        }
+        return copy;
+    }
+
+    /*
+     * The first `if` with an invariant condition, nested loops are left
+     * to be unswitched on their own.
+     *
+     * An array read proven in bounds may rely on the condition of an
+     * enclosing `if` or `while`, it is only taken out of a `for` body
+     * when it is not nested in another `if`.
+    */
+    static Position findBranch(
+        parsing::Body& body, const std::unordered_set<std::string>& variant, bool arrays_allowed)
+    {
+        for (size_t idx = 0; idx < body.m_items.size(); ++idx)
+        {
+            auto* item = body.m_items[idx].get();
+            if (auto* branch = dynamic_cast<parsing::If*>(item))
+            {
+                if (isInvariant(*branch->m_condition, variant, arrays_allowed))
+                {
+                    return { &body, idx };
+                }
+                auto found = findBranch(*branch->m_then, variant, false);
+                if (!found.m_body && branch->m_else)
+                {
+                    found = findBranch(*branch->m_else, variant, false);
+                }
+                if (found.m_body)
+                {
+                    return found;
+                }
+            }
+            else if (auto* nested = dynamic_cast<parsing::Body*>(item))
+            {
+                auto found = findBranch(*nested, variant, arrays_allowed);
+                if (found.m_body)
+                {
+                    return found;
+                }
+            }
+        }
+        return {};
+    }
+
+    static bool isInvariant(
+        parsing::Expression& condition, const std::unordered_set<std::string>& variant, bool arrays_allowed)
+    {
+        auto used = analysis::usedNames(condition);
+        if (used.empty() || !analysis::isSpeculatable(condition) || (!arrays_allowed && readsArrays(condition)))
+        {
+            return false;
+        }
+        for (auto& name : used)
+        {
+            if (variant.contains(name))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static std::unordered_set<std::string> variantNames(parsing::ASTNode& loop)
+    {
+        auto& body = bodyOf(loop);
+        auto variant = analysis::assignedNames(body);
+        auto declared = analysis::declaredNames(body);
+        variant.insert(declared.begin(), declared.end());
+        if (auto* for_loop = dynamic_cast<parsing::For*>(&loop))
+        {
+            variant.insert(for_loop->m_identifier->m_name);
+        }
+        return variant;
+    }
+
+    static bool readsArrays(parsing::Expression& condition)
+    {
+        struct ArrayReads : public parsing::RecursiveVisitor
+        {
+            void visit(parsing::ArrayAccess& node) override
+            {
+                m_found = true;
+                parsing::RecursiveVisitor::visit(node);
+            }
+
+            bool m_found = false;
+        } reads;
+        condition.accept(reads);
+        return reads.m_found;
+    }
+
+    static bool isFor(parsing::ASTNode& loop)
+    {
+        return dynamic_cast<parsing::For*>(&loop) != nullptr;
+    }
+
+    static parsing::Body& bodyOf(parsing::ASTNode& loop)
+    {
+        if (auto* for_loop = dynamic_cast<parsing::For*>(&loop))
+        {
+            return *for_loop->m_body;
+        }
+        return *static_cast<parsing::While&>(loop).m_body;
+    }
+
+    parsing::Routine* m_routine = nullptr;
+    size_t m_routine_size = 0;
+    size_t m_unswitched = 0;
+};
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/*
+ *  A fixed set of workers pulling tasks from a shared queue.
+ *
+ *  Used to run independent pieces of work (e.g. per-routine
+ *  checks and optimisations) concurrently. Results are handed
+ *  back through futures, so the caller decides the order in
+ *  which they are observed.
+*/
+class ThreadPool
+{
+public:
+    explicit ThreadPool(size_t threads = 0)
+    {
+        if (threads == 0)
+        {
+            threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+        }
+        m_workers.reserve(threads);
+        for (size_t idx = 0; idx < threads; ++idx)
+        {
+            m_workers.emplace_back([this] { work(); });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopped = true;
+        }
+        m_wakeup.notify_all();
+        for (auto& worker : m_workers)
+        {
+            worker.join();
+        }
+    }
+
+    size_t size() const
+    {
+        return m_workers.size();
+    }
+
+    template <typename Task>
+    auto submit(Task&& task) -> std::future<std::invoke_result_t<Task>>
+    {
+        using Result = std::invoke_result_t<Task>;
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<Task>(task));
+        auto result = packaged->get_future();
+        {
+            std::lock_guard lock(m_mutex);
+            m_tasks.emplace([packaged] { (*packaged)(); });
+        }
+        m_wakeup.notify_one();
+        return result;
+    }
+
+    /*
+     *  Calls fn(idx) for every idx in [0, count) and blocks until all
+     *  of them are done. Indices are handed out dynamically, so a few
+     *  heavy items do not stall a whole chunk of light ones.
+     *  The first exception (by index) is rethrown to the caller.
+    */
+    template <typename Fn>
+    void forEach(size_t count, Fn&& fn)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+
+        auto next = std::make_shared<std::atomic<size_t>>(0);
+        std::vector<std::exception_ptr> failures(count);
+
+        size_t jobs = std::min(count, m_workers.size());
+        std::vector<std::future<void>> running;
+        running.reserve(jobs);
+        for (size_t job = 0; job < jobs; ++job)
+        {
+            running.push_back(submit(
+                [&fn, &failures, next, count]
+                {
+                    for (size_t idx = (*next)++; idx < count; idx = (*next)++)
+                    {
+                        try
+                        {
+                            fn(idx);
+                        }
+                        catch (...)
+                        {
+                            failures[idx] = std::current_exception();
+                        }
+                    }
+                }));
+        }
+        for (auto& job : running)
+        {
+            job.get();
+        }
+
+        for (auto& failure : failures)
+        {
+            if (failure)
+            {
+                std::rethrow_exception(failure);
+            }
+        }
+    }
+
+private:
+    void work()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(m_mutex);
+                m_wakeup.wait(lock, [this] { return m_stopped || !m_tasks.empty(); });
+                if (m_stopped && m_tasks.empty())
+                {
+                    return;
+                }
+                task = std::move(m_tasks.front());
+                m_tasks.pop();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> m_workers;
+    std::queue<std::function<void()>> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_wakeup;
+    bool m_stopped = false;
+};
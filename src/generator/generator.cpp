@@ -1,12 +1,30 @@
 #include "generator.hpp"
+#include "tiered-jit.hpp"
 
+#include "analyzer/ast-utils.hpp"
 #include "parser/visitor/abstract-visitor.hpp"
+#include "parser/visitor/recursive-visitor.hpp"
 #include "parser/statement.hpp"
 #include "parser/return.hpp"
 #include "parser/std-function.hpp"
 #include "llvm/Analysis/StackSafetyAnalysis.h"
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/Intrinsics.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/TargetSelect.h>
 #include <llvm-14/llvm/IR/Function.h>
 
+#include <algorithm>
+#include <mutex>
+#include <optional>
 #include <vector>
 
 namespace generator {
@@ -22,8 +40,87 @@ std::string get_array_typename(const std::string& inner_type, int size) {
     return "array_" + inner_type + "_" + std::to_string(size);
 }
 
+llvm::AllocaInst* Generator::createEntryAlloca(llvm::Type* type, const std::string& name) {
+    // allocas outside of the entry block would grow the stack on every loop iteration
+    llvm::BasicBlock& entry = current_function->getEntryBlock();
+    llvm::IRBuilder<> entry_builder(&entry, entry.begin());
+    return entry_builder.CreateAlloca(type, nullptr, name);
+}
+
+/*
+ * Arrays and records larger than two registers are passed and returned
+ * through pointers. Smaller ones stay first-class values, which the calling
+ * conventions split into registers.
+*/
+bool Generator::passedByReference(llvm::Type* type) {
+    return type->isAggregateType() && module->getDataLayout().getTypeAllocSize(type) > 16;
+}
+
+// an argument passed by reference: the variable itself, or a temporary for any other value
+llvm::Value* Generator::emitAddress(parsing::Expression& node, llvm::Type* type) {
+    auto* modifiable = dynamic_cast<parsing::Modifiable*>(&node);
+    if (modifiable && !m_scalar_table.contains(modifiable->m_head_name)) {
+        is_lvalue = true;
+        modifiable->accept(*this);
+        is_lvalue = false;
+        return current_lvalue;
+    }
+
+    is_lvalue = false;
+    node.accept(*this);
+    llvm::Value* temporary = acquireSlot(type, "argument");
+    builder.CreateStore(current_expression, temporary);
+    return temporary;
+}
+
+llvm::Value* Generator::acquireSlot(llvm::Type* type, const std::string& name) {
+    uint64_t size = module->getDataLayout().getTypeAllocSize(type).getFixedSize();
+    llvm::Value* slot = nullptr;
+    auto& free_slots = m_free_slots[type];
+    if (!free_slots.empty()) {
+        slot = free_slots.back();
+        free_slots.pop_back();
+    } else if (size <= m_options.m_stack_limit) {
+        slot = createEntryAlloca(type, name);
+    } else if (!m_recursive.contains(current_function->getName().str())) {
+        slot = new llvm::GlobalVariable(*module, type, false, llvm::GlobalValue::InternalLinkage,
+            llvm::ConstantAggregateZero::get(type), current_function->getName() + "." + name);
+    } else {
+        auto allocate = module->getOrInsertFunction("calloc", builder.getInt8PtrTy(), builder.getInt64Ty(), builder.getInt64Ty());
+        auto* memory = builder.CreateCall(allocate, { builder.getInt64(1), builder.getInt64(size) });
+        slot = builder.CreateBitCast(memory, type->getPointerTo(), name);
+        m_heap_slots.push_back(slot);
+    }
+
+    if (llvm::isa<llvm::AllocaInst>(slot)) {
+        builder.CreateLifetimeStart(slot, builder.getInt64(size));
+    }
+    m_scope_slots.push_back(slot);
+    return slot;
+}
+
+void Generator::releaseSlots(const std::vector<llvm::Value*>& slots) {
+    for (auto* slot : slots) {
+        auto* type = slot->getType()->getPointerElementType();
+        if (llvm::isa<llvm::AllocaInst>(slot)) {
+            auto size = module->getDataLayout().getTypeAllocSize(type);
+            builder.CreateLifetimeEnd(slot, builder.getInt64(size.getFixedSize()));
+        } else if (!llvm::isa<llvm::GlobalVariable>(slot)) {
+            emitFree(slot);
+            m_heap_slots.erase(std::find(m_heap_slots.begin(), m_heap_slots.end(), slot));
+            continue;
+        }
+        m_free_slots[type].push_back(slot);
+    }
+}
+
+void Generator::emitFree(llvm::Value* slot) {
+    auto release = module->getOrInsertFunction("free", builder.getVoidTy(), builder.getInt8PtrTy());
+    builder.CreateCall(release, { builder.CreateBitCast(slot, builder.getInt8PtrTy()) });
+}
+
 void Generator::gen_expr_fork(parsing::Math& node, llvm::Value*& left, llvm::Value*& right) {
-    std::cout << "Generating expression for " << node.gr_to_str() << "...\n";
+    listing() << "Generating expression for " << node.gr_to_str() << "...\n";
 
     is_lvalue = false;
     node.m_left->accept(*this);
@@ -39,27 +136,240 @@ void Generator::apply() {
     m_type_table.emplace("real", llvm::Type::getDoubleTy(context));
     m_type_table.emplace("boolean", llvm::Type::getInt1Ty(context));
 
+    // the data layout has to be known before any code is generated for the target
+    if (m_options.m_emit != Options::Emit::IR || !m_options.m_triple.empty()) {
+        selectTarget();
+    }
+    m_recursive = analysis::CallGraph(*m_tree).recursive();
+
     m_tree->accept(*this);
 
-    std::cout << "\n";
+    // a broken module would crash the optimizer, or worse, be miscompiled
+    if (llvm::verifyModule(*module, &llvm::errs())) {
+        throw std::runtime_error("Generated module is broken");
+    }
+    optimize();
+
+    if (m_options.m_emit == Options::Emit::MEMORY) {
+        return;
+    }
+
+    listing() << "\n";
 
     module->print(llvm::outs(), nullptr);
 
+    if (writeModule(*module, m_options, m_target_machine.get())) {
+        llvm::outs() << describe(m_options.m_emit) << " written to " << m_options.m_output << "\n";
+    }
+}
+
+void Generator::selectTarget() {
+    m_target_machine = createTargetMachine(m_options);
+    module->setTargetTriple(m_target_machine->getTargetTriple().str());
+    module->setDataLayout(m_target_machine->createDataLayout());
+}
+
+void initializeNativeTarget() {
+    // registering a target is not thread safe, and modules may be generated concurrently
+    static std::once_flag once;
+    std::call_once(once, []() {
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+    });
+}
+
+std::unique_ptr<llvm::TargetMachine> createTargetMachine(const Options& options) {
+    initializeNativeTarget();
+
+    std::string triple = options.m_triple.empty() ? llvm::sys::getDefaultTargetTriple() : options.m_triple;
+    std::string error;
+    const llvm::Target* target = llvm::TargetRegistry::lookupTarget(triple, error);
+    if (!target) {
+        throw std::runtime_error("Unknown target " + triple + ": " + error);
+    }
+
+    llvm::CodeGenOpt::Level level = llvm::CodeGenOpt::Default;
+    switch (options.m_level) {
+    case Options::Level::O0:
+        level = llvm::CodeGenOpt::None;
+        break;
+    case Options::Level::O1:
+        level = llvm::CodeGenOpt::Less;
+        break;
+    case Options::Level::O3:
+        level = llvm::CodeGenOpt::Aggressive;
+        break;
+    default:
+        break;
+    }
+
+    // position independent, the system linker makes PIE executables by default
+    return std::unique_ptr<llvm::TargetMachine>(target->createTargetMachine(
+        triple, "generic", "", llvm::TargetOptions(), llvm::Reloc::PIC_, llvm::None, level));
+}
+
+bool writeModule(llvm::Module& module, const Options& options, llvm::TargetMachine* target_machine) {
     std::error_code EC;
-    llvm::raw_fd_ostream fileStream("output.ll", EC);
+    llvm::raw_fd_ostream fileStream(options.m_output, EC, llvm::sys::fs::OF_None);
 
     if (EC) {
         llvm::errs() << "Error opening file: " << EC.message() << "\n";
+        return false;
+    }
+
+    if (options.m_emit == Options::Emit::IR) {
+        module.print(fileStream, nullptr);
+        return true;
+    }
+
+    auto file_type = options.m_emit == Options::Emit::ASSEMBLY ? llvm::CGFT_AssemblyFile : llvm::CGFT_ObjectFile;
+    // code generation still runs on the legacy pass manager
+    llvm::legacy::PassManager passes;
+    if (target_machine->addPassesToEmitFile(passes, fileStream, nullptr, file_type)) {
+        throw std::runtime_error("Target " + module.getTargetTriple() + " can not emit this file type");
+    }
+    passes.run(module);
+    return true;
+}
+
+std::string describe(Options::Emit emit) {
+    switch (emit) {
+    case Options::Emit::ASSEMBLY:
+        return "Assembly";
+    case Options::Emit::OBJECT:
+        return "Object code";
+    default:
+        return "LLVM IR";
+    }
+}
+
+void Generator::optimize() {
+    // the tiered JIT optimises routines itself once they turn out to be hot
+    if (m_options.m_level == Options::Level::O0 || m_options.m_tiered) {
         return;
     }
+    runPipeline(*module, m_options.m_level, m_target_machine.get());
+}
+
+std::ostream& Generator::listing() {
+    return *m_options.m_listing;
+}
 
-    module->print(fileStream, nullptr);
-    fileStream.close();
+void runPipeline(llvm::Module& module, Options::Level level, llvm::TargetMachine* target_machine) {
+    llvm::LoopAnalysisManager loop_analyses;
+    llvm::FunctionAnalysisManager function_analyses;
+    llvm::CGSCCAnalysisManager cgscc_analyses;
+    llvm::ModuleAnalysisManager module_analyses;
+
+    // with a target machine the cost models know the real instructions
+    llvm::PassBuilder pass_builder(target_machine);
+    pass_builder.registerModuleAnalyses(module_analyses);
+    pass_builder.registerCGSCCAnalyses(cgscc_analyses);
+    pass_builder.registerFunctionAnalyses(function_analyses);
+    pass_builder.registerLoopAnalyses(loop_analyses);
+    pass_builder.crossRegisterProxies(loop_analyses, function_analyses, cgscc_analyses, module_analyses);
+
+    llvm::OptimizationLevel pipeline = llvm::OptimizationLevel::O2;
+    switch (level) {
+    case Options::Level::O1:
+        pipeline = llvm::OptimizationLevel::O1;
+        break;
+    case Options::Level::O3:
+        pipeline = llvm::OptimizationLevel::O3;
+        break;
+    case Options::Level::Os:
+        pipeline = llvm::OptimizationLevel::Os;
+        break;
+    default:
+        // O2, and O0: the callers never ask for an O0 pipeline, see the declaration
+        break;
+    }
 
-    llvm::outs() << "LLVM IR written to output.ll\n";
+    auto passes = pass_builder.buildPerModuleDefaultPipeline(pipeline);
+    passes.run(module, module_analyses);
+}
+
+int Generator::run() {
+    if (m_options.m_tiered) {
+        return TieredJit(std::move(module), std::move(m_context), m_options).run();
+    }
+
+    auto jit = llvm::orc::LLJITBuilder().create();
+    if (!jit) {
+        throw std::runtime_error("Cannot create the JIT: " + llvm::toString(jit.takeError()));
+    }
+
+    // printf and the rest of the C library are taken from this process
+    auto host_symbols = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+        (*jit)->getDataLayout().getGlobalPrefix());
+    if (!host_symbols) {
+        throw std::runtime_error("Cannot load host symbols: " + llvm::toString(host_symbols.takeError()));
+    }
+    (*jit)->getMainJITDylib().addGenerator(std::move(*host_symbols));
+
+    llvm::Function* main_function = module->getFunction("main");
+    if (!main_function) {
+        throw std::runtime_error("There is no main routine to run");
+    }
+    bool has_status = main_function->getReturnType()->isIntegerTy(32);
+
+    // the JIT owns the module and its context from now on, the generator is done with them
+    llvm::orc::ThreadSafeModule jit_module(std::move(module), llvm::orc::ThreadSafeContext(std::move(m_context)));
+    if (auto error = (*jit)->addIRModule(std::move(jit_module))) {
+        throw std::runtime_error("Cannot add the module to the JIT: " + llvm::toString(std::move(error)));
+    }
+
+    auto entry = (*jit)->lookup("main");
+    if (!entry) {
+        throw std::runtime_error("Cannot compile main: " + llvm::toString(entry.takeError()));
+    }
+
+    if (has_status) {
+        return llvm::jitTargetAddressToFunction<int (*)()>(entry->getAddress())();
+    }
+    llvm::jitTargetAddressToFunction<void (*)()>(entry->getAddress())();
+    return 0;
+}
+
+void Generator::emitSelect(parsing::If& node) {
+    // the if-conversion made sure both arms are a single assignment
+    // to the same variable and can be evaluated whatever the condition is
+    auto& then_arm = static_cast<parsing::Assignment&>(*node.m_then->m_items.front());
+
+    is_lvalue = false;
+    node.m_condition->accept(*this);
+    llvm::Value* cond = current_expression;
+
+    then_arm.m_expression->accept(*this);
+    llvm::Value* then_value = current_expression;
+
+    // without else the variable keeps its value
+    if (node.m_else) {
+        static_cast<parsing::Assignment&>(*node.m_else->m_items.front()).m_expression->accept(*this);
+    } else {
+        then_arm.m_modifiable->accept(*this);
+    }
+    llvm::Value* else_value = current_expression;
+
+    llvm::Value* selected = builder.CreateSelect(cond, then_value, else_value, "selecttmp");
+    if (assignScalar(*then_arm.m_modifiable, selected)) {
+        return;
+    }
+
+    is_lvalue = true;
+    then_arm.m_modifiable->accept(*this);
+    is_lvalue = false;
+
+    builder.CreateStore(selected, current_lvalue);
 }
 
 void Generator::visit(parsing::If& node) {
+    if (node.m_branchless) {
+        listing() << "Generating select for if statement...\n";
+        emitSelect(node);
+        return;
+    }
+
     // Go the parent function (last point) inside CFG
     llvm::Function* parent_func = builder.GetInsertBlock()->getParent();
 
@@ -78,6 +388,7 @@ void Generator::visit(parsing::If& node) {
         // the if statement
         builder.CreateCondBr(cond, thenBB, skipBB);
     }
+    sealBlock(thenBB);
 
     // generating THEN part
     builder.SetInsertPoint(thenBB);
@@ -86,12 +397,14 @@ void Generator::visit(parsing::If& node) {
 
     if (node.m_else) {
         // else is generated only in case it exists
+        sealBlock(elseBB);
         parent_func->getBasicBlockList().push_back(elseBB);
         builder.SetInsertPoint(elseBB);
         node.m_else->accept(*this);
         builder.CreateBr(skipBB);
     }
 
+    sealBlock(skipBB);
     parent_func->getBasicBlockList().push_back(skipBB);
     builder.SetInsertPoint(skipBB);
 }
@@ -103,7 +416,7 @@ void Generator::visit(parsing::Declaration& node) {}
 void Generator::visit(parsing::Type& node) {}
 
 void Generator::visit(parsing::RecordType& node) {
-    std::cout << "Generating a record " << node.m_name << "...\n";
+    listing() << "Generating a record " << node.m_name << "...\n";
 
     m_ast_decl_table[node.m_name] = std::make_shared<parsing::RecordType>(node);
 
@@ -130,7 +443,7 @@ void Generator::visit(parsing::ArrayType& node) {
     //     return;
     // }
 
-    std::cout << "Generating array type with inner type: " << inner_type_str << "...\n";
+    listing() << "Generating array type with inner type: " << inner_type_str << "...\n";
 
     m_ast_decl_table[node.m_name] = std::make_shared<parsing::ArrayType>(node);
 
@@ -149,6 +462,10 @@ void Generator::visit(parsing::ArrayType& node) {
     //     ptr = llvm::PointerType::getUnqual(inner_type);
     // }
 
+    // EvaluateCalls replaces the calls in a size by their result, unless it can't evaluate them
+    if (!analysis::calledNames(*node.m_size).empty()) {
+        throw std::runtime_error("Array size could not be evaluated at compile time");
+    }
     node.m_size->accept(*this);
     auto *array_size = llvm::dyn_cast<llvm::ConstantInt>(current_expression);
     if (!array_size) {
@@ -157,7 +474,11 @@ void Generator::visit(parsing::ArrayType& node) {
 
     llvm::ArrayType* array_type = llvm::ArrayType::get(inner_type, array_size->getZExtValue());
 
-    node.m_generated_size = array_size->getZExtValue();
+    // global types are shared by the generators of all the partitions, only the first one writes
+    int generated_size = static_cast<int>(array_size->getZExtValue());
+    if (node.m_generated_size != generated_size) {
+        node.m_generated_size = generated_size;
+    }
 
     m_type_table.emplace(get_array_typename(inner_type_str, array_size->getZExtValue()), array_type);
 }
@@ -165,7 +486,7 @@ void Generator::visit(parsing::ArrayType& node) {
 void Generator::visit(parsing::Variable& node) {}
 
 void Generator::visit(parsing::ArrayVariable& node) {
-    std::cout << "Generating array var...\n";
+    listing() << "Generating array var...\n";
 
     m_ast_decl_table[node.m_name] = node.m_type;
 
@@ -174,61 +495,357 @@ void Generator::visit(parsing::ArrayVariable& node) {
     auto *element_type = typenameToType(node.m_type->m_type->m_name);
     auto *array_type = m_type_table[get_array_typename(node.m_type->m_type->m_name, node.m_type->m_generated_size)];
 
-    llvm::AllocaInst* arr_var = builder.CreateAlloca(array_type, nullptr, node.m_name);
+    llvm::Value* arr_var = acquireSlot(array_type, node.m_name);
     m_var_table[node.m_name] = arr_var;
+    m_scalar_table.erase(node.m_name);
 }
 
 void Generator::visit(parsing::PrimitiveVariable& node) {
     // this is never an array, arrays get dispathed into ArrayVariable visit method
-    std::cout << "Generating non-array variable " << node.m_name << " of type: " << node.m_type->m_name << "...\n";
+    listing() << "Generating non-array variable " << node.m_name << " of type: " << node.m_type->m_name << "...\n";
 
     m_ast_decl_table[node.m_name] = node.m_type;
 
-    llvm::AllocaInst *var = builder.CreateAlloca(typenameToType(node.m_type->m_name), nullptr, node.m_name);
+    llvm::Type* type = typenameToType(node.m_type->m_name);
+    if (type->isIntegerTy() || type->isDoubleTy()) {
+        // a fresh value each time the declaration runs, also in a loop
+        llvm::Value* value = llvm::UndefValue::get(type);
+        if (node.m_value) {
+            node.m_value->accept(*this);
+            value = current_expression;
+        }
+        writeScalar(declareScalar(node.m_name, type), builder.GetInsertBlock(), value);
+        return;
+    }
+
+    llvm::Value *var = acquireSlot(type, node.m_name);
 
     if (node.m_value) {
         node.m_value->accept(*this);
         builder.CreateStore(current_expression, var);
     }
     m_var_table[node.m_name] = var;
+    m_scalar_table.erase(node.m_name);
 
     if (m_records_table.contains(node.m_type->m_name)) {
-        std::cout << node.m_name << " -> " << node.m_type->m_name << "\n";
+        listing() << node.m_name << " -> " << node.m_type->m_name << "\n";
         m_recordnames_table[node.m_name] = node.m_type->m_name;
     }
 }
 
 void Generator::visit(parsing::Body& node) {
     auto outer_scope = m_var_table;
+    auto outer_scalars = m_scalar_table;
+    auto outer_slots = std::move(m_scope_slots);
+    m_scope_slots.clear();
     for(const auto& stmt : node.m_items) {
         stmt->accept(*this);
     }
+
+    releaseSlots(m_scope_slots);
+    m_scope_slots = std::move(outer_slots);
     m_var_table = std::move(outer_scope);
+    m_scalar_table = std::move(outer_scalars);
 }
 
-void Generator::visit(parsing::Routine& node) {
-    // Generate types of arguments
-    std::cout << "\nGenerating routine " << node.m_name << "...\n\n";
+size_t Generator::declareScalar(const std::string& name, llvm::Type* type) {
+    m_scalars.emplace_back(name, type);
+    m_scalar_table[name] = m_scalars.size() - 1;
+    m_var_table.erase(name);
+    return m_scalars.size() - 1;
+}
+
+bool Generator::assignScalar(parsing::Modifiable& target, llvm::Value* value) {
+    auto found = m_scalar_table.find(target.m_head_name);
+    if (!target.m_chain.empty() || found == m_scalar_table.end()) {
+        return false;
+    }
+    writeScalar(found->second, builder.GetInsertBlock(), value);
+    return true;
+}
+
+void Generator::writeScalar(size_t scalar, llvm::BasicBlock* block, llvm::Value* value) {
+    m_definitions[block][scalar] = value;
+}
+
+llvm::Value* Generator::readScalar(size_t scalar, llvm::BasicBlock* block) {
+    auto& definitions = m_definitions[block];
+    auto found = definitions.find(scalar);
+    if (found != definitions.end()) {
+        return found->second;
+    }
+    return readScalarRecursive(scalar, block);
+}
+
+llvm::Value* Generator::readScalarRecursive(size_t scalar, llvm::BasicBlock* block) {
+    auto& [name, type] = m_scalars[scalar];
+    llvm::Value* value = nullptr;
+    if (!m_sealed.contains(block)) {
+        // more predecessors are to come, the operands are added when the block is sealed
+        auto* phi = llvm::IRBuilder<>(block, block->begin()).CreatePHI(type, 2, name);
+        m_incomplete_phis[block].emplace_back(scalar, phi);
+        value = phi;
+    } else if (llvm::pred_empty(block)) {
+        // dead code, or a read before the first assignment
+        value = llvm::UndefValue::get(type);
+    } else if (auto* predecessor = block->getSinglePredecessor()) {
+        value = readScalar(scalar, predecessor);
+    } else {
+        auto* phi = llvm::IRBuilder<>(block, block->begin()).CreatePHI(type, 2, name);
+        // a loop leads back here, the phi is the value until its operands say otherwise
+        writeScalar(scalar, block, phi);
+        value = addPhiOperands(scalar, phi);
+    }
+    writeScalar(scalar, block, value);
+    return value;
+}
+
+llvm::Value* Generator::addPhiOperands(size_t scalar, llvm::PHINode* phi) {
+    std::vector<llvm::BasicBlock*> predecessors(llvm::pred_begin(phi->getParent()), llvm::pred_end(phi->getParent()));
+    for (auto* predecessor : predecessors) {
+        phi->addIncoming(readScalar(scalar, predecessor), predecessor);
+    }
+    return tryRemoveTrivialPhi(phi);
+}
+
+llvm::Value* Generator::tryRemoveTrivialPhi(llvm::PHINode* phi) {
+    llvm::Value* same = nullptr;
+    for (llvm::Value* operand : phi->incoming_values()) {
+        if (operand == same || operand == phi) {
+            continue;
+        }
+        if (same) {
+            return phi;
+        }
+        same = operand;
+    }
+    if (!same) {
+        same = llvm::UndefValue::get(phi->getType());
+    }
+
+    // the phis using this one may turn trivial as well
+    std::vector<llvm::WeakVH> users;
+    for (auto* user : phi->users()) {
+        if (user != phi && llvm::isa<llvm::PHINode>(user)) {
+            users.emplace_back(user);
+        }
+    }
+    phi->replaceAllUsesWith(same);
+    phi->eraseFromParent();
+
+    // same may be one of those phis, and be replaced in turn
+    llvm::TrackingVH<llvm::Value> result(same);
+    for (auto& user : users) {
+        // one still waiting for its operands is not trivial yet
+        auto* user_phi = llvm::dyn_cast_or_null<llvm::PHINode>(user);
+        if (user_phi && user_phi->getNumIncomingValues() == llvm::pred_size(user_phi->getParent())) {
+            tryRemoveTrivialPhi(user_phi);
+        }
+    }
+    return result;
+}
+
+void Generator::sealBlock(llvm::BasicBlock* block) {
+    for (auto found = m_incomplete_phis.find(block); found != m_incomplete_phis.end();
+         found = m_incomplete_phis.find(block)) {
+        auto incomplete = std::move(found->second);
+        m_incomplete_phis.erase(found);
+        for (auto& [scalar, phi] : incomplete) {
+            addPhiOperands(scalar, phi);
+        }
+    }
+    m_sealed.insert(block);
+}
 
+void Generator::declareRoutine(parsing::Routine& node) {
+    // Generate types of arguments
     std::vector<llvm::Type*> arg_types;
-    arg_types.reserve(node.m_params.size());
+    arg_types.reserve(node.m_params.size() + 1);
+
+    // a large result is written where the caller points
+    llvm::Type* return_type = typenameToType(node.return_type);
+    // main is the entry point of the C runtime as well, which takes its result for the exit status
+    if (node.m_name == "main" && return_type->isVoidTy()) {
+        return_type = builder.getInt32Ty();
+    }
+    bool sret = passedByReference(return_type);
+    if (sret) {
+        arg_types.push_back(return_type->getPointerTo());
+    }
     for (const auto& param : node.m_params) {
-        arg_types.push_back(typenameToType(param->m_type));
+        llvm::Type* type = typenameToType(param->m_type);
+        arg_types.push_back(passedByReference(type) ? type->getPointerTo() : type);
     }
 
     // function type generation
-    auto* ft = llvm::FunctionType::get(typenameToType(node.return_type), arg_types, false);
-    current_function = llvm::Function::Create(ft, llvm::Function::ExternalLinkage, node.m_name, module.get());
+    auto* ft = llvm::FunctionType::get(sret ? llvm::Type::getVoidTy(context) : return_type, arg_types, false);
+    auto* function = llvm::Function::Create(ft, llvm::Function::ExternalLinkage, node.m_name, module.get());
+    m_routine_table[node.m_name] = function;
+
+    if (sret) {
+        function->addParamAttr(0, llvm::Attribute::getWithStructRetType(context, return_type));
+        function->addParamAttr(0, llvm::Attribute::NoAlias);
+    }
+    for (auto& arg : function->args()) {
+        if (!arg.getType()->isPointerTy() || arg.hasStructRetAttr()) {
+            continue;
+        }
+        // the argument is a slot of the caller, which nothing else reaches while the callee
+        // runs, not even a global slot as its routine can't be running twice; the callee
+        // copies one before it writes it
+        auto* pointee = arg.getType()->getPointerElementType();
+        arg.addAttr(llvm::Attribute::NoAlias);
+        arg.addAttr(llvm::Attribute::ReadOnly);
+        arg.addAttrs(llvm::AttrBuilder(context).addDereferenceableAttr(
+            module->getDataLayout().getTypeAllocSize(pointee)));
+    }
+}
+
+void Generator::addEffectAttributes(parsing::Routine& node, llvm::Function& function) {
+    // the language has no exceptions, a bounds check traps instead
+    function.addFnAttr(llvm::Attribute::NoUnwind);
+
+    bool pointer_params = false;
+    for (auto& arg : function.args()) {
+        if (arg.getType()->isPointerTy()) {
+            // nothing in the language can keep a pointer beyond the call
+            arg.addAttr(llvm::Attribute::NoCapture);
+            pointer_params = true;
+        }
+    }
+
+    switch (node.m_effects) {
+    case parsing::Effects::NONE:
+    case parsing::Effects::READS_ARGUMENTS:
+    case parsing::Effects::WRITES_ARGUMENTS:
+        // aggregates passed by value live in the frame of the callee, those passed
+        // by reference are copied there before a write; only the result is written.
+        // Slots too large for the frame are globals, which the module sees, or
+        // heap memory, which it doesn't
+        if (hasLargeSlots(node)) {
+            if (m_recursive.contains(node.m_name)) {
+                function.addFnAttr(llvm::Attribute::InaccessibleMemOrArgMemOnly);
+            }
+        } else if (!pointer_params || (node.m_effects == parsing::Effects::NONE && !function.hasStructRetAttr())) {
+            function.addFnAttr(llvm::Attribute::ReadNone);
+        } else {
+            function.addFnAttr(llvm::Attribute::ArgMemOnly);
+            if (!function.hasStructRetAttr()) {
+                function.addFnAttr(llvm::Attribute::ReadOnly);
+            }
+        }
+        break;
+    default:
+        break;
+    }
+
+    // a trapping bounds check never returns, claiming it would make the trap undefined
+    if (node.m_will_return && !m_options.m_bounds_check) {
+        function.addFnAttr(llvm::Attribute::WillReturn);
+    }
+}
+
+namespace {
+
+/*
+ * Element types and lengths of the arrays declared in place, the length
+ * is unknown unless it is a literal.
+*/
+struct InPlaceArrays : public parsing::RecursiveVisitor {
+    void visit(parsing::ArrayType& node) override {
+        auto* length = dynamic_cast<parsing::Integer*>(node.m_size.get());
+        m_arrays.emplace_back(node.m_type->m_name, length ? std::optional<int>(length->m_value) : std::nullopt);
+        parsing::RecursiveVisitor::visit(node);
+    }
+
+    std::vector<std::pair<std::string, std::optional<int>>> m_arrays;
+};
+
+} // namespace
+
+/*
+ * Whether acquireSlot may have to put a slot of the routine outside of its
+ * frame. Slots are taken for its parameters and declarations, and for the
+ * arguments and results of its calls. The routines it calls must be declared.
+*/
+bool Generator::hasLargeSlots(parsing::Routine& node) {
+    auto large = [this](llvm::Type* type) {
+        return module->getDataLayout().getTypeAllocSize(type).getFixedSize() > m_options.m_stack_limit;
+    };
+    for (auto& name : analysis::referencedTypes(node)) {
+        auto type = m_type_table.find(name);
+        if (type != m_type_table.end() && large(type->second)) {
+            return true;
+        }
+    }
+
+    InPlaceArrays arrays;
+    node.m_body->accept(arrays);
+    for (auto& [element, length] : arrays.m_arrays) {
+        auto type = m_type_table.find(element);
+        if (!length || type == m_type_table.end() || large(llvm::ArrayType::get(type->second, *length))) {
+            return true;
+        }
+    }
+
+    for (auto& callee : analysis::calledNames(*node.m_body)) {
+        auto routine = m_routine_table.find(callee);
+        if (routine == m_routine_table.end()) {
+            continue;
+        }
+        for (auto& arg : routine->second->args()) {
+            auto* type = arg.getType()->isPointerTy() ? arg.getType()->getPointerElementType() : arg.getType();
+            if (large(type)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
 
-    m_routine_table[node.m_name] = current_function;
+void Generator::visit(parsing::Routine& node) {
+    listing() << "\nGenerating routine " << node.m_name << "...\n\n";
+
+    if (!m_routine_table.contains(node.m_name)) {
+        declareRoutine(node);
+        addEffectAttributes(node, *m_routine_table.at(node.m_name));
+    }
+    current_function = m_routine_table.at(node.m_name);
+
+    m_scalar_table.clear();
+    m_scalars.clear();
+    m_definitions.clear();
+    m_incomplete_phis.clear();
+    m_sealed.clear();
+    m_free_slots.clear();
+    m_scope_slots.clear();
+    m_heap_slots.clear();
 
     llvm::BasicBlock *BB = llvm::BasicBlock::Create(context, "entry", current_function);
     builder.SetInsertPoint(BB);
+    sealBlock(BB);
     // arguments generation
     int arg_idx = 0;
+    if (current_function->hasStructRetAttr()) {
+        current_function->getArg(arg_idx++)->setName("result");
+    }
+    auto written = analysis::assignedNames(*node.m_body);
     for (auto &arg : node.m_params) {
-        llvm::AllocaInst *space = builder.CreateAlloca(typenameToType(arg->m_type), nullptr, arg->m_name);
+        llvm::Type* arg_type = typenameToType(arg->m_type);
+        if (arg_type->isIntegerTy() || arg_type->isDoubleTy()) {
+            llvm::Value* arg_value = current_function->getArg(arg_idx);
+            arg_value->setName(arg->m_name);
+            writeScalar(declareScalar(arg->m_name, arg_type), BB, arg_value);
+            arg_idx++;
+            continue;
+        }
+
+        // one passed by reference is used in place unless the routine writes it
+        llvm::Value* arg_value = current_function->getArg(arg_idx);
+        bool in_place = passedByReference(arg_type) && !written.contains(arg->m_name);
+        llvm::Value* space = in_place ? arg_value : acquireSlot(arg_type, arg->m_name);
         m_var_table[arg->m_name] = space;
+        m_scalar_table.erase(arg->m_name);
 
         if (m_ast_decl_table.contains(arg->m_type)) {
             m_ast_decl_table[arg->m_name] = m_ast_decl_table.at(arg->m_type);
@@ -240,8 +857,14 @@ void Generator::visit(parsing::Routine& node) {
 
         arg->accept(*this);
 
-        llvm::Value* arg_value = current_function->getArg(arg_idx);
-        builder.CreateStore(arg_value, space);
+        if (in_place) {
+            arg_value->setName(arg->m_name);
+        } else if (passedByReference(arg_type)) {
+            auto align = module->getDataLayout().getABITypeAlign(arg_type);
+            builder.CreateMemCpy(space, align, arg_value, align, module->getDataLayout().getTypeAllocSize(arg_type));
+        } else {
+            builder.CreateStore(arg_value, space);
+        }
 
         arg_idx++;
     }
@@ -249,16 +872,27 @@ void Generator::visit(parsing::Routine& node) {
     node.m_body->accept(*this);
 
     if (node.return_type.empty()) {
-        std::cout << "RETURN VOID\n";
-        builder.CreateRetVoid();
+        listing() << "RETURN VOID\n";
+        // the copies of the arguments
+        releaseSlots(m_scope_slots);
+        if (current_function->getReturnType()->isVoidTy()) {
+            builder.CreateRetVoid();
+        } else {
+            builder.CreateRet(builder.getInt32(0));
+        }
         return;
     }
 
+    // every path returned already, control never gets here
+    if (!builder.GetInsertBlock()->getTerminator()) {
+        builder.CreateUnreachable();
+    }
+
     // verifyFunction(*current_function);
 }
 
 void Generator::visit(parsing::RoutineCall& node) {
-    std::cout << "Generating routine call...\n";
+    listing() << "Generating routine call...\n";
 
     if (!m_routine_table.contains(node.m_routine_name)) {
         throw std::runtime_error("Routine doesn't exist: " + node.m_routine_name); 
@@ -266,19 +900,57 @@ void Generator::visit(parsing::RoutineCall& node) {
     llvm::Function* routine = m_routine_table[node.m_routine_name];
 
     // checking number of arguments
-    if (routine->arg_size() != node.m_parameters.size()) {
+    bool sret = routine->hasStructRetAttr();
+    if (routine->arg_size() != node.m_parameters.size() + sret) {
         throw std::runtime_error("Invalid number of arguments for a routine call: " + node.m_routine_name); 
     }
 
+    // arguments may be calls themselves, they are not returned directly
+    bool tail = m_tail_position;
+    m_tail_position = false;
+
     // create a vector of arguments
     std::vector<llvm::Value*> params;
+    llvm::Value* result = nullptr;
+    // a returned call writes straight into the result of this routine
+    bool forward_result = sret && tail && current_function->hasStructRetAttr();
+    if (sret) {
+        result = forward_result
+            ? static_cast<llvm::Value*>(current_function->getArg(0))
+            : acquireSlot(routine->getParamStructRetType(0), "result");
+        params.push_back(result);
+    }
     for (auto& par : node.m_parameters) {
+        llvm::Type* type = routine->getArg(params.size())->getType();
+        if (type->isPointerTy()) {
+            params.push_back(emitAddress(*par, type->getPointerElementType()));
+            continue;
+        }
         is_lvalue = false;
         par->accept(*this);
         params.push_back(current_expression);
     }
 
-    current_expression = builder.CreateCall(routine, params, "call_" + node.m_routine_name);
+    llvm::CallInst* call = builder.CreateCall(routine, params, sret ? "" : "call_" + node.m_routine_name);
+    current_expression = call;
+    if (sret) {
+        call->addParamAttr(0, llvm::Attribute::getWithStructRetType(context, routine->getParamStructRetType(0)));
+    }
+    if (sret && !forward_result) {
+        current_expression = builder.CreateLoad(routine->getParamStructRetType(0), result, "call_" + node.m_routine_name);
+    }
+
+    // a returned call can reuse the frame unless it gets pointers into it;
+    // musttail guarantees that, but needs the very same signature
+    bool by_value = std::none_of(params.begin(), params.end(), [](llvm::Value* param) {
+        return param->getType()->isPointerTy() && !llvm::isa<llvm::Argument>(llvm::getUnderlyingObject(param));
+    });
+    // freeing the heap slots would come after the call
+    if (tail && by_value && m_heap_slots.empty()) {
+        call->setTailCallKind(routine->getFunctionType() == current_function->getFunctionType()
+            ? llvm::CallInst::TCK_MustTail
+            : llvm::CallInst::TCK_Tail);
+    }
 }
 
 void Generator::visit(parsing::RoutineCallResult& node) {
@@ -298,9 +970,17 @@ void Generator::visit(parsing::Statement& node) {}
 void Generator::visit(parsing::Expression& node) {}
 
 void Generator::visit(parsing::Modifiable& node) {
+    if (auto scalar = m_scalar_table.find(node.m_head_name); scalar != m_scalar_table.end()) {
+        if (is_lvalue) {
+            throw std::runtime_error("Scalar " + node.m_head_name + " has no address");
+        }
+        current_expression = readScalar(scalar->second, builder.GetInsertBlock());
+        return;
+    }
+
     if (node.m_chain.empty()) {
         auto *var = m_var_table.at(node.m_head_name);
-        llvm::Type *allocatedType = var->getAllocatedType();
+        llvm::Type *allocatedType = var->getType()->getPointerElementType();
         if (is_lvalue) {
             current_lvalue = var;
         } else {
@@ -400,75 +1080,128 @@ void Generator::visit(parsing::Modifiable& node) {
 }
 
 void Generator::visit(parsing::ReturnStatement& node) {
-    std::cout << "Generating return statement...\n";
+    listing() << "Generating return statement...\n";
 
     is_lvalue = false;
+    m_tail_position = dynamic_cast<parsing::RoutineCallResult*>(node.m_expr.get()) != nullptr;
     node.m_expr->accept(*this);
+    m_tail_position = false;
     llvm::Value* ret_res = current_expression;
 
-    builder.CreateRet(ret_res);
+    if (current_function->hasStructRetAttr()) {
+        // a returned call with a large result has written it already, and has no value
+        if (!ret_res->getType()->isVoidTy()) {
+            builder.CreateStore(ret_res, current_function->getArg(0));
+        }
+    }
+    for (auto slot = m_heap_slots.rbegin(); slot != m_heap_slots.rend(); ++slot) {
+        emitFree(*slot);
+    }
+    if (current_function->hasStructRetAttr()) {
+        builder.CreateRetVoid();
+    } else {
+        builder.CreateRet(ret_res);
+    }
+
+    // statements after a return are dead, but they still need a block
+    // that does not already end with a terminator
+    llvm::BasicBlock* dead = llvm::BasicBlock::Create(context, "afterreturn", builder.GetInsertBlock()->getParent());
+    sealBlock(dead);
+    builder.SetInsertPoint(dead);
 }
 
 void Generator::visit(parsing::Range& node) {}
 
 void Generator::visit(parsing::For& node) {
-    std::cout << "\nGenerating For-loop statement...\n";
+    listing() << "\nGenerating For-loop statement...\n";
 
     llvm::Function* parent_function = builder.GetInsertBlock()->getParent();
 
-    // Working with range
-    llvm::Value* startValue = nullptr;
-    llvm::Value* endValue = nullptr;
-    llvm::Value* stepValue = nullptr;
-
-    if (node.m_range->m_reverse) {
-        stepValue = llvm::ConstantInt::get(llvm::Type::getInt32Ty(context), -1);
-    } else {
-        stepValue = llvm::ConstantInt::get(llvm::Type::getInt32Ty(context), 1);
-    }
-
+    // Working with range, both ends are evaluated once
     is_lvalue = false;
     node.m_range->m_begin->accept(*this);
-    startValue = current_expression;
+    llvm::Value* beginValue = current_expression;
 
     is_lvalue = false;
     node.m_range->m_end->accept(*this);
-    endValue = current_expression;
+    llvm::Value* endValue = current_expression;
+
+    // begin .. end is half-open, a reverse loop walks it from end - 1 down to begin;
+    // end - 1 is only used once the guard made sure that end > begin, it doesn't wrap
+    bool reverse = node.m_range->m_reverse;
+    llvm::Value* lastValue = builder.CreateSub(endValue, builder.getInt32(1), "last");
+    llvm::Value* startValue = reverse ? lastValue : beginValue;
+    llvm::Value* stopValue = reverse ? beginValue : lastValue;
+    llvm::Value* stepValue = builder.getInt32(reverse ? -1 : 1);
 
     // Creating identifier (var i)
-    llvm::AllocaInst* iterator_var = builder.CreateAlloca(startValue->getType(), nullptr, node.m_identifier->m_name);
-    builder.CreateStore(startValue, iterator_var);
-    m_var_table[node.m_identifier->m_name] = iterator_var;
+    size_t iterator = declareScalar(node.m_identifier->m_name, startValue->getType());
+    writeScalar(iterator, builder.GetInsertBlock(), startValue);
 
-    // Top-level structure
+    // Top-level structure, in the shape LoopSimplify would give it
+    llvm::BasicBlock* preheaderBB = llvm::BasicBlock::Create(context, "preheader", parent_function);
     llvm::BasicBlock* loopBB = llvm::BasicBlock::Create(context, "loop", parent_function);
+    llvm::BasicBlock* exitBB = llvm::BasicBlock::Create(context, "loopexit", parent_function);
     llvm::BasicBlock* afterBB = llvm::BasicBlock::Create(context, "afterloop", parent_function);
 
-    // parent_function->getBasicBlockList().push_back(loopBB);
-    llvm::Value* for_var = builder.CreateLoad(iterator_var->getAllocatedType(), iterator_var, node.m_identifier->m_name);
+    // the loop is rotated: a guard here, and the test for the next iteration at the latch
+    builder.CreateCondBr(builder.CreateICmpSLT(beginValue, endValue, "loopguard"), preheaderBB, afterBB);
+    sealBlock(preheaderBB);
+    builder.SetInsertPoint(preheaderBB);
+    builder.CreateBr(loopBB);
 
-    // Condition to break a loop
-    llvm::Value* for_condition = builder.CreateICmpSLT(for_var, endValue, "loopcond");
-    builder.CreateCondBr(for_condition, loopBB, afterBB);
-    
     builder.SetInsertPoint(loopBB);
+    llvm::PHINode* induction = builder.CreatePHI(startValue->getType(), 2, node.m_identifier->m_name);
+    induction->addIncoming(startValue, preheaderBB);
+    writeScalar(iterator, loopBB, induction);
+
     node.m_body->accept(*this);
 
-    // i++
-    for_var = builder.CreateLoad(iterator_var->getAllocatedType(), iterator_var, node.m_identifier->m_name);
-    llvm::Value* upd_value = builder.CreateAdd(for_var, stepValue, "nextvalue");
-    builder.CreateStore(upd_value, iterator_var);
+    // i++, the body may have assigned the iterator. The value is tested before the step,
+    // against a bound computed once, so the step never wraps around: the loop runs
+    // stop - start + 1 times unless the body moves the iterator
+    llvm::BasicBlock* latchBB = builder.GetInsertBlock();
+    llvm::Value* currentValue = readScalar(iterator, latchBB);
+    llvm::Value* for_condition = reverse
+        ? builder.CreateICmpSGT(currentValue, stopValue, "loopcond")
+        : builder.CreateICmpSLT(currentValue, stopValue, "loopcond");
+    llvm::Value* nextValue = builder.CreateNSWAdd(currentValue, stepValue, "nextvalue");
+    writeScalar(iterator, latchBB, nextValue);
+    induction->addIncoming(nextValue, latchBB);
+
+    builder.CreateCondBr(for_condition, loopBB, exitBB)->setMetadata(llvm::LLVMContext::MD_loop, loopMetadata(node));
+    sealBlock(loopBB);
+    sealBlock(exitBB);
+
+    builder.SetInsertPoint(exitBB);
+    builder.CreateBr(afterBB);
+    sealBlock(afterBB);
 
-    for_var = builder.CreateLoad(iterator_var->getAllocatedType(), iterator_var, node.m_identifier->m_name);
+    builder.SetInsertPoint(afterBB);
 
-    // Condition to break a loop
-    for_condition = builder.CreateICmpSLT(for_var, endValue, "loopcond");
-    builder.CreateCondBr(for_condition, loopBB, afterBB);
+    listing() << "> For-loop statement was generated\n\n";
+}
 
-    // parent_function->getBasicBlockList().push_back(afterBB);
-    builder.SetInsertPoint(afterBB);
+/*
+ * Every for gets a loop id, so that the loop passes tell the loops apart
+ * and the hints of the source reach the vectorizer and the unroller.
+*/
+llvm::MDNode* Generator::loopMetadata(parsing::For& node) {
+    llvm::SmallVector<llvm::Metadata*, 3> operands = { nullptr };
+    if (node.m_vectorize) {
+        operands.push_back(llvm::MDNode::get(context, {
+            llvm::MDString::get(context, "llvm.loop.vectorize.enable"),
+            llvm::ConstantAsMetadata::get(builder.getTrue()) }));
+    }
+    if (node.m_unroll) {
+        operands.push_back(llvm::MDNode::get(context, {
+            llvm::MDString::get(context, "llvm.loop.unroll.count"),
+            llvm::ConstantAsMetadata::get(builder.getInt32(node.m_unroll)) }));
+    }
 
-    std::cout << "> For-loop statement was generated\n\n";
+    auto* loop = llvm::MDNode::getDistinct(context, operands);
+    loop->replaceOperandWith(0, loop);
+    return loop;
 }
 
 void Generator::visit(parsing::While& node) {
@@ -492,6 +1225,8 @@ void Generator::visit(parsing::While& node) {
     cond = current_expression;
 
     builder.CreateCondBr(cond, loopBB, skipBB);
+    sealBlock(loopBB);
+    sealBlock(skipBB);
 
     parent_func->getBasicBlockList().push_back(skipBB);
     builder.SetInsertPoint(skipBB);
@@ -504,17 +1239,44 @@ void Generator::visit(parsing::Assignment& node) {
     node.m_expression->accept(*this);
     llvm::Value* expr_value = current_expression;
 
+    if (assignScalar(*node.m_modifiable, expr_value)) {
+        return;
+    }
+
     // and this thing sets out current_lvalue thing
     // so now we have an address to store or value to
     is_lvalue = true;
     node.m_modifiable->accept(*this);
+    is_lvalue = false;
 
     builder.CreateStore(expr_value, current_lvalue);
 }
 
 void Generator::visit(parsing::Program& node) {
+    // types first, then every routine signature, so that a routine
+    // may call the ones declared after it
+    for (const auto& decl : node.m_declarations) {
+        if (!std::dynamic_pointer_cast<parsing::Routine>(decl)) {
+            decl->accept(*this);
+        }
+    }
+    for (const auto& decl : node.m_declarations) {
+        if (auto routine = std::dynamic_pointer_cast<parsing::Routine>(decl)) {
+            declareRoutine(*routine);
+        }
+    }
+    // the effects depend on the slots a routine needs for its calls
+    for (const auto& decl : node.m_declarations) {
+        if (auto routine = std::dynamic_pointer_cast<parsing::Routine>(decl)) {
+            addEffectAttributes(*routine, *m_routine_table.at(routine->m_name));
+        }
+    }
+    // the others stay declarations, they are defined in another module
     for (const auto& decl : node.m_declarations) {
-        decl->accept(*this);
+        if (std::dynamic_pointer_cast<parsing::Routine>(decl)
+            && (m_partition.empty() || m_partition.contains(decl->m_name))) {
+            decl->accept(*this);
+        }
     }
 }
 
@@ -541,21 +1303,29 @@ void Generator::visit(parsing::Integer& node) {
 }
 
 void Generator::visit(parsing::ArrayAccess& node) {
-    std::cout << "Accessing an array...\n";
+    listing() << "Accessing an array...\n";
 
     llvm::Value* outer = current_expression;
 
+    // the index is always read, even when the element is assigned to
+    bool outer_is_lvalue = is_lvalue;
+    is_lvalue = false;
     node.access->accept(*this);
     llvm::Value* index = current_expression;
+    is_lvalue = outer_is_lvalue;
 
-    std::cout << "array type:";
-    outer->getType()->print(llvm::errs());
-    std::cout << "\n";
+    std::string type_name;
+    llvm::raw_string_ostream(type_name) << *outer->getType();
+    listing() << "array type:" << type_name << "\n";
 
     if (!outer->getType()->isPointerTy()) {
         throw std::runtime_error("Outer must be a pointer to the array!");
     }
 
+    if (m_options.m_bounds_check && !node.m_in_bounds) {
+        emitBoundsCheck(index, outer->getType()->getPointerElementType()->getArrayNumElements());
+    }
+
     llvm::Value* element = builder.CreateGEP(
         outer->getType()->getPointerElementType(),
         outer,
@@ -567,22 +1337,51 @@ void Generator::visit(parsing::ArrayAccess& node) {
     current_access_type = outer->getType()->getPointerElementType()->getArrayElementType();
 }
 
+void Generator::emitBoundsCheck(llvm::Value* index, uint64_t size) {
+    llvm::Function* parent_func = builder.GetInsertBlock()->getParent();
+
+    if (m_trap_block == nullptr || m_trap_block->getParent() != parent_func) {
+        m_trap_block = llvm::BasicBlock::Create(context, "out_of_bounds", parent_func);
+        llvm::IRBuilder<> trap_builder(m_trap_block);
+        // the trap kills the process, flush what the program printed so far and say why first
+        auto flush = module->getOrInsertFunction("fflush", trap_builder.getInt32Ty(), trap_builder.getInt8PtrTy());
+        trap_builder.CreateCall(flush, {llvm::ConstantPointerNull::get(trap_builder.getInt8PtrTy())});
+        const std::string message = "Error: array index out of bounds\n";
+        auto write = module->getOrInsertFunction("write", trap_builder.getInt64Ty(), trap_builder.getInt32Ty(),
+                                                 trap_builder.getInt8PtrTy(), trap_builder.getInt64Ty());
+        trap_builder.CreateCall(write, {trap_builder.getInt32(2), trap_builder.CreateGlobalStringPtr(message),
+                                        trap_builder.getInt64(message.size())});
+        trap_builder.CreateCall(llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::trap));
+        trap_builder.CreateUnreachable();
+    }
+
+    // unsigned comparison catches negative indices as well
+    llvm::Value* in_bounds = builder.CreateICmpULT(
+        index, llvm::ConstantInt::get(index->getType(), size), "in_bounds");
+    llvm::BasicBlock* okBB = llvm::BasicBlock::Create(context, "in_bounds", parent_func);
+
+    llvm::MDBuilder weights(context);
+    builder.CreateCondBr(in_bounds, okBB, m_trap_block, weights.createBranchWeights(1 << 20, 1));
+    sealBlock(okBB);
+    builder.SetInsertPoint(okBB);
+}
+
 void Generator::visit(parsing::RecordAccess& node) {
-    std::cout << "Accessing a record...\n";
+    listing() << "Accessing a record...\n";
 
     llvm::Value* record = current_expression;
 
-    std::cout << "record type:";
-    record->getType()->print(llvm::errs());
-    std::cout << "\n";
+    std::string type_name;
+    llvm::raw_string_ostream(type_name) << *record->getType();
+    listing() << "record type:" << type_name << "\n";
 
 
-    std::cout << "1: " << node.m_record_type << "\n";
-    std::cout << "2:\n";
+    listing() << "1: " << node.m_record_type << "\n";
+    listing() << "2:\n";
 
     int index = 0;
     for (auto& field_name : m_records_table.at(node.m_record_type)) {
-        std::cout << " " << field_name << " (" << index << ")\n";
+        listing() << " " << field_name << " (" << index << ")\n";
 
         if (field_name == node.identifier) {
             break;
@@ -598,7 +1397,7 @@ void Generator::visit(parsing::RecordAccess& node) {
 }
 
 void Generator::visit(parsing::TypeAliasing& node) {
-    std::cout << "Generating an aliasing type " << node.m_to << " as " << node.m_from->m_name << "...\n";
+    listing() << "Generating an aliasing type " << node.m_to << " as " << node.m_from->m_name << "...\n";
 
     auto default_type = node.m_from;
     llvm::Type* real_type = nullptr;
@@ -617,7 +1416,7 @@ void Generator::visit(parsing::TypeAliasing& node) {
 }
 
 void Generator::visit(parsing::StdFunction& node) {
-    std::cout << "Parsing std function " << node.m_routine_name << " call...\n";
+    listing() << "Parsing std function " << node.m_routine_name << " call...\n";
 
     if (node.m_routine_name == "print") {
         // function print
@@ -708,7 +1507,18 @@ void Generator::visit(parsing::Multiplication& node) {
     gen_expr_fork(node, left, right);
 
     if (left->getType()->isIntegerTy() && right->getType()->isIntegerTy()) {
-        current_expression = builder.CreateMul(left, right, "multmp");
+        auto* constant = llvm::dyn_cast<llvm::ConstantInt>(right);
+        if (!constant) {
+            constant = llvm::dyn_cast<llvm::ConstantInt>(left);
+            std::swap(left, right);
+        }
+        if (constant && constant->isOne()) {
+            current_expression = left;
+        } else if (constant && constant->getValue().isPowerOf2()) {
+            current_expression = builder.CreateShl(left, constant->getValue().logBase2(), "multmp");
+        } else {
+            current_expression = builder.CreateMul(left, right, "multmp");
+        }
     } else if (left->getType()->isDoubleTy() && right->getType()->isDoubleTy()) {
         current_expression = builder.CreateFMul(left, right, "fmultmp");
     } else {
@@ -722,7 +1532,14 @@ void Generator::visit(parsing::Division& node) {
     gen_expr_fork(node, left, right);
 
     if (left->getType()->isIntegerTy() && right->getType()->isIntegerTy()) {
-        current_expression = builder.CreateSDiv(left, right, "divtmp");
+        auto* constant = llvm::dyn_cast<llvm::ConstantInt>(right);
+        if (node.m_non_negative && constant && constant->getValue().isPowerOf2()) {
+            current_expression = builder.CreateLShr(left, constant->getValue().logBase2(), "divtmp");
+        } else if (node.m_non_negative) {
+            current_expression = builder.CreateUDiv(left, right, "divtmp");
+        } else {
+            current_expression = builder.CreateSDiv(left, right, "divtmp");
+        }
     } else if (left->getType()->isDoubleTy() && right->getType()->isDoubleTy()) {
         current_expression = builder.CreateFDiv(left, right, "fdivtmp");
     } else {
@@ -730,7 +1547,49 @@ void Generator::visit(parsing::Division& node) {
     }
 }
 
+void Generator::emitShortCircuit(parsing::Logic& node, bool is_and) {
+    listing() << "Generating short-circuit expression for " << node.gr_to_str() << "...\n";
+
+    is_lvalue = false;
+    node.m_left->accept(*this);
+    llvm::Value* left = current_expression;
+    llvm::BasicBlock* left_end = builder.GetInsertBlock();
+    llvm::Function* parent_func = left_end->getParent();
+
+    llvm::BasicBlock* rightBB = llvm::BasicBlock::Create(context, "shortrhs", parent_func);
+    llvm::BasicBlock* mergeBB = llvm::BasicBlock::Create(context, "shortmerge");
+
+    // `and` is decided by a false left operand, `or` by a true one
+    if (is_and) {
+        builder.CreateCondBr(left, rightBB, mergeBB);
+    } else {
+        builder.CreateCondBr(left, mergeBB, rightBB);
+    }
+    sealBlock(rightBB);
+
+    builder.SetInsertPoint(rightBB);
+    is_lvalue = false;
+    node.m_right->accept(*this);
+    llvm::Value* right = current_expression;
+    llvm::BasicBlock* right_end = builder.GetInsertBlock();
+    builder.CreateBr(mergeBB);
+    sealBlock(mergeBB);
+
+    parent_func->getBasicBlockList().push_back(mergeBB);
+    builder.SetInsertPoint(mergeBB);
+
+    llvm::PHINode* phi = builder.CreatePHI(llvm::Type::getInt1Ty(context), 2, "shorttmp");
+    phi->addIncoming(llvm::ConstantInt::get(llvm::Type::getInt1Ty(context), is_and ? 0 : 1), left_end);
+    phi->addIncoming(right, right_end);
+    current_expression = phi;
+}
+
 void Generator::visit(parsing::And& node) {
+    if (node.m_short_circuit) {
+        emitShortCircuit(node, true);
+        return;
+    }
+
     llvm::Value* left = nullptr;
     llvm::Value* right = nullptr;
     gen_expr_fork(node, left, right);
@@ -743,6 +1602,11 @@ void Generator::visit(parsing::And& node) {
 }
 
 void Generator::visit(parsing::Or& node) {
+    if (node.m_short_circuit) {
+        emitShortCircuit(node, false);
+        return;
+    }
+
     llvm::Value* left = nullptr;
     llvm::Value* right = nullptr;
     gen_expr_fork(node, left, right);
@@ -772,7 +1636,14 @@ void Generator::visit(parsing::Mod& node) {
     gen_expr_fork(node, left, right);
 
     if (left->getType()->isIntegerTy() && right->getType()->isIntegerTy()) {
-        current_expression = builder.CreateSRem(left, right, "modtmp");
+        auto* constant = llvm::dyn_cast<llvm::ConstantInt>(right);
+        if (node.m_non_negative && constant && constant->getValue().isPowerOf2()) {
+            current_expression = builder.CreateAnd(left, constant->getValue() - 1, "modtmp");
+        } else if (node.m_non_negative) {
+            current_expression = builder.CreateURem(left, right, "modtmp");
+        } else {
+            current_expression = builder.CreateSRem(left, right, "modtmp");
+        }
     } else {
         throw std::runtime_error("Invalid types for 'mod' operator. Both operands must be integer.");
     }
@@ -1,3 +1,5 @@
+#pragma once
+
 #include "parser/AST-node.hpp"
 #include "parser/parser.hpp"
 #include "parser/visitor/abstract-visitor.hpp"
@@ -12,24 +14,89 @@
 #include <llvm/IR/Function.h>
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/IR/Value.h>
+#include <llvm/IR/ValueHandle.h>
+#include <llvm/Target/TargetMachine.h>
 
+#include <iostream>
 #include <memory>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <string>
 
 namespace generator {
+
+/*
+ * Knobs of the code generation, set from the command line.
+*/
+struct Options {
+    enum class Level {
+        O0,
+        O1,
+        O2,
+        O3,
+        Os
+    };
+
+    enum class Emit {
+        IR,
+        ASSEMBLY,
+        OBJECT,
+        // nothing is written, the module is kept for run()
+        MEMORY
+    };
+
+    // trap on out-of-bounds array accesses the range analysis could not rule out
+    bool m_bounds_check = false;
+    // LLVM pipeline run on the module before it is written out
+    Level m_level = Level::O0;
+    // what apply() writes to m_output
+    Emit m_emit = Emit::IR;
+    std::string m_output = "output.ll";
+    // target of the native code, the host when empty
+    std::string m_triple;
+    // run() starts every routine unoptimised and recompiles the hot ones in the background
+    bool m_tiered = false;
+    // calls plus loop iterations after which a routine is recompiled
+    uint64_t m_tier_threshold = 1000;
+    // arrays and records larger than this many bytes are kept off the stack
+    uint64_t m_stack_limit = 64 * 1024;
+    // progress of the generation, nothing is printed to a stream without a buffer
+    std::ostream* m_listing = &std::cout;
+};
+
+/*
+ * Runs LLVM's default pipeline of the level, there is none for O0 and O2
+ * runs instead. Generator::optimize doesn't call it at O0 at all, the tiered
+ * JIT asks for O2 explicitly when it recompiles a hot routine built at O0.
+*/
+void runPipeline(llvm::Module& module, Options::Level level, llvm::TargetMachine* target_machine);
+
+// safe to call from several threads, only the first call registers the target
+void initializeNativeTarget();
+// for Options::m_triple, or the host
+std::unique_ptr<llvm::TargetMachine> createTargetMachine(const Options& options);
+/*
+ * Writes the module to Options::m_output as Options::m_emit says, native
+ * code needs the target machine. False when the file cannot be opened.
+*/
+bool writeModule(llvm::Module& module, const Options& options, llvm::TargetMachine* target_machine);
+std::string describe(Options::Emit emit);
+
 struct Generator : public parsing::ICompleteVisitor {
-    llvm::LLVMContext context{};
-    std::shared_ptr<llvm::Module> module;
+    // owned through a pointer, run() hands both over to the JIT
+    std::unique_ptr<llvm::LLVMContext> m_context = std::make_unique<llvm::LLVMContext>();
+    llvm::LLVMContext& context = *m_context;
+    std::unique_ptr<llvm::Module> module;
     std::shared_ptr<parsing::Program> m_tree;
+    Options m_options;
 
     // Something like Control Flow Graph
     llvm::IRBuilder<> builder;
 
     std::unordered_map<std::string, llvm::Type*> m_type_table;
-    // we may consider storing string -> llvm::AllocaInst*
-    std::unordered_map<std::string, llvm::AllocaInst*> m_var_table;
+    // where arrays and records live: an alloca, or a parameter passed by reference
+    std::unordered_map<std::string, llvm::Value*> m_var_table;
     std::unordered_map<std::string, llvm::Function*> m_routine_table;
     std::unordered_map<std::string, std::vector<std::string>> m_records_table;
     std::unordered_map<std::string, std::string> m_recordnames_table;
@@ -41,16 +108,81 @@ struct Generator : public parsing::ICompleteVisitor {
     llvm::Type* current_access_type;
 
     bool is_lvalue = false;
+    // the call being generated is the value of a return statement
+    bool m_tail_position = false;
+
+    // shared by all the bounds checks of the current function
+    llvm::BasicBlock* m_trap_block = nullptr;
+
+    // Scalar locals, arguments and iterators never have their address taken,
+    // they are SSA values built on the fly (Braun et al., "Simple and Efficient
+    // Construction of Static Single Assignment Form"). Only arrays and records
+    // live in allocas. A scalar is numbered per declaration, so shadowing is fine.
+    std::unordered_map<std::string, size_t> m_scalar_table;
+    std::vector<std::pair<std::string, llvm::Type*>> m_scalars;
+    // the value of each scalar at the end of a block, as far as it was generated
+    std::unordered_map<llvm::BasicBlock*, std::unordered_map<size_t, llvm::TrackingVH<llvm::Value>>> m_definitions;
+    // phis of blocks whose predecessors are not all known yet
+    std::unordered_map<llvm::BasicBlock*, std::vector<std::pair<size_t, llvm::PHINode*>>> m_incomplete_phis;
+    std::unordered_set<llvm::BasicBlock*> m_sealed;
 
-    explicit Generator(std::shared_ptr<parsing::Program> program)
-        : m_tree(program),
-        module(std::make_shared<llvm::Module>("I_module", context)),
+    // Arrays and records declared in a Body live from their declaration to the
+    // end of that Body, between lifetime markers. A slot is in the entry block
+    // and is handed to the next declaration of the same type once its scope
+    // is over, so disjoint scopes share the stack.
+    //
+    // Slots above Options::m_stack_limit are zero-initialised internal globals
+    // when the routine is not recursive, as only one call of it can be running.
+    // In a recursive one they are calloc'ed, and freed at the end of the scope
+    // or at a return.
+    std::unordered_map<llvm::Type*, std::vector<llvm::Value*>> m_free_slots;
+    // slots taken in the innermost Body
+    std::vector<llvm::Value*> m_scope_slots;
+    // heap slots of the current routine that are not freed yet
+    std::vector<llvm::Value*> m_heap_slots;
+    std::unordered_set<std::string> m_recursive;
+
+    // only created when native code is emitted
+    std::unique_ptr<llvm::TargetMachine> m_target_machine;
+    // routines given a body in this module, all of them when empty
+    std::unordered_set<std::string> m_partition;
+
+    explicit Generator(std::shared_ptr<parsing::Program> program, Options options = {})
+        : module(std::make_unique<llvm::Module>("I_module", context)),
+        m_tree(program),
+        m_options(options),
         builder(context) {}
 
     void apply();
+    void optimize();
+    std::ostream& listing();
+    void selectTarget();
+    int run();
 
     llvm::Type* typenameToType(const std::string& name);
+    llvm::AllocaInst* createEntryAlloca(llvm::Type* type, const std::string& name);
+    llvm::Value* acquireSlot(llvm::Type* type, const std::string& name);
+    void releaseSlots(const std::vector<llvm::Value*>& slots);
+    void emitFree(llvm::Value* slot);
+    bool passedByReference(llvm::Type* type);
+    llvm::Value* emitAddress(parsing::Expression& node, llvm::Type* type);
     void gen_expr_fork(parsing::Math& node, llvm::Value*& left, llvm::Value*& right);
+    void declareRoutine(parsing::Routine& node);
+    void addEffectAttributes(parsing::Routine& node, llvm::Function& function);
+    bool hasLargeSlots(parsing::Routine& node);
+    void emitBoundsCheck(llvm::Value* index, uint64_t size);
+    void emitSelect(parsing::If& node);
+    void emitShortCircuit(parsing::Logic& node, bool is_and);
+    llvm::MDNode* loopMetadata(parsing::For& node);
+
+    size_t declareScalar(const std::string& name, llvm::Type* type);
+    bool assignScalar(parsing::Modifiable& target, llvm::Value* value);
+    void writeScalar(size_t scalar, llvm::BasicBlock* block, llvm::Value* value);
+    llvm::Value* readScalar(size_t scalar, llvm::BasicBlock* block);
+    llvm::Value* readScalarRecursive(size_t scalar, llvm::BasicBlock* block);
+    llvm::Value* addPhiOperands(size_t scalar, llvm::PHINode* phi);
+    llvm::Value* tryRemoveTrivialPhi(llvm::PHINode* phi);
+    void sealBlock(llvm::BasicBlock* block);
 
     void visit(parsing::ASTNode& node) override;
     void visit(parsing::Declaration& node) override;
@@ -0,0 +1,130 @@
+#include "parallel-generator.hpp"
+
+#include "analyzer/ast-utils.hpp"
+#include "analyzer/thread-pool.hpp"
+
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace generator {
+
+ParallelGenerator::ParallelGenerator(std::shared_ptr<parsing::Program> program, Options options, size_t threads)
+    : m_tree(program),
+    m_options(options),
+    m_threads(threads) {
+    std::unordered_map<std::string, size_t> position;
+    for (auto& decl : m_tree->m_declarations) {
+        if (dynamic_cast<parsing::Routine*>(decl.get())) {
+            position.emplace(decl->m_name, position.size());
+        }
+    }
+    auto earlier = [&position](const std::string& left, const std::string& right) {
+        return position.at(left) < position.at(right);
+    };
+
+    m_partitions = analysis::CallGraph(*m_tree).bottomUp();
+    for (auto& partition : m_partitions) {
+        std::sort(partition.begin(), partition.end(), earlier);
+    }
+    std::sort(m_partitions.begin(), m_partitions.end(), [&earlier](const auto& left, const auto& right) {
+        return earlier(left.front(), right.front());
+    });
+}
+
+void ParallelGenerator::apply() {
+    auto generators = generate();
+
+    // modules of different contexts cannot be linked, they are moved over as bitcode
+    llvm::LLVMContext context;
+    auto merged = std::make_unique<llvm::Module>("I_module", context);
+    llvm::Linker linker(*merged);
+    for (auto& generator : generators) {
+        llvm::SmallVector<char, 0> bitcode;
+        llvm::raw_svector_ostream stream(bitcode);
+        llvm::WriteBitcodeToFile(*generator->module, stream);
+        generator.reset();
+
+        auto part = llvm::parseBitcodeFile(
+            llvm::MemoryBufferRef(llvm::StringRef(bitcode.data(), bitcode.size()), "partition"), context);
+        if (!part) {
+            throw std::runtime_error("Cannot read a partition back: " + llvm::toString(part.takeError()));
+        }
+        if (linker.linkInModule(std::move(*part))) {
+            throw std::runtime_error("Cannot link the partitions");
+        }
+    }
+
+    *m_options.m_listing << "\n";
+
+    merged->print(llvm::outs(), nullptr);
+
+    std::unique_ptr<llvm::TargetMachine> target_machine;
+    if (m_options.m_emit != Options::Emit::IR) {
+        target_machine = createTargetMachine(m_options);
+    }
+    if (writeModule(*merged, m_options, target_machine.get())) {
+        llvm::outs() << describe(m_options.m_emit) << " written to " << m_options.m_output << "\n";
+    }
+}
+
+std::vector<std::string> ParallelGenerator::writeObjects() {
+    auto generators = generate();
+
+    std::vector<std::string> objects;
+    for (size_t idx = 0; idx < generators.size(); ++idx) {
+        objects.push_back(m_options.m_output + "." + std::to_string(idx) + ".o");
+    }
+
+    ThreadPool pool(m_threads);
+    pool.forEach(generators.size(), [&](size_t idx) {
+        Options options = m_options;
+        options.m_emit = Options::Emit::OBJECT;
+        options.m_output = objects[idx];
+        if (!writeModule(*generators[idx]->module, options, generators[idx]->m_target_machine.get())) {
+            throw std::runtime_error("Cannot write " + objects[idx]);
+        }
+    });
+    return objects;
+}
+
+/*
+ * The first partition goes alone: it stores the sizes of the global array
+ * types in the tree, the others only read them. Each generator lists its
+ * progress into a buffer of its own, the buffers are printed in the order
+ * of the partitions once all of them are done.
+*/
+std::vector<std::unique_ptr<Generator>> ParallelGenerator::generate() {
+    std::vector<std::unique_ptr<Generator>> generators(m_partitions.size());
+    std::vector<std::ostringstream> listings(m_partitions.size());
+    auto generateOne = [&](size_t idx) {
+        Options options = m_options;
+        options.m_emit = Options::Emit::MEMORY;
+        options.m_listing = &listings[idx];
+        generators[idx] = std::make_unique<Generator>(m_tree, options);
+        generators[idx]->m_partition.insert(m_partitions[idx].begin(), m_partitions[idx].end());
+        generators[idx]->apply();
+    };
+
+    if (m_partitions.empty()) {
+        return generators;
+    }
+    generateOne(0);
+
+    ThreadPool pool(m_threads);
+    pool.forEach(m_partitions.size() - 1, [&](size_t idx) { generateOne(idx + 1); });
+
+    for (size_t idx = 0; idx < generators.size(); ++idx) {
+        *m_options.m_listing << listings[idx].str();
+        generators[idx]->m_options.m_listing = m_options.m_listing;
+    }
+    return generators;
+}
+
+} // namespace generator
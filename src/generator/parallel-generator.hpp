@@ -0,0 +1,38 @@
+#pragma once
+
+#include "generator.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace generator {
+
+/*
+ * Generates a program as several modules at once.
+ *
+ * Routines are split by call graph component: a routine goes together with
+ * the routines it is mutually recursive with, so that LLVM still sees whole
+ * recursions. Every partition is generated, verified and optimised by a
+ * Generator of its own, with its own LLVMContext, on a thread pool. The
+ * partitions do not depend on the number of threads, and are put back
+ * together in the order of the program, so neither does the output.
+*/
+struct ParallelGenerator {
+    ParallelGenerator(std::shared_ptr<parsing::Program> program, Options options, size_t threads);
+
+    // links the partitions into one module and writes it as Options::m_emit says
+    void apply();
+    // lowers every partition to an object file of its own, for the driver to link
+    std::vector<std::string> writeObjects();
+
+private:
+    std::vector<std::unique_ptr<Generator>> generate();
+
+    std::shared_ptr<parsing::Program> m_tree;
+    Options m_options;
+    size_t m_threads;
+    std::vector<std::vector<std::string>> m_partitions;
+};
+
+} // namespace generator
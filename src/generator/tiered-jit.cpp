@@ -0,0 +1,234 @@
+#include "tiered-jit.hpp"
+
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/Transforms/Utils/BasicBlockUtils.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+
+#include <stdexcept>
+#include <unordered_set>
+
+namespace generator {
+
+namespace {
+
+const char* const hook_name = "tarsonis.tier_up";
+
+void check(llvm::Error error, const std::string& what) {
+    if (error) {
+        throw std::runtime_error(what + ": " + llvm::toString(std::move(error)));
+    }
+}
+
+template <typename T>
+T check(llvm::Expected<T> value, const std::string& what) {
+    if (!value) {
+        throw std::runtime_error(what + ": " + llvm::toString(value.takeError()));
+    }
+    return std::move(*value);
+}
+
+} // namespace
+
+TieredJit::TieredJit(
+    std::unique_ptr<llvm::Module> module, std::unique_ptr<llvm::LLVMContext> context, Options options)
+    : m_options(options),
+    m_context(std::move(context)),
+    m_source(std::move(module)) {
+    initializeNativeTarget();
+
+    auto machine_builder = check(llvm::orc::JITTargetMachineBuilder::detectHost(), "Cannot detect the host");
+    m_target_machine = check(machine_builder.createTargetMachine(), "Cannot create a target machine");
+
+    m_jit = check(llvm::orc::LLJITBuilder().setJITTargetMachineBuilder(machine_builder).create(),
+        "Cannot create the JIT");
+
+    m_stubs = llvm::orc::createLocalIndirectStubsManagerBuilder(m_jit->getTargetTriple())();
+    if (!m_stubs) {
+        throw std::runtime_error("The tiered JIT does not support " + m_jit->getTargetTriple().str());
+    }
+
+    // nothing else runs yet, but the context is still only used locked
+    auto lock = m_context.getLock();
+    m_first_tier = llvm::CloneModule(*m_source);
+    instrument(*m_first_tier);
+}
+
+TieredJit::~TieredJit() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wakeup.notify_one();
+    if (m_worker.joinable()) {
+        m_worker.join();
+    }
+}
+
+int TieredJit::run() {
+    auto& library = m_jit->getMainJITDylib();
+    library.addGenerator(check(llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+        m_jit->getDataLayout().getGlobalPrefix()), "Cannot load host symbols"));
+
+    // callers see the stubs, which point at the first tier until a routine gets hot
+    llvm::orc::SymbolMap symbols;
+    auto flags = llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable;
+    for (auto& name : m_routines) {
+        check(m_stubs->createStub(name, 0, flags), "Cannot create a stub for " + name);
+        symbols[m_jit->mangleAndIntern(name)] = m_stubs->findStub(name, true);
+    }
+    symbols[m_jit->mangleAndIntern(hook_name)] =
+        llvm::JITEvaluatedSymbol(llvm::pointerToJITTargetAddress(&TieredJit::onHot), flags);
+    check(library.define(llvm::orc::absoluteSymbols(std::move(symbols))), "Cannot define the stubs");
+
+    llvm::Function* main_function = m_first_tier->getFunction("main");
+    if (!main_function) {
+        throw std::runtime_error("There is no main routine to run");
+    }
+    bool has_status = main_function->getReturnType()->isIntegerTy(32);
+
+    check(m_jit->addIRModule(llvm::orc::ThreadSafeModule(std::move(m_first_tier), m_context)),
+        "Cannot add the module to the JIT");
+    for (auto& name : m_routines) {
+        auto cold = check(m_jit->lookup(name + ".cold"), "Cannot compile " + name);
+        check(m_stubs->updatePointer(name, cold.getAddress()), "Cannot update the stub of " + name);
+    }
+    auto entry = check(m_jit->lookup("main"), "Cannot compile main");
+
+    m_worker = std::thread([this]() { compileHot(); });
+
+    if (has_status) {
+        return llvm::jitTargetAddressToFunction<int (*)()>(entry.getAddress())();
+    }
+    llvm::jitTargetAddressToFunction<void (*)()>(entry.getAddress())();
+    return 0;
+}
+
+void TieredJit::onHot(TieredJit* self, uint32_t routine) {
+    {
+        std::lock_guard<std::mutex> lock(self->m_mutex);
+        self->m_hot.push_back(routine);
+    }
+    self->m_wakeup.notify_one();
+}
+
+/*
+ * Renames every routine but main to `<name>.cold`, and sends the calls to
+ * `<name>`, the stub. Counting goes after the allocas of the entry block,
+ * which have to stay there, and at the start of every block a back edge
+ * jumps to.
+*/
+void TieredJit::instrument(llvm::Module& module) {
+    auto& context = module.getContext();
+    auto* counter_type = llvm::Type::getInt64Ty(context);
+    auto hook = module.getOrInsertFunction(hook_name, llvm::FunctionType::get(llvm::Type::getVoidTy(context),
+        { llvm::Type::getInt8PtrTy(context), llvm::Type::getInt32Ty(context) }, false));
+
+    std::vector<llvm::Function*> routines;
+    for (auto& function : module) {
+        if (!function.isDeclaration() && function.getName() != "main") {
+            routines.push_back(&function);
+        }
+    }
+
+    for (auto* function : routines) {
+        std::string name = function->getName().str();
+        auto routine = static_cast<uint32_t>(m_routines.size());
+        m_routines.push_back(name);
+
+        auto* counter = new llvm::GlobalVariable(module, counter_type, false, llvm::GlobalValue::InternalLinkage,
+            llvm::ConstantInt::get(counter_type, 0), name + ".count");
+
+        llvm::DominatorTree dominators(*function);
+        std::unordered_set<llvm::BasicBlock*> headers;
+        for (auto& block : *function) {
+            for (auto* successor : llvm::successors(&block)) {
+                if (dominators.dominates(successor, &block)) {
+                    headers.insert(successor);
+                }
+            }
+        }
+
+        auto entry = function->getEntryBlock().begin();
+        while (llvm::isa<llvm::AllocaInst>(*entry)) {
+            ++entry;
+        }
+        countAt(&*entry, counter, routine, hook);
+        for (auto* header : headers) {
+            countAt(header->getFirstNonPHI(), counter, routine, hook);
+        }
+
+        function->setName(name + ".cold");
+        auto* stub = llvm::Function::Create(
+            function->getFunctionType(), llvm::Function::ExternalLinkage, name, module);
+        stub->setAttributes(function->getAttributes());
+        function->replaceAllUsesWith(stub);
+    }
+}
+
+void TieredJit::countAt(
+    llvm::Instruction* where, llvm::GlobalVariable* counter, uint32_t routine, llvm::FunctionCallee hook) {
+    auto& context = where->getContext();
+    auto* counter_type = counter->getValueType();
+
+    llvm::IRBuilder<> builder(where);
+    auto* count = builder.CreateAdd(builder.CreateLoad(counter_type, counter), llvm::ConstantInt::get(counter_type, 1));
+    builder.CreateStore(count, counter);
+    auto* hot = builder.CreateICmpEQ(count, llvm::ConstantInt::get(counter_type, m_options.m_tier_threshold));
+
+    auto* weights = llvm::MDBuilder(context).createBranchWeights(1, 1 << 20);
+    llvm::IRBuilder<> hot_builder(llvm::SplitBlockAndInsertIfThen(hot, where, false, weights));
+    auto* self = llvm::ConstantExpr::getIntToPtr(
+        llvm::ConstantInt::get(counter_type, reinterpret_cast<uintptr_t>(this)), llvm::Type::getInt8PtrTy(context));
+    hot_builder.CreateCall(hook, { self, llvm::ConstantInt::get(llvm::Type::getInt32Ty(context), routine) });
+}
+
+void TieredJit::compileHot() {
+    while (true) {
+        uint32_t routine = 0;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wakeup.wait(lock, [this]() { return m_stopping || !m_hot.empty(); });
+            if (m_stopping) {
+                return;
+            }
+            routine = m_hot.front();
+            m_hot.pop_front();
+        }
+        try {
+            recompile(m_routines[routine]);
+        } catch (const std::exception& err) {
+            // the first tier keeps running, it is just slower
+            llvm::errs() << err.what() << "\n";
+        }
+    }
+}
+
+/*
+ * The routine is compiled in a module of its own, the other routines are
+ * declarations there and are called through their stubs. Its string
+ * constants are copied along.
+*/
+void TieredJit::recompile(const std::string& name) {
+    std::unique_ptr<llvm::Module> hot;
+    {
+        auto lock = m_context.getLock();
+        llvm::ValueToValueMapTy mapping;
+        hot = llvm::CloneModule(*m_source, mapping, [&name](const llvm::GlobalValue* value) {
+            return value->getName() == name || (llvm::isa<llvm::GlobalVariable>(value) && value->hasLocalLinkage());
+        });
+        hot->setModuleIdentifier(name + ".hot");
+        hot->getFunction(name)->setName(name + ".hot");
+
+        auto level = m_options.m_level == Options::Level::O0 ? Options::Level::O2 : m_options.m_level;
+        runPipeline(*hot, level, m_target_machine.get());
+    }
+
+    check(m_jit->addIRModule(llvm::orc::ThreadSafeModule(std::move(hot), m_context)), "Cannot add " + name);
+    auto optimized = check(m_jit->lookup(name + ".hot"), "Cannot compile " + name);
+    check(m_stubs->updatePointer(name, optimized.getAddress()), "Cannot update the stub of " + name);
+}
+
+} // namespace generator
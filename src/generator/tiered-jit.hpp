@@ -0,0 +1,66 @@
+#pragma once
+
+#include "generator.hpp"
+
+#include <llvm/ExecutionEngine/Orc/IndirectionUtils.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Target/TargetMachine.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace generator {
+
+/*
+ * Runs a program in two tiers on ORC.
+ *
+ * Every routine but main is first compiled without optimisations, and is
+ * called through an indirection stub. Its entry and its loop headers count
+ * into a counter of the routine. When that reaches Options::m_tier_threshold,
+ * a background thread compiles the routine alone at Options::m_level (O2 when
+ * that is O0) and points the stub at the result. Calls already running finish
+ * in the first tier, the next calls get the optimised code. main is entered
+ * once and so is never recompiled.
+*/
+struct TieredJit {
+    TieredJit(std::unique_ptr<llvm::Module> module, std::unique_ptr<llvm::LLVMContext> context, Options options);
+    ~TieredJit();
+
+    int run();
+
+    // called by the first tier, once per routine
+    static void onHot(TieredJit* self, uint32_t routine);
+
+private:
+    void instrument(llvm::Module& module);
+    void countAt(llvm::Instruction* where, llvm::GlobalVariable* counter, uint32_t routine, llvm::FunctionCallee hook);
+    void compileHot();
+    void recompile(const std::string& name);
+
+    Options m_options;
+    llvm::orc::ThreadSafeContext m_context;
+    // the program as generated, only touched with the context locked
+    std::unique_ptr<llvm::Module> m_source;
+    std::unique_ptr<llvm::Module> m_first_tier;
+    std::unique_ptr<llvm::TargetMachine> m_target_machine;
+    std::unique_ptr<llvm::orc::LLJIT> m_jit;
+    std::unique_ptr<llvm::orc::IndirectStubsManager> m_stubs;
+    // names of the tiered routines, by the number their counters report
+    std::vector<std::string> m_routines;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wakeup;
+    std::deque<uint32_t> m_hot;
+    bool m_stopping = false;
+    std::thread m_worker;
+};
+
+} // namespace generator
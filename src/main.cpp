@@ -1,30 +1,218 @@
+#include <charconv>
+#include <chrono>
 #include <cstdlib>
 #include <exception>
 #include <filesystem>
 #include <iostream>
+#include <optional>
+#include <spawn.h>
+#include <string>
+#include <string_view>
+#include <sys/wait.h>
+#include <unistd.h>
 #include <vector>
 
 #include "generator/generator.hpp"
+#include "generator/parallel-generator.hpp"
 
+#include "analyzer/strategies/constant-fold.hpp"
+#include "analyzer/strategies/dead-stores.hpp"
+#include "analyzer/strategies/evaluate-calls.hpp"
+#include "analyzer/strategies/effect-analysis.hpp"
+#include "analyzer/strategies/fuse-loops.hpp"
+#include "analyzer/strategies/hoist-invariants.hpp"
+#include "analyzer/strategies/if-conversion.hpp"
+#include "analyzer/strategies/inline-routines.hpp"
+#include "analyzer/strategies/range-analysis.hpp"
+#include "analyzer/strategies/remove-dead-declarations.hpp"
 #include "analyzer/strategies/remove-unreachable.hpp"
 #include "analyzer/strategies/remove-unused.hpp"
+#include "analyzer/strategies/specialize-routines.hpp"
+#include "analyzer/strategies/strength-reduction.hpp"
+#include "analyzer/strategies/tail-recursion.hpp"
 #include "analyzer/strategies/type-check.hpp"
+#include "analyzer/strategies/unswitch-loops.hpp"
 
 #include "analyzer/analyzer.hpp"
 #include "lexer/lexer.hpp"
 #include "parser/parser.hpp"
 #include "parser/visitor/print-visitor.hpp"
 
+/*
+ * Links the objects written by the generator against the C library,
+ * which provides printf, with the system compiler driver. It is started
+ * without a shell, so the paths need no quoting.
+*/
+static bool linkExecutable(const std::vector<std::string>& objects, const std::string& executable)
+{
+    const char* driver = std::getenv("CC");
+    std::vector<std::string> args { driver ? driver : "cc" };
+    args.insert(args.end(), objects.begin(), objects.end());
+    args.push_back("-o");
+    args.push_back(executable);
+
+    std::vector<char*> argv;
+    for (auto& arg : args)
+    {
+        argv.push_back(arg.data());
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid = 0;
+    int status = 0;
+    bool linked = posix_spawnp(&pid, argv.front(), nullptr, nullptr, argv.data(), environ) == 0
+        && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    for (auto& object : objects)
+    {
+        std::filesystem::remove(object);
+    }
+    return linked;
+}
+
 int main(int argc, char* argv[])
 {
-    // if (argc < 2)
-    // {
-    //     std::cerr << "Error: path to a source file is not provided\n";
-    //     return EXIT_FAILURE;
-    // }
-    // std::string source_file_path = argv[1];
-       std::string source_file_path = "/home/max/vscdir/tarsonis/tests/examples/record.tr";
-    // std::string source_file_path = "/home/nickolaus-sdr/compilers/Tarsonis-Compiler/tests/examples/routine_calls.tr";
+    std::string source_file_path;
+    size_t threads = 0;
+    bool split_codegen = false;
+    size_t codegen_threads = 0;
+    bool stats = false;
+    size_t opt_iterations = 8;
+    size_t opt_time_ms = 0;
+    generator::Options codegen;
+    std::string output_path;
+    bool executable = false;
+    bool run = false;
+    std::vector<std::string> objects;
+
+    // the value of a numeric flag, nothing after reporting it when it is not a number
+    auto number = [&](int& idx) -> std::optional<uint64_t>
+    {
+        std::string_view text = argv[++idx];
+        uint64_t value = 0;
+        auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (error != std::errc() || end != text.data() + text.size())
+        {
+            std::cerr << "Error: " << argv[idx - 1] << " takes a non-negative number, not \"" << text << "\"\n";
+            return std::nullopt;
+        }
+        return value;
+    };
+
+    for (int idx = 1; idx < argc; ++idx)
+    {
+        std::string arg = argv[idx];
+        if ((arg == "-j" || arg == "--jobs") && idx + 1 < argc)
+        {
+            auto value = number(idx);
+            if (!value)
+            {
+                return EXIT_FAILURE;
+            }
+            threads = *value;
+        }
+        else if (arg == "--codegen-jobs" && idx + 1 < argc)
+        {
+            split_codegen = true;
+            auto value = number(idx);
+            if (!value)
+            {
+                return EXIT_FAILURE;
+            }
+            codegen_threads = *value;
+        }
+        else if (arg == "--stats")
+        {
+            stats = true;
+        }
+        else if (arg == "--bounds-check")
+        {
+            codegen.m_bounds_check = true;
+        }
+        else if (arg == "-O0" || arg == "-O1" || arg == "-O2" || arg == "-O3" || arg == "-Os")
+        {
+            using Level = generator::Options::Level;
+            codegen.m_level = arg == "-O1" ? Level::O1
+                : arg == "-O2"             ? Level::O2
+                : arg == "-O3"             ? Level::O3
+                : arg == "-Os"             ? Level::Os
+                                           : Level::O0;
+        }
+        else if (arg == "--emit" && idx + 1 < argc)
+        {
+            using Emit = generator::Options::Emit;
+            std::string kind = argv[++idx];
+            if (kind != "ir" && kind != "asm" && kind != "obj" && kind != "exe")
+            {
+                std::cerr << "Error: --emit takes one of ir, asm, obj, exe\n";
+                return EXIT_FAILURE;
+            }
+            codegen.m_emit = kind == "asm" ? Emit::ASSEMBLY : kind == "ir" ? Emit::IR : Emit::OBJECT;
+            executable = kind == "exe";
+        }
+        else if (arg == "--run")
+        {
+            run = true;
+        }
+        else if (arg == "--tiered")
+        {
+            run = true;
+            codegen.m_tiered = true;
+        }
+        else if (arg == "--tier-threshold" && idx + 1 < argc)
+        {
+            auto value = number(idx);
+            if (!value)
+            {
+                return EXIT_FAILURE;
+            }
+            codegen.m_tier_threshold = *value;
+        }
+        else if (arg == "--stack-limit" && idx + 1 < argc)
+        {
+            auto value = number(idx);
+            if (!value)
+            {
+                return EXIT_FAILURE;
+            }
+            codegen.m_stack_limit = *value;
+        }
+        else if (arg == "-o" && idx + 1 < argc)
+        {
+            output_path = argv[++idx];
+        }
+        else if (arg == "--target" && idx + 1 < argc)
+        {
+            codegen.m_triple = argv[++idx];
+        }
+        else if (arg == "--opt-iterations" && idx + 1 < argc)
+        {
+            auto value = number(idx);
+            if (!value)
+            {
+                return EXIT_FAILURE;
+            }
+            opt_iterations = *value;
+        }
+        else if (arg == "--opt-time-ms" && idx + 1 < argc)
+        {
+            auto value = number(idx);
+            if (!value)
+            {
+                return EXIT_FAILURE;
+            }
+            opt_time_ms = *value;
+        }
+        else
+        {
+            source_file_path = arg;
+        }
+    }
+
+    if (source_file_path.empty())
+    {
+        std::cerr << "Error: path to a source file is not provided\n";
+        return EXIT_FAILURE;
+    }
 
     if (!std::filesystem::exists(source_file_path))
     {
@@ -32,6 +220,27 @@ int main(int argc, char* argv[])
         return EXIT_FAILURE;
     }
 
+    if (output_path.empty())
+    {
+        using Emit = generator::Options::Emit;
+        output_path = executable                    ? "output"
+            : codegen.m_emit == Emit::ASSEMBLY      ? "output.s"
+            : codegen.m_emit == Emit::OBJECT        ? "output.o"
+                                                    : "output.ll";
+    }
+    codegen.m_output = executable ? output_path + ".o" : output_path;
+    if (run)
+    {
+        codegen.m_emit = generator::Options::Emit::MEMORY;
+    }
+
+    // when running, standard output belongs to the program: the listings are dropped,
+    // and what the analysis reports goes to standard error
+    std::ostream dropped(nullptr);
+    std::ostream& listing = run ? dropped : std::cout;
+    std::ostream& reports = run ? std::cerr : std::cout;
+    codegen.m_listing = &listing;
+
     lexical::Lexer lexer(source_file_path);
     std::vector<Token> tokens;
     try
@@ -40,37 +249,87 @@ int main(int argc, char* argv[])
     }
     catch (const std::exception& err)
     {
-        std::cout << err.what() << '\n';
+        reports << err.what() << '\n';
         return EXIT_FAILURE;
     }
     for (int i = 0; i < tokens.size(); ++i)
     {
-        std::cout << i << ": \"" << (tokens[i].m_value == "\n" ? "newline" : tokens[i].m_value) << "\" "
-                  << tokens[i].m_id << "\n";
+        listing << i << ": \"" << (tokens[i].m_value == "\n" ? "newline" : tokens[i].m_value) << "\" "
+                << tokens[i].m_id << "\n";
     }
-    std::cout << "\n";
+    listing << "\n";
 
     try
     {
         auto parser = parsing::Parser(tokens);
         auto program_ast = parser.parse();
-        program_ast->accept(parsing::Printer{});
+        program_ast->accept(parsing::Printer{ listing });
 
         Analyzer(program_ast)
+            .withThreads(threads)
+            .withBudget(opt_iterations, std::chrono::milliseconds(opt_time_ms))
+            .withStats(stats)
+            .withReportsTo(reports)
             .withCheckOf<TypeCheck>()
+            .withOptimizationOf<EvaluateCalls>()
+            .withOptimizationOf<EliminateTailRecursion>()
+            .withOptimizationOf<InlineRoutines>()
+            .withOptimizationOf<SpecializeRoutines>()
+            .withOptimizationOf<RemoveDeadDeclarations>()
+            .withOptimizationOf<ConstantFold>()
             .withOptimizationOf<RemoveUnreachableCode>()
-            .withOptimizationOf<RemoveUnusedDeclarations>();
-        std::cout << "\n AFTER OPTIMIZATIONS: \n";
-        program_ast->accept(parsing::Printer{});
+            .withOptimizationOf<PropagateCopies>()
+            .withOptimizationOf<RemoveDeadStores>()
+            .withOptimizationOf<RemoveUnusedDeclarations>()
+            .withOptimizationOf<FuseLoops>()
+            .withOptimizationOf<HoistLoopInvariants>()
+            .withOptimizationOf<UnswitchLoops>()
+            .withOptimizationOf<StrengthReduction>()
+            .withOptimizationOf<RangeAnalysis>()
+            .withOptimizationOf<IfConversion>()
+            .withOptimizationOf<EffectAnalysis>()
+            .done();
+        listing << "\n AFTER OPTIMIZATIONS: \n";
+        program_ast->accept(parsing::Printer{ listing });
 
-        generator::Generator gen(program_ast);
-        gen.apply();
+        if (split_codegen && !run)
+        {
+            generator::ParallelGenerator gen(program_ast, codegen, codegen_threads);
+            if (executable)
+            {
+                objects = gen.writeObjects();
+            }
+            else
+            {
+                gen.apply();
+            }
+        }
+        else
+        {
+            generator::Generator gen(program_ast, codegen);
+            gen.apply();
+            if (run)
+            {
+                return gen.run();
+            }
+            objects.push_back(codegen.m_output);
+        }
     }
     catch (const std::exception& err)
     {
-        std::cout << err.what() << '\n';
+        reports << err.what() << '\n';
         return EXIT_FAILURE;
     }
 
+    if (executable)
+    {
+        if (!linkExecutable(objects, output_path))
+        {
+            std::cerr << "Error: linking " << output_path << " failed\n";
+            return EXIT_FAILURE;
+        }
+        std::cout << "Executable written to " << output_path << '\n';
+    }
+
     return EXIT_SUCCESS;
 }
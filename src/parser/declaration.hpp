@@ -265,7 +265,7 @@ public:
 
     std::shared_ptr<Type> m_type;
     std::shared_ptr<Expression> m_size;
-    int m_generated_size;
+    int m_generated_size = 0;
 
     bool isArray() override
     {
@@ -199,6 +199,9 @@ struct ArrayAccess : public Chained
 
     std::shared_ptr<Expression> access;
 
+    // set by the range analysis when the index can never be out of bounds
+    bool m_in_bounds = false;
+
     void check_has_field(
         std::shared_ptr<Declaration>& current_type,
         std::unordered_map<std::string, std::shared_ptr<Declaration>>& types) override
@@ -417,6 +420,10 @@ public:
 
     std::shared_ptr<Expression> m_left;
     std::shared_ptr<Expression> m_right;
+
+    // set by the strength reduction when both operands of an integer
+    // division are known to be non-negative
+    bool m_non_negative = false;
 };
 
 class Plus : public Math
@@ -576,6 +583,10 @@ public:
     explicit Logic() : Math()
     {
     }
+
+    // set by the if-conversion when the right operand may call or trap,
+    // it is then only evaluated when the left one does not decide
+    bool m_short_circuit = false;
 };
 
 class And : public Logic
@@ -8,6 +8,7 @@
 #include "std-function.hpp"
 #include <algorithm>
 #include <array>
+#include <charconv>
 #include <memory>
 #include <stdexcept>
 #include <vector>
@@ -895,6 +896,39 @@ std::shared_ptr<For> Parser::parse_for_statement()
     }
     advanceTok();
 
+    // optional hints after 'loop': 'vectorize' and 'unroll <count>', they are no keywords
+    while (currentTok().m_id == TOKEN_IDENTIFIER)
+    {
+        if (currentTok().m_value == "vectorize" && peekNextToken().m_id != TOKEN_ASSIGNMENT
+            && peekNextToken().m_id != TOKEN_LBRACKET && peekNextToken().m_id != TOKEN_DOT
+            && peekNextToken().m_id != TOKEN_LPAREN)
+        {
+            result->m_vectorize = true;
+            advanceTok();
+        }
+        else if (currentTok().m_value == "unroll" && peekNextToken().m_id == TOKEN_CONST_INT)
+        {
+            advanceTok();
+            std::string count = currentTok().m_value;
+            int value = 0;
+            auto [end, error] = std::from_chars(count.data(), count.data() + count.size(), value);
+            if (error != std::errc() || end != count.data() + count.size() || value <= 0)
+            {
+                throw std::runtime_error("unroll count must be a positive integer, not " + count);
+            }
+            result->m_unroll = value;
+            advanceTok();
+        }
+        else if (currentTok().m_value == "unroll" && peekNextToken().m_id == TOKEN_MINUS)
+        {
+            throw std::runtime_error("unroll count must be a positive integer");
+        }
+        else
+        {
+            break;
+        }
+    }
+
     result->m_body = parse_body();
 
     if (currentTok().m_id != TOKEN_END)
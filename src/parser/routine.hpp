@@ -7,6 +7,19 @@
 namespace parsing
 {
 
+/*
+ *  What a routine may do besides computing its result. UNKNOWN until the
+ *  effect analysis ran, the others go from harmless to observable.
+*/
+enum class Effects
+{
+    UNKNOWN,
+    NONE,
+    READS_ARGUMENTS,
+    WRITES_ARGUMENTS,
+    INPUT_OUTPUT
+};
+
 class Routine : public Declaration
 {
 public:
@@ -38,6 +51,10 @@ public:
     std::shared_ptr<Body> m_body;
     std::vector<std::shared_ptr<RoutineParameter>> m_params;
     std::string return_type;
+
+    // found by the effect analysis, the generator turns them into attributes
+    Effects m_effects = Effects::UNKNOWN;
+    bool m_will_return = false;
 };
 
 } // namespace parsing
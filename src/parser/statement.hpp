@@ -51,6 +51,10 @@ public:
     std::shared_ptr<Expression> m_condition;
     std::shared_ptr<Body> m_then;
     std::shared_ptr<Body> m_else;
+
+    // set by the if-conversion when both arms assign one variable
+    // and can be evaluated unconditionally, the generator emits a select
+    bool m_branchless = false;
 };
 
 class For : public Statement
@@ -89,6 +93,9 @@ public:
     std::shared_ptr<Range> m_range;
     std::shared_ptr<Body> m_body;
     std::shared_ptr<Variable> m_identifier;
+    // hints for the LLVM loop passes, written after 'loop'
+    bool m_vectorize = false;
+    int m_unroll = 0;
 };
 
 class While : public Statement
@@ -0,0 +1,289 @@
+#pragma once
+
+#include "abstract-visitor.hpp"
+
+#include "parser/AST-node.hpp"
+#include "parser/body.hpp"
+#include "parser/declaration.hpp"
+#include "parser/expression.hpp"
+#include "parser/return.hpp"
+#include "parser/routine.hpp"
+#include "parser/statement.hpp"
+#include "parser/std-function.hpp"
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+namespace parsing {
+
+/*
+ * Makes a deep copy of a subtree. Variables listed in m_renames
+ * (declarations, uses and for-loop iterators) get their new names
+ * in the copy, so it can be pasted into another scope.
+*/
+struct Cloner : public IVisitor {
+
+Cloner() = default;
+
+explicit Cloner(std::unordered_map<std::string, std::string> renames) : m_renames(std::move(renames)) {
+}
+
+template <typename T>
+std::shared_ptr<T> clone(const std::shared_ptr<T>& node) {
+    if (!node) {
+        return nullptr;
+    }
+    m_result.reset();
+    node->accept(*this);
+    auto copy = std::dynamic_pointer_cast<T>(m_result);
+    if (!copy) {
+        throw std::runtime_error("Can't clone the node");
+    }
+    return copy;
+}
+
+std::string rename(const std::string& name) const {
+    auto found = m_renames.find(name);
+    return found == m_renames.end() ? name : found->second;
+}
+
+static std::shared_ptr<Math> makeMath(GrammarUnit unit) {
+    switch (unit) {
+        case GrammarUnit::PLUS:
+            return std::make_shared<Plus>();
+        case GrammarUnit::MINUS:
+            return std::make_shared<Minus>();
+        case GrammarUnit::MULTIPLICATE:
+            return std::make_shared<Multiplication>();
+        case GrammarUnit::DIVISION:
+            return std::make_shared<Division>();
+        case GrammarUnit::MOD:
+            return std::make_shared<Mod>();
+        case GrammarUnit::GREATER:
+            return std::make_shared<Greater>();
+        case GrammarUnit::LESS:
+            return std::make_shared<Less>();
+        case GrammarUnit::GREATER_EQUAL:
+            return std::make_shared<GreaterEqual>();
+        case GrammarUnit::LESS_EQUAL:
+            return std::make_shared<LessEqual>();
+        case GrammarUnit::EQUAL:
+            return std::make_shared<Equal>();
+        case GrammarUnit::NOT_EQUAL:
+            return std::make_shared<NotEqual>();
+        case GrammarUnit::AND:
+            return std::make_shared<And>();
+        case GrammarUnit::OR:
+            return std::make_shared<Or>();
+        case GrammarUnit::XOR:
+            return std::make_shared<Xor>();
+        default:
+            throw std::runtime_error("Unknown operation to clone");
+    }
+}
+
+void visit(ASTNode& node) override {
+    throw std::runtime_error("Can't clone the node");
+}
+
+void visit(Program& node) override {
+    auto copy = std::make_shared<Program>();
+    for (auto& declaration : node.m_declarations) {
+        copy->m_declarations.push_back(clone(declaration));
+    }
+    m_result = copy;
+}
+
+void visit(Declaration& node) override {
+    throw std::runtime_error("Can't clone the declaration " + node.m_name);
+}
+
+void visit(Type& node) override {
+    // named types (primitives, records and aliases by name) are just references
+    m_result = std::make_shared<PrimitiveType>(node.m_name);
+}
+
+void visit(TypeAliasing& node) override {
+    m_result = std::make_shared<TypeAliasing>(clone(node.m_from), node.m_to);
+}
+
+void visit(ArrayType& node) override {
+    auto copy = std::make_shared<ArrayType>(clone(node.m_type), clone(node.m_size));
+    copy->m_generated_size = node.m_generated_size;
+    m_result = copy;
+}
+
+void visit(RecordType& node) override {
+    auto copy = std::make_shared<RecordType>(node.m_name);
+    for (auto& field : node.m_fields) {
+        copy->m_fields.push_back(clone(field));
+    }
+    m_result = copy;
+}
+
+void visit(Variable& node) override {
+    throw std::runtime_error("Can't clone the variable " + node.m_name);
+}
+
+void visit(ArrayVariable& node) override {
+    m_result = std::make_shared<ArrayVariable>(rename(node.m_name), clone(node.m_type));
+}
+
+void visit(PrimitiveVariable& node) override {
+    auto type = clone(node.m_type);
+    auto value = clone(node.m_value);
+    m_result = std::make_shared<PrimitiveVariable>(rename(node.m_name), type, value);
+}
+
+void visit(Body& node) override {
+    auto copy = std::make_shared<Body>();
+    for (auto& item : node.m_items) {
+        copy->m_items.push_back(clone(item));
+    }
+    m_result = copy;
+}
+
+void visit(Routine& node) override {
+    auto copy = std::make_shared<Routine>(node.m_name);
+    for (auto& param : node.m_params) {
+        copy->m_params.push_back(clone(param));
+    }
+    copy->return_type = node.return_type;
+    copy->m_body = clone(node.m_body);
+    m_result = copy;
+}
+
+void visit(RoutineCall& node) override {
+    auto copy = std::make_shared<RoutineCall>(node.m_routine_name);
+    for (auto& param : node.m_parameters) {
+        copy->m_parameters.push_back(clone(param));
+    }
+    m_result = copy;
+}
+
+void visit(StdFunction& node) override {
+    auto copy = std::make_shared<StdFunction>(node.m_routine_name);
+    for (auto& param : node.m_parameters) {
+        copy->m_parameters.push_back(clone(param));
+    }
+    m_result = copy;
+}
+
+void visit(RoutineCallResult& node) override {
+    auto copy = std::make_shared<RoutineCallResult>();
+    copy->m_routine_call = clone(node.m_routine_call);
+    m_result = copy;
+}
+
+void visit(RoutineParameter& node) override {
+    m_result = std::make_shared<RoutineParameter>(rename(node.m_name), node.m_type);
+}
+
+void visit(Statement& node) override {
+    throw std::runtime_error("Can't clone the statement");
+}
+
+void visit(Expression& node) override {
+    throw std::runtime_error("Can't clone the expression");
+}
+
+void visit(True&) override {
+    m_result = std::make_shared<True>();
+}
+
+void visit(False&) override {
+    m_result = std::make_shared<False>();
+}
+
+void visit(Math& node) override {
+    auto copy = makeMath(node.m_grammar);
+    copy->m_left = clone(node.m_left);
+    copy->m_right = clone(node.m_right);
+    m_result = copy;
+}
+
+void visit(Real& node) override {
+    m_result = std::make_shared<Real>(node.m_value);
+}
+
+void visit(Boolean& node) override {
+    m_result = std::make_shared<Boolean>(node.m_value);
+}
+
+void visit(Integer& node) override {
+    m_result = std::make_shared<Integer>(node.m_value);
+}
+
+void visit(Modifiable& node) override {
+    auto copy = std::make_shared<Modifiable>(rename(node.m_head_name));
+    for (auto& access : node.m_chain) {
+        copy->m_chain.push_back(clone(access));
+    }
+    m_result = copy;
+}
+
+void visit(ArrayAccess& node) override {
+    auto copy = std::make_shared<ArrayAccess>();
+    copy->access = clone(node.access);
+    m_result = copy;
+}
+
+void visit(RecordAccess& node) override {
+    auto copy = std::make_shared<RecordAccess>();
+    copy->identifier = node.identifier;
+    copy->m_record_type = node.m_record_type;
+    m_result = copy;
+}
+
+void visit(ReturnStatement& node) override {
+    m_result = std::make_shared<ReturnStatement>(clone(node.m_expr));
+}
+
+void visit(If& node) override {
+    auto copy = std::make_shared<If>();
+    copy->m_condition = clone(node.m_condition);
+    copy->m_then = clone(node.m_then);
+    copy->m_else = clone(node.m_else);
+    m_result = copy;
+}
+
+void visit(Range& node) override {
+    auto copy = std::make_shared<Range>();
+    copy->m_reverse = node.m_reverse;
+    copy->m_begin = clone(node.m_begin);
+    copy->m_end = clone(node.m_end);
+    m_result = copy;
+}
+
+void visit(For& node) override {
+    auto copy = std::make_shared<For>();
+    copy->m_identifier = clone(node.m_identifier);
+    copy->m_range = clone(node.m_range);
+    copy->m_body = clone(node.m_body);
+    copy->m_vectorize = node.m_vectorize;
+    copy->m_unroll = node.m_unroll;
+    m_result = copy;
+}
+
+void visit(While& node) override {
+    auto copy = std::make_shared<While>();
+    copy->m_condition = clone(node.m_condition);
+    copy->m_body = clone(node.m_body);
+    m_result = copy;
+}
+
+void visit(Assignment& node) override {
+    auto copy = std::make_shared<Assignment>();
+    copy->m_modifiable = clone(node.m_modifiable);
+    copy->m_expression = clone(node.m_expression);
+    m_result = copy;
+}
+
+std::unordered_map<std::string, std::string> m_renames;
+std::shared_ptr<ASTNode> m_result;
+
+};
+
+}  // namespace parsing
@@ -13,8 +13,6 @@
 
 namespace parsing {
 
-using std::cout;
-
 struct nest {
     int nest = 0;
     struct nest operator++() {
@@ -36,22 +34,24 @@ std::ostream& operator<<(std::ostream& os, const nest& n) {
 
 struct Printer : public IVisitor {
 
+explicit Printer(std::ostream& out = std::cout) : m_out(out) {}
+
 /*
  * Consider bringing this to CRTP.
 */
 void visit(ASTNode& node) override {
-    cout << "Some AST-Node, the default print function\n";
+    m_out << "Some AST-Node, the default print function\n";
     // this enables double-dispatching in our code.
     node.accept(*this);
 }
 
 void visit(Program& node) override {
-    cout << "Beginning of the Program:\n";
+    m_out << "Beginning of the Program:\n";
     for (auto& declaration : node.m_declarations)
     {
         declaration->accept(*this);
     }
-    cout << "End of the program\n";
+    m_out << "End of the program\n";
 }
 
 void visit(Declaration& node) override {
@@ -59,18 +59,18 @@ void visit(Declaration& node) override {
 }
 
 void visit(Type& node) override {
-    cout << "type: " << node.m_name;
+    m_out << "type: " << node.m_name;
 }
 
 void visit(TypeAliasing& node) override {
-    cout << m_nest << "type: " << node.m_from->m_name << " as " << node.m_to << '\n';
+    m_out << m_nest << "type: " << node.m_from->m_name << " as " << node.m_to << '\n';
 }
 
 void visit(ArrayType& node) override {
     node.m_type->accept(*this);
-    cout << "[";
+    m_out << "[";
     node.m_size->accept(*this); 
-    cout << "]";
+    m_out << "]";
 }
 
 void visit(Variable& node) override {
@@ -78,64 +78,64 @@ void visit(Variable& node) override {
 }
 
 void visit(ArrayVariable& node) override {
-    std::cout << m_nest << node.m_name << " ";
+    m_out << m_nest << node.m_name << " ";
     node.m_type->accept(*this);
-    std::cout << "\n";
+    m_out << "\n";
 }
 
 void visit(PrimitiveVariable& node) override {
-    cout << m_nest << "var: " << node.m_name << " " << "type: " << node.m_type->m_name;
+    m_out << m_nest << "var: " << node.m_name << " " << "type: " << node.m_type->m_name;
     if (node.m_value.get())
     {
-        std::cout << " = ";
+        m_out << " = ";
         node.m_value->accept(*this);
     }
-    cout << "\n";
+    m_out << "\n";
 }
 
 void visit(Body& node) override {
-    std::cout << m_nest << "{\n";
+    m_out << m_nest << "{\n";
     ++m_nest;
     for (auto& item : node.m_items)
     {
         item->accept(*this);
     }
     --m_nest;
-    std::cout << m_nest << "}\n";
+    m_out << m_nest << "}\n";
 }
 
 void visit(Routine& node) override {
-    cout << "function declaration, name: " << node.m_name << " -> " << (node.return_type.empty() ? "void" : node.return_type)
+    m_out << "function declaration, name: " << node.m_name << " -> " << (node.return_type.empty() ? "void" : node.return_type)
             << '\n';
     node.m_body->accept(*this);
 
-    cout << "\n";
+    m_out << "\n";
 }
 
 void visit(RoutineCall& node) override {
-    cout << m_nest << node.m_routine_name << " ( ";
+    m_out << m_nest << node.m_routine_name << " ( ";
 
     for (auto& par : node.m_parameters)
     {
         par->accept(*this);
-        cout << ", ";
+        m_out << ", ";
     }
-    cout << ") \n";
+    m_out << ") \n";
 }
 
 void visit(RoutineCallResult& node) override {
-    cout << node.m_routine_call->m_routine_name << " ( ";
+    m_out << node.m_routine_call->m_routine_name << " ( ";
 
     for (auto& par : node.m_routine_call->m_parameters)
     {
         par->accept(*this);
-        cout << ", ";
+        m_out << ", ";
     }
-    cout << ") ";
+    m_out << ") ";
 }
 
 void visit(RoutineParameter& node) override {
-    cout << node.m_name << " " << node.m_type;
+    m_out << node.m_name << " " << node.m_type;
 }
 
 void visit(Statement& node) override {
@@ -147,40 +147,40 @@ void visit(Expression& node) override {
 }
 
 void visit(True&) override {
-    cout << "True";
+    m_out << "True";
 }
 
 void visit(False&) override {
-    cout << "False";
+    m_out << "False";
 }
 
 void visit(Math& node) override {
-    std::cout << node.gr_to_str() << " with params: {" << std::to_string(static_cast<int>(node.m_grammar))
+    m_out << node.gr_to_str() << " with params: {" << std::to_string(static_cast<int>(node.m_grammar))
                 << "::";
 
-    std::cout << " ";
+    m_out << " ";
     node.m_left->accept(*this);
 
-    std::cout << ", ";
+    m_out << ", ";
     node.m_right->accept(*this);
 
-    std::cout << " ::" << std::to_string(static_cast<int>(node.m_grammar)) << "}";
+    m_out << " ::" << std::to_string(static_cast<int>(node.m_grammar)) << "}";
 }
 
 void visit(Real& node) override {
-    cout << "real: " << node.m_value;
+    m_out << "real: " << node.m_value;
 }
 
 void visit(Boolean& node) override {
-    std::cout << "bool: " << node.m_value;
+    m_out << "bool: " << node.m_value;
 }
 
 void visit(Integer& node) override {
-    std::cout << "int: " << node.m_value;
+    m_out << "int: " << node.m_value;
 }
 
 void visit(Modifiable& node) override {
-    std::cout << node.m_head_name;
+    m_out << node.m_head_name;
     for (auto& chain : node.m_chain)
     {
         chain->accept(*this);
@@ -188,93 +188,102 @@ void visit(Modifiable& node) override {
 }
 
 void visit(ArrayAccess& node) override {
-    std::cout << "[ ";
+    m_out << "[ ";
     node.access->accept(*this);
-    std::cout << " ]";
+    m_out << " ]";
 }
 
 void visit(RecordAccess& node) override {
-    cout << "." + node.identifier;
+    m_out << "." + node.identifier;
 }
 
 void visit(ReturnStatement& node) override {
-    std::cout << m_nest << "RETURN "; 
+    m_out << m_nest << "RETURN "; 
     node.m_expr->accept(*this); 
-    std::cout << "\n";
+    m_out << "\n";
 }
 
 void visit(If& node) override {
-    std::cout << m_nest << "if ";
+    m_out << m_nest << "if ";
     node.m_condition->accept(*this);
-    std::cout << "\n";
+    m_out << "\n";
 
     node.m_then->accept(*this);
 
     if (node.m_else.get())
     {
-        std::cout << m_nest << "else \n";
+        m_out << m_nest << "else \n";
         node.m_else->accept(*this);
     }
 }
 
 void visit(Range& node) override {
-    std::cout << "in range";
+    m_out << "in range";
     if (node.m_reverse)
     {
-        std::cout << " (reverse)";
+        m_out << " (reverse)";
     }
-    std::cout << ": ";
+    m_out << ": ";
 
     node.m_begin->accept(*this);
-    std::cout << " .. ";
+    m_out << " .. ";
     node.m_end->accept(*this);
 }
 
 void visit(For& node) override {
-    cout << m_nest << "for ";
-    cout << node.m_identifier->m_name;
-    cout << " in ";
+    m_out << m_nest << "for ";
+    m_out << node.m_identifier->m_name;
+    m_out << " in ";
     node.m_range->accept(*this);
-    cout << "\n";
+    if (node.m_vectorize)
+    {
+        m_out << " vectorize";
+    }
+    if (node.m_unroll)
+    {
+        m_out << " unroll " << node.m_unroll;
+    }
+    m_out << "\n";
     node.m_body->accept(*this);
 }
 
 void visit(While& node) override {
-    std::cout << m_nest << "while ";
+    m_out << m_nest << "while ";
     node.m_condition->accept(*this);
     node.m_body->accept(*this);
 }
 
 void visit(Assignment& node) override {
-    std::cout << m_nest;
+    m_out << m_nest;
     node.m_modifiable->accept(*this);
-    std::cout << " = ";
+    m_out << " = ";
     node.m_expression->accept(*this);
-    std::cout << "\n";
+    m_out << "\n";
 }
 
 void visit(RecordType& node) override {
-    cout << "RECORD " << node.m_name << " { \n";
+    m_out << "RECORD " << node.m_name << " { \n";
     for (auto& field : node.m_fields)
     {
-        cout << "  ";
+        m_out << "  ";
         field->accept(*this);
     }
-    cout << "} \n";
+    m_out << "} \n";
 }
 
 void visit(StdFunction& node) override {
-    cout << m_nest << "std::" << node.m_routine_name << " ( ";
+    m_out << m_nest << "std::" << node.m_routine_name << " ( ";
 
     for (auto& par : node.m_parameters)
     {
         par->accept(*this);
-        cout << ", ";
+        m_out << ", ";
     }
-    cout << ") \n";
+    m_out << ") \n";
 }
 
     nest m_nest;
+    std::ostream& m_out;
 };
 
 }  // namespace parsing
@@ -0,0 +1,171 @@
+#pragma once
+
+#include "abstract-visitor.hpp"
+
+#include "parser/AST-node.hpp"
+#include "parser/body.hpp"
+#include "parser/declaration.hpp"
+#include "parser/expression.hpp"
+#include "parser/return.hpp"
+#include "parser/routine.hpp"
+#include "parser/statement.hpp"
+#include "parser/std-function.hpp"
+
+namespace parsing {
+
+/*
+ * Walks every child of every node and does nothing else.
+ * Analyses override the nodes they care about and call
+ * RecursiveVisitor::visit(node) to keep descending.
+*/
+struct RecursiveVisitor : public IVisitor {
+
+void visit(ASTNode& node) override {
+}
+
+void visit(Program& node) override {
+    for (auto& declaration : node.m_declarations) {
+        declaration->accept(*this);
+    }
+}
+
+void visit(Declaration& node) override {
+}
+
+void visit(Type& node) override {
+}
+
+void visit(TypeAliasing& node) override {
+    node.m_from->accept(*this);
+}
+
+void visit(ArrayType& node) override {
+    node.m_type->accept(*this);
+    node.m_size->accept(*this);
+}
+
+void visit(RecordType& node) override {
+    for (auto& field : node.m_fields) {
+        field->accept(*this);
+    }
+}
+
+void visit(Variable& node) override {
+}
+
+void visit(ArrayVariable& node) override {
+    node.m_type->accept(*this);
+}
+
+void visit(PrimitiveVariable& node) override {
+    if (node.m_value) {
+        node.m_value->accept(*this);
+    }
+}
+
+void visit(Body& node) override {
+    for (auto& item : node.m_items) {
+        item->accept(*this);
+    }
+}
+
+void visit(Routine& node) override {
+    for (auto& param : node.m_params) {
+        param->accept(*this);
+    }
+    node.m_body->accept(*this);
+}
+
+void visit(RoutineCall& node) override {
+    for (auto& param : node.m_parameters) {
+        param->accept(*this);
+    }
+}
+
+void visit(StdFunction& node) override {
+    for (auto& param : node.m_parameters) {
+        param->accept(*this);
+    }
+}
+
+void visit(RoutineCallResult& node) override {
+    node.m_routine_call->accept(*this);
+}
+
+void visit(RoutineParameter& node) override {
+}
+
+void visit(Statement& node) override {
+}
+
+void visit(Expression& node) override {
+}
+
+void visit(True&) override {
+}
+
+void visit(False&) override {
+}
+
+void visit(Math& node) override {
+    node.m_left->accept(*this);
+    node.m_right->accept(*this);
+}
+
+void visit(Real& node) override {
+}
+
+void visit(Boolean& node) override {
+}
+
+void visit(Integer& node) override {
+}
+
+void visit(Modifiable& node) override {
+    for (auto& access : node.m_chain) {
+        access->accept(*this);
+    }
+}
+
+void visit(ArrayAccess& node) override {
+    node.access->accept(*this);
+}
+
+void visit(RecordAccess& node) override {
+}
+
+void visit(ReturnStatement& node) override {
+    node.m_expr->accept(*this);
+}
+
+void visit(If& node) override {
+    node.m_condition->accept(*this);
+    node.m_then->accept(*this);
+    if (node.m_else) {
+        node.m_else->accept(*this);
+    }
+}
+
+void visit(Range& node) override {
+    node.m_begin->accept(*this);
+    node.m_end->accept(*this);
+}
+
+void visit(For& node) override {
+    node.m_range->accept(*this);
+    node.m_body->accept(*this);
+}
+
+void visit(While& node) override {
+    node.m_condition->accept(*this);
+    node.m_body->accept(*this);
+}
+
+void visit(Assignment& node) override {
+    node.m_modifiable->accept(*this);
+    node.m_expression->accept(*this);
+}
+
+};
+
+}  // namespace parsing
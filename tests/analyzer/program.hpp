@@ -0,0 +1,42 @@
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include "lexer/lexer.hpp"
+#include "parser/AST-node.hpp"
+#include "parser/parser.hpp"
+#include "parser/routine.hpp"
+
+/*
+ *  Parses a program given as source text, the lexer only reads files.
+*/
+inline std::shared_ptr<parsing::Program> parseProgram(const std::string& source)
+{
+    auto path = std::filesystem::temp_directory_path()
+        / (std::string(::testing::UnitTest::GetInstance()->current_test_info()->name()) + ".tr");
+    {
+        std::ofstream file(path);
+        file << source;
+    }
+    auto tokens = lexical::Lexer(path.string()).parse();
+    std::filesystem::remove(path);
+    return parsing::Parser(tokens).parse();
+}
+
+inline std::shared_ptr<parsing::Routine> findRoutine(parsing::Program& program, const std::string& name)
+{
+    for (auto& decl : program.m_declarations)
+    {
+        auto routine = std::dynamic_pointer_cast<parsing::Routine>(decl);
+        if (routine && routine->m_name == name)
+        {
+            return routine;
+        }
+    }
+    return nullptr;
+}
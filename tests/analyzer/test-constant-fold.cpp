@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+
+#include "analyzer/strategies/constant-fold.hpp"
+#include "program.hpp"
+
+// folds f, the expression of the `return` that ends it
+static std::shared_ptr<parsing::Expression> foldedResult(std::shared_ptr<parsing::Program> program)
+{
+    auto routine = findRoutine(*program, "f");
+    ConstantFold(program).apply(*routine);
+    auto ret = std::dynamic_pointer_cast<parsing::ReturnStatement>(routine->m_body->m_items.back());
+    return ret ? ret->m_expr : nullptr;
+}
+
+static int folded(std::shared_ptr<parsing::Program> program)
+{
+    auto literal = std::dynamic_pointer_cast<parsing::Integer>(foldedResult(program));
+    EXPECT_TRUE(literal != nullptr) << "the result was not folded to an integer";
+    return literal ? literal->m_value : 0;
+}
+
+TEST(ConstantFoldTest, FoldsArithmeticLikeTheGenerator)
+{
+    EXPECT_EQ(folded(parseProgram("routine f() -> integer is\n"
+                                  "    return 2 + 3 * 4 - (10 / 3) % 2;\n"
+                                  "end\n")),
+              13);
+    // 32-bit wrap-around, as the generated add does
+    EXPECT_EQ(folded(parseProgram("routine f() -> integer is\n"
+                                  "    return 2147483647 + 1;\n"
+                                  "end\n")),
+              -2147483647 - 1);
+}
+
+TEST(ConstantFoldTest, PropagatesInitialisersAndTakesConstantBranches)
+{
+    EXPECT_EQ(folded(parseProgram("routine f() -> integer is\n"
+                                  "    var x: integer is 6;\n"
+                                  "    var y: integer is x * 7;\n"
+                                  "    return y;\n"
+                                  "end\n")),
+              42);
+
+    auto program = parseProgram("routine f() -> integer is\n"
+                                "    var r: integer is 1;\n"
+                                "    if 3 > 4 then\n"
+                                "        r := 2;\n"
+                                "    end\n"
+                                "    return r;\n"
+                                "end\n");
+    foldedResult(program);
+    for (auto& item : findRoutine(*program, "f")->m_body->m_items)
+    {
+        EXPECT_EQ(dynamic_cast<parsing::If*>(item.get()), nullptr);
+    }
+}
+
+TEST(ConstantFoldTest, LeavesTrappingDivisionsAlone)
+{
+    for (std::string expression : { "((0 - 2147483647) - 1) / (0 - 1)", "((0 - 2147483647) - 1) % (0 - 1)",
+                                    "7 / 0", "7 % (3 - 3)" })
+    {
+        auto result = foldedResult(parseProgram("routine f() -> integer is\n"
+                                                "    return " + expression + ";\n"
+                                                "end\n"));
+        EXPECT_TRUE(std::dynamic_pointer_cast<parsing::Math>(result) != nullptr) << expression << " was folded";
+    }
+}
+
+TEST(ConstantFoldTest, LeavesAssignedVariablesAlone)
+{
+    auto result = foldedResult(parseProgram("routine f(integer n) -> integer is\n"
+                                            "    var x: integer is 6;\n"
+                                            "    if n > 0 then\n"
+                                            "        x := n;\n"
+                                            "    end\n"
+                                            "    return x;\n"
+                                            "end\n"));
+    EXPECT_TRUE(std::dynamic_pointer_cast<parsing::Modifiable>(result) != nullptr);
+}
@@ -0,0 +1,174 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "analyzer/evaluator.hpp"
+#include "analyzer/strategies/dead-stores.hpp"
+#include "program.hpp"
+
+using folding::Constant;
+
+// results of f for n in [-2, 5), f must be evaluable
+static std::vector<int> results(std::shared_ptr<parsing::Program> program)
+{
+    evaluation::Interpreter interpreter(program);
+    std::vector<int> values;
+    for (int n = -2; n < 5; ++n)
+    {
+        auto value = interpreter.call("f", { Constant::ofInteger(n) });
+        EXPECT_TRUE(value.has_value()) << interpreter.m_failure;
+        values.push_back(value ? value->m_int : 0);
+    }
+    return values;
+}
+
+// the name `return <name>;` at the end of f reads
+static std::string returned(parsing::Program& program)
+{
+    auto ret = std::dynamic_pointer_cast<parsing::ReturnStatement>(findRoutine(program, "f")->m_body->m_items.back());
+    auto read = std::dynamic_pointer_cast<parsing::Modifiable>(ret->m_expr);
+    return read ? read->m_head_name : "";
+}
+
+// applies the pass to f and checks that f computes the same
+template <typename Pass>
+static bool transform(std::shared_ptr<parsing::Program> program)
+{
+    auto before = results(program);
+    bool changed = Pass(program).apply(*findRoutine(*program, "f"));
+    EXPECT_EQ(results(program), before);
+    return changed;
+}
+
+TEST(PropagateCopiesTest, PropagatesInStraightLineCode)
+{
+    auto program = parseProgram("routine f(integer n) -> integer is\n"
+                                "    var y: integer is n * 2;\n"
+                                "    var x: integer is y;\n"
+                                "    return x;\n"
+                                "end\n");
+    EXPECT_TRUE(transform<PropagateCopies>(program));
+    EXPECT_EQ(returned(*program), "y");
+}
+
+TEST(PropagateCopiesTest, LoopsForgetCopiesTheyBreak)
+{
+    auto program = parseProgram("routine f(integer n) -> integer is\n"
+                                "    var s: integer is 0;\n"
+                                "    var y: integer is n;\n"
+                                "    var x: integer is y;\n"
+                                "    for i in 0 .. 3 loop\n"
+                                "        s := s + x;\n"
+                                "        y := y + 1;\n"
+                                "    end\n"
+                                "    return x;\n"
+                                "end\n");
+    transform<PropagateCopies>(program);
+    // y changed in the loop, x still holds its old value, which is n
+    EXPECT_NE(returned(*program), "y");
+
+    program = parseProgram("routine f(integer n) -> integer is\n"
+                           "    var s: integer is 0;\n"
+                           "    var x: integer is n;\n"
+                           "    for i in 0 .. 3 loop\n"
+                           "        s := s + x;\n"
+                           "        x := s;\n"
+                           "    end\n"
+                           "    return s;\n"
+                           "end\n");
+    transform<PropagateCopies>(program);
+}
+
+TEST(PropagateCopiesTest, KeepsCopiesKnownOnBothArms)
+{
+    auto program = parseProgram("routine f(integer n) -> integer is\n"
+                                "    var y: integer is n + 1;\n"
+                                "    var x: integer is 0;\n"
+                                "    if n > 0 then\n"
+                                "        x := y;\n"
+                                "    else\n"
+                                "        x := y;\n"
+                                "    end\n"
+                                "    return x;\n"
+                                "end\n");
+    EXPECT_TRUE(transform<PropagateCopies>(program));
+    EXPECT_EQ(returned(*program), "y");
+
+    program = parseProgram("routine f(integer n) -> integer is\n"
+                           "    var y: integer is n + 1;\n"
+                           "    var x: integer is 0;\n"
+                           "    if n > 0 then\n"
+                           "        x := y;\n"
+                           "    end\n"
+                           "    return x;\n"
+                           "end\n");
+    transform<PropagateCopies>(program);
+    EXPECT_EQ(returned(*program), "x");
+}
+
+TEST(RemoveDeadStoresTest, RemovesOverwrittenStores)
+{
+    auto program = parseProgram("routine f(integer n) -> integer is\n"
+                                "    var x: integer is n;\n"
+                                "    x := n + 1;\n"
+                                "    x := n + 2;\n"
+                                "    return x;\n"
+                                "end\n");
+    EXPECT_TRUE(transform<RemoveDeadStores>(program));
+    EXPECT_EQ(findRoutine(*program, "f")->m_body->m_items.size(), 3);
+}
+
+TEST(RemoveDeadStoresTest, KeepsStoresReadByTheNextIteration)
+{
+    auto program = parseProgram("routine f(integer n) -> integer is\n"
+                                "    var s: integer is 0;\n"
+                                "    var x: integer is 0;\n"
+                                "    for i in 0 .. 4 loop\n"
+                                "        s := s + x;\n"
+                                "        x := i + n;\n"
+                                "    end\n"
+                                "    return s;\n"
+                                "end\n");
+    EXPECT_FALSE(transform<RemoveDeadStores>(program));
+}
+
+TEST(RemoveDeadStoresTest, RemovesStoresOverwrittenInLoops)
+{
+    auto program = parseProgram("routine f(integer n) -> integer is\n"
+                                "    var s: integer is 0;\n"
+                                "    var x: integer is 0;\n"
+                                "    for i in 0 .. 4 loop\n"
+                                "        x := i;\n"
+                                "        x := i + n;\n"
+                                "        s := s + x;\n"
+                                "    end\n"
+                                "    return s;\n"
+                                "end\n");
+    EXPECT_TRUE(transform<RemoveDeadStores>(program));
+}
+
+TEST(RemoveDeadStoresTest, NeedsBothArmsToOverwrite)
+{
+    auto program = parseProgram("routine f(integer n) -> integer is\n"
+                                "    var x: integer;\n"
+                                "    x := n;\n"
+                                "    if n > 0 then\n"
+                                "        x := 1;\n"
+                                "    end\n"
+                                "    return x;\n"
+                                "end\n");
+    EXPECT_FALSE(transform<RemoveDeadStores>(program));
+
+    program = parseProgram("routine f(integer n) -> integer is\n"
+                           "    var x: integer;\n"
+                           "    x := n;\n"
+                           "    if n > 0 then\n"
+                           "        x := 1;\n"
+                           "    else\n"
+                           "        x := 2;\n"
+                           "    end\n"
+                           "    return x;\n"
+                           "end\n");
+    EXPECT_TRUE(transform<RemoveDeadStores>(program));
+}
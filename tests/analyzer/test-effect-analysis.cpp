@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+
+#include "analyzer/strategies/effect-analysis.hpp"
+#include "program.hpp"
+
+using parsing::Effects;
+
+static const char* source = "type A is array[4] integer;\n"
+                            "routine pure(integer x) -> integer is\n"
+                            "    var s: integer is 0;\n"
+                            "    for i in 0 .. x loop\n"
+                            "        s := s + i;\n"
+                            "    end\n"
+                            "    return s;\n"
+                            "end\n"
+                            "routine first(A a) -> integer is\n"
+                            "    return a[0];\n"
+                            "end\n"
+                            "routine clear(A a) is\n"
+                            "    a[0] := pure(3);\n"
+                            "end\n"
+                            "routine show(integer x) is\n"
+                            "    print(x);\n"
+                            "end\n"
+                            "routine caller(integer x) -> integer is\n"
+                            "    show(pure(x));\n"
+                            "    return x;\n"
+                            "end\n"
+                            "routine spin(integer x) -> integer is\n"
+                            "    while x > 0 loop\n"
+                            "        x := x - 2;\n"
+                            "    end\n"
+                            "    return x;\n"
+                            "end\n"
+                            "routine spinCaller(integer x) -> integer is\n"
+                            "    return spin(x) + 1;\n"
+                            "end\n"
+                            "routine fact(integer n) -> integer is\n"
+                            "    if n <= 1 then\n"
+                            "        return 1;\n"
+                            "    end\n"
+                            "    return n * fact(n - 1);\n"
+                            "end\n"
+                            "routine even(integer n) -> boolean is\n"
+                            "    if n <= 0 then\n"
+                            "        return true;\n"
+                            "    end\n"
+                            "    return odd(n - 1);\n"
+                            "end\n"
+                            "routine odd(integer n) -> boolean is\n"
+                            "    if n <= 0 then\n"
+                            "        return false;\n"
+                            "    end\n"
+                            "    return even(n - 1);\n"
+                            "end\n";
+
+// runs the analysis over the source above
+static std::shared_ptr<parsing::Program> analysed()
+{
+    auto program = parseProgram(source);
+    EXPECT_TRUE(EffectAnalysis(program).apply().m_changed);
+    return program;
+}
+
+TEST(EffectAnalysisTest, ClassifiesWhatRoutinesTouch)
+{
+    auto program = analysed();
+    EXPECT_EQ(findRoutine(*program, "pure")->m_effects, Effects::NONE);
+    EXPECT_EQ(findRoutine(*program, "first")->m_effects, Effects::READS_ARGUMENTS);
+    EXPECT_EQ(findRoutine(*program, "clear")->m_effects, Effects::WRITES_ARGUMENTS);
+    EXPECT_EQ(findRoutine(*program, "show")->m_effects, Effects::INPUT_OUTPUT);
+    // printing is seen through calls
+    EXPECT_EQ(findRoutine(*program, "caller")->m_effects, Effects::INPUT_OUTPUT);
+}
+
+TEST(EffectAnalysisTest, OnlyLoopFreeNonRecursiveRoutinesSurelyReturn)
+{
+    auto program = analysed();
+    EXPECT_TRUE(findRoutine(*program, "pure")->m_will_return);
+    EXPECT_TRUE(findRoutine(*program, "clear")->m_will_return);
+    EXPECT_TRUE(findRoutine(*program, "caller")->m_will_return);
+
+    EXPECT_FALSE(findRoutine(*program, "spin")->m_will_return);
+    EXPECT_FALSE(findRoutine(*program, "spinCaller")->m_will_return);
+    EXPECT_FALSE(findRoutine(*program, "fact")->m_will_return);
+    EXPECT_FALSE(findRoutine(*program, "even")->m_will_return);
+    EXPECT_FALSE(findRoutine(*program, "odd")->m_will_return);
+}
+
+TEST(EffectAnalysisTest, SettlesInOneRun)
+{
+    auto program = analysed();
+    EXPECT_FALSE(EffectAnalysis(program).apply().m_changed);
+}
@@ -0,0 +1,186 @@
+#include <gtest/gtest.h>
+#include <string>
+
+#include "analyzer/evaluator.hpp"
+#include "program.hpp"
+
+using evaluation::Interpreter;
+using folding::Constant;
+
+TEST(InterpreterTest, EvaluatesLoops)
+{
+    auto program = parseProgram("routine sum(integer n) -> integer is\n"
+                                "    var s: integer is 0;\n"
+                                "    for i in 0 .. n loop\n"
+                                "        s := s + i;\n"
+                                "    end\n"
+                                "    return s;\n"
+                                "end\n");
+    Interpreter interpreter(program);
+    auto result = interpreter.call("sum", { Constant::ofInteger(10) });
+    ASSERT_TRUE(result.has_value());
+    EXPECT_EQ(result->m_int, 45);
+    EXPECT_EQ(interpreter.m_failure, "");
+}
+
+TEST(InterpreterTest, StopsAfterTooManySteps)
+{
+    auto program = parseProgram("routine sum(integer n) -> integer is\n"
+                                "    var s: integer is 0;\n"
+                                "    for i in 0 .. n loop\n"
+                                "        s := s + i;\n"
+                                "    end\n"
+                                "    return s;\n"
+                                "end\n");
+    Interpreter interpreter(program);
+    interpreter.m_limits.m_max_steps = 100;
+    EXPECT_FALSE(interpreter.call("sum", { Constant::ofInteger(1000) }).has_value());
+    EXPECT_EQ(interpreter.m_failure, "too many steps");
+
+    // the limit is per call
+    EXPECT_TRUE(interpreter.call("sum", { Constant::ofInteger(5) }).has_value());
+    EXPECT_EQ(interpreter.m_failure, "");
+}
+
+TEST(InterpreterTest, StopsTooDeepRecursion)
+{
+    auto program = parseProgram("routine down(integer n) -> integer is\n"
+                                "    if n <= 0 then\n"
+                                "        return 0;\n"
+                                "    end\n"
+                                "    return down(n - 1) + 1;\n"
+                                "end\n");
+    Interpreter interpreter(program);
+    interpreter.m_limits.m_max_depth = 8;
+    EXPECT_TRUE(interpreter.call("down", { Constant::ofInteger(7) }).has_value());
+    EXPECT_FALSE(interpreter.call("down", { Constant::ofInteger(8) }).has_value());
+    EXPECT_EQ(interpreter.m_failure, "too deep");
+}
+
+TEST(InterpreterTest, StopsAtTooMuchMemory)
+{
+    auto program = parseProgram("routine big() -> integer is\n"
+                                "    var a: array[100000] integer;\n"
+                                "    a[1] := 1;\n"
+                                "    return a[1];\n"
+                                "end\n");
+    Interpreter interpreter(program);
+    EXPECT_FALSE(interpreter.call("big", {}).has_value());
+    EXPECT_EQ(interpreter.m_failure, "too much memory");
+}
+
+TEST(InterpreterTest, ReportsWhyCallsAreUnevaluable)
+{
+    auto program = parseProgram("type Point is record\n"
+                                "    var x: integer\n"
+                                "    var y: integer\n"
+                                "end\n"
+                                "\n"
+                                "routine loud(integer n) -> integer is\n"
+                                "    print(n);\n"
+                                "    return n;\n"
+                                "end\n"
+                                "\n"
+                                "routine unset() -> integer is\n"
+                                "    var x: integer;\n"
+                                "    return x;\n"
+                                "end\n"
+                                "\n"
+                                "routine mk(integer n) -> Point is\n"
+                                "    var p: Point;\n"
+                                "    p.x := n;\n"
+                                "    p.y := n;\n"
+                                "    return p;\n"
+                                "end\n");
+    Interpreter interpreter(program);
+    EXPECT_FALSE(interpreter.call("loud", { Constant::ofInteger(1) }).has_value());
+    EXPECT_EQ(interpreter.m_failure, "prints");
+
+    EXPECT_FALSE(interpreter.call("unset", {}).has_value());
+    EXPECT_EQ(interpreter.m_failure, "reads x before it is set");
+
+    // the reason of the previous failure must not stick
+    EXPECT_FALSE(interpreter.call("mk", { Constant::ofInteger(1) }).has_value());
+    EXPECT_EQ(interpreter.m_failure, "result is not a scalar");
+
+    EXPECT_FALSE(interpreter.call("missing", {}).has_value());
+    EXPECT_EQ(interpreter.m_failure, "unknown routine missing");
+}
+
+TEST(InterpreterTest, EvaluatesArraysDeclaredInPlace)
+{
+    auto program = parseProgram("routine squares(integer n) -> integer is\n"
+                                "    var a: array[10] integer;\n"
+                                "    for i in 0 .. 10 loop\n"
+                                "        a[i] := i * i;\n"
+                                "    end\n"
+                                "    return a[n];\n"
+                                "end\n");
+    Interpreter interpreter(program);
+    auto result = interpreter.call("squares", { Constant::ofInteger(7) });
+    ASSERT_TRUE(result.has_value());
+    EXPECT_EQ(result->m_int, 49);
+
+    EXPECT_FALSE(interpreter.call("squares", { Constant::ofInteger(10) }).has_value());
+    EXPECT_EQ(interpreter.m_failure, "index out of bounds");
+}
+
+TEST(InterpreterTest, CountsOnlyLiveMemory)
+{
+    // every iteration declares a variable, which is gone at the end of it
+    auto program = parseProgram("routine fact(integer n, integer acc) -> integer is\n"
+                                "    while n > 1 loop\n"
+                                "        var next: integer is acc * n;\n"
+                                "        acc := next;\n"
+                                "        n := n - 1;\n"
+                                "    end\n"
+                                "    return acc;\n"
+                                "end\n"
+                                "\n"
+                                "routine table(integer n) -> integer is\n"
+                                "    var a: array[1000] integer;\n"
+                                "    a[n] := n;\n"
+                                "    return a[n];\n"
+                                "end\n"
+                                "\n"
+                                "routine tables(integer n) -> integer is\n"
+                                "    var s: integer is 0;\n"
+                                "    for i in 0 .. n loop\n"
+                                "        s := s + table(i);\n"
+                                "    end\n"
+                                "    return s;\n"
+                                "end\n");
+    Interpreter interpreter(program);
+    interpreter.m_limits.m_max_cells = 2000;
+    EXPECT_TRUE(interpreter.call("fact", { Constant::ofInteger(10000), Constant::ofInteger(1) }).has_value());
+    EXPECT_EQ(interpreter.m_failure, "");
+
+    auto sum = interpreter.call("tables", { Constant::ofInteger(100) });
+    ASSERT_TRUE(sum.has_value()) << interpreter.m_failure;
+    EXPECT_EQ(sum->m_int, 4950);
+
+    interpreter.m_limits.m_max_cells = 500;
+    EXPECT_FALSE(interpreter.call("tables", { Constant::ofInteger(100) }).has_value());
+    EXPECT_EQ(interpreter.m_failure, "too much memory");
+}
+
+TEST(InterpreterTest, LoopsEndAtTheEdgesOfIntegers)
+{
+    auto program = parseProgram("routine edges() -> integer is\n"
+                                "    var n: integer is 0;\n"
+                                "    var lo: integer is 0 - 2147483647 - 1;\n"
+                                "    for i in reverse lo .. lo + 3 loop\n"
+                                "        n := n + 1;\n"
+                                "    end\n"
+                                "    for i in 0 .. 10 loop\n"
+                                "        if i = 5 then\n"
+                                "            i := 2147483647;\n"
+                                "        end\n"
+                                "        n := n + 1;\n"
+                                "    end\n"
+                                "    return n;\n"
+                                "end\n");
+    auto result = Interpreter(program).call("edges", {});
+    ASSERT_TRUE(result.has_value());
+    EXPECT_EQ(result->m_int, 9);
+}
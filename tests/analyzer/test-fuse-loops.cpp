@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+#include <string>
+
+#include "analyzer/strategies/fuse-loops.hpp"
+#include "program.hpp"
+
+// whether the two loops of main are fused, main is given its arrays and a scalar
+static bool fuses(const std::string& loops)
+{
+    auto program = parseProgram("routine main() is\n"
+                                "    var a: array[20] integer;\n"
+                                "    var b: array[20] integer;\n"
+                                "    var s: integer is 0;\n"
+                                + loops + "end\n");
+    auto main = findRoutine(*program, "main");
+    bool fused = FuseLoops(program).apply(*main);
+
+    size_t loop_count = 0;
+    for (auto& item : main->m_body->m_items)
+    {
+        loop_count += dynamic_cast<parsing::For*>(item.get()) != nullptr;
+    }
+    EXPECT_EQ(loop_count, fused ? 1 : 2);
+    return fused;
+}
+
+TEST(FuseLoopsTest, FusesIndependentLoops)
+{
+    EXPECT_TRUE(fuses("    for i in 1 .. 10 loop\n"
+                      "        a[i] := i;\n"
+                      "    end\n"
+                      "    for j in 1 .. 10 loop\n"
+                      "        b[j] := j;\n"
+                      "    end\n"));
+}
+
+TEST(FuseLoopsTest, FusesWhenEachElementIsWrittenFirst)
+{
+    // b[i] reads a[i], written in the same iteration
+    EXPECT_TRUE(fuses("    for i in 1 .. 10 loop\n"
+                      "        a[i] := i;\n"
+                      "    end\n"
+                      "    for i in 1 .. 10 loop\n"
+                      "        b[i] := a[i];\n"
+                      "    end\n"));
+    // a[i - 1] was written one iteration earlier
+    EXPECT_TRUE(fuses("    for i in 1 .. 10 loop\n"
+                      "        a[i] := i;\n"
+                      "    end\n"
+                      "    for i in 1 .. 10 loop\n"
+                      "        b[i] := a[i - 1];\n"
+                      "    end\n"));
+}
+
+TEST(FuseLoopsTest, RefusesReadsAhead)
+{
+    // a[i + 1] would be read before the first loop writes it
+    EXPECT_FALSE(fuses("    for i in 1 .. 10 loop\n"
+                       "        a[i] := i;\n"
+                       "    end\n"
+                       "    for i in 1 .. 10 loop\n"
+                       "        b[i] := a[i + 1];\n"
+                       "    end\n"));
+    // a reverse loop writes the higher elements first
+    EXPECT_FALSE(fuses("    for i in reverse 1 .. 10 loop\n"
+                       "        a[i] := i;\n"
+                       "    end\n"
+                       "    for i in reverse 1 .. 10 loop\n"
+                       "        b[i] := a[i - 1];\n"
+                       "    end\n"));
+}
+
+TEST(FuseLoopsTest, RefusesWritesAhead)
+{
+    // the second loop would overwrite a[i + 1] before the first one reads it
+    EXPECT_FALSE(fuses("    for i in 1 .. 10 loop\n"
+                       "        b[i] := a[i];\n"
+                       "    end\n"
+                       "    for i in 1 .. 10 loop\n"
+                       "        a[i + 1] := 0;\n"
+                       "    end\n"));
+    // a[i - 1] has been read already
+    EXPECT_TRUE(fuses("    for i in 1 .. 10 loop\n"
+                      "        b[i] := a[i];\n"
+                      "    end\n"
+                      "    for i in 1 .. 10 loop\n"
+                      "        a[i - 1] := 0;\n"
+                      "    end\n"));
+}
+
+TEST(FuseLoopsTest, RefusesSharedScalarsAndUnknownIndices)
+{
+    EXPECT_FALSE(fuses("    for i in 1 .. 10 loop\n"
+                       "        s := s + i;\n"
+                       "    end\n"
+                       "    for i in 1 .. 10 loop\n"
+                       "        b[i] := s;\n"
+                       "    end\n"));
+    EXPECT_FALSE(fuses("    for i in 1 .. 10 loop\n"
+                       "        a[i] := i;\n"
+                       "    end\n"
+                       "    for i in 1 .. 10 loop\n"
+                       "        b[i] := a[10 - i];\n"
+                       "    end\n"));
+}
+
+TEST(FuseLoopsTest, RefusesDifferentOrChangedRanges)
+{
+    EXPECT_FALSE(fuses("    for i in 1 .. 10 loop\n"
+                       "        a[i] := i;\n"
+                       "    end\n"
+                       "    for i in 1 .. 11 loop\n"
+                       "        b[i] := i;\n"
+                       "    end\n"));
+    EXPECT_FALSE(fuses("    for i in 1 .. s loop\n"
+                       "        s := 5;\n"
+                       "    end\n"
+                       "    for i in 1 .. s loop\n"
+                       "        b[i] := i;\n"
+                       "    end\n"));
+}
+
+TEST(FuseLoopsTest, RefusesTwoLoopsThatPrint)
+{
+    EXPECT_FALSE(fuses("    for i in 1 .. 10 loop\n"
+                       "        print(i);\n"
+                       "    end\n"
+                       "    for i in 1 .. 10 loop\n"
+                       "        print(i);\n"
+                       "    end\n"));
+}
@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "analyzer/evaluator.hpp"
+#include "analyzer/strategies/hoist-invariants.hpp"
+#include "program.hpp"
+
+using folding::Constant;
+
+// results of f for n in [-2, 5), f must be evaluable
+static std::vector<int> results(std::shared_ptr<parsing::Program> program)
+{
+    evaluation::Interpreter interpreter(program);
+    std::vector<int> values;
+    for (int n = -2; n < 5; ++n)
+    {
+        auto value = interpreter.call("f", { Constant::ofInteger(n) });
+        EXPECT_TRUE(value.has_value()) << interpreter.m_failure;
+        values.push_back(value ? value->m_int : 0);
+    }
+    return values;
+}
+
+// applies the pass to f and checks that f computes the same
+static bool hoist(std::shared_ptr<parsing::Program> program)
+{
+    auto before = results(program);
+    bool changed = HoistLoopInvariants(program).apply(*findRoutine(*program, "f"));
+    EXPECT_EQ(results(program), before);
+    return changed;
+}
+
+// the name of what f declares first
+static std::string firstDeclared(parsing::Program& program)
+{
+    auto var = std::dynamic_pointer_cast<parsing::Variable>(findRoutine(program, "f")->m_body->m_items.front());
+    return var ? var->m_name : "";
+}
+
+TEST(HoistLoopInvariantsTest, HoistsInvariantArithmetic)
+{
+    auto program = parseProgram("routine f(integer n) -> integer is\n"
+                                "    var s: integer is 0;\n"
+                                "    for i in 0 .. 4 loop\n"
+                                "        s := s + i * (n * n + 3);\n"
+                                "    end\n"
+                                "    return s;\n"
+                                "end\n");
+    EXPECT_TRUE(hoist(program));
+    EXPECT_EQ(firstDeclared(*program), "s");
+    auto& items = findRoutine(*program, "f")->m_body->m_items;
+    auto hoisted = std::dynamic_pointer_cast<parsing::Variable>(items[1]);
+    ASSERT_TRUE(hoisted != nullptr);
+    EXPECT_EQ(hoisted->m_name, "licm.1");
+}
+
+TEST(HoistLoopInvariantsTest, LeavesWhatMayTrapInTheLoop)
+{
+    // the loop doesn't run for n = 0, the division must not run either
+    auto program = parseProgram("routine f(integer n) -> integer is\n"
+                                "    var s: integer is 0;\n"
+                                "    for i in 0 .. n loop\n"
+                                "        s := s + 100 / n;\n"
+                                "    end\n"
+                                "    return s;\n"
+                                "end\n");
+    EXPECT_FALSE(hoist(program));
+}
+
+TEST(HoistLoopInvariantsTest, LeavesCallsAndVariantsInTheLoop)
+{
+    auto program = parseProgram("routine g(integer x) -> integer is\n"
+                                "    return x * x;\n"
+                                "end\n"
+                                "routine f(integer n) -> integer is\n"
+                                "    var s: integer is 0;\n"
+                                "    var k: integer is n;\n"
+                                "    for i in 0 .. 4 loop\n"
+                                "        s := s + g(n) + k * k;\n"
+                                "        k := k + 1;\n"
+                                "    end\n"
+                                "    return s;\n"
+                                "end\n");
+    EXPECT_FALSE(hoist(program));
+}
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+
+#include "analyzer/strategies/if-conversion.hpp"
+#include "program.hpp"
+
+// whether the if of `var x is 0; if ...; return x;` in f becomes a select
+static bool converted(const std::string& branch)
+{
+    auto program = parseProgram("routine g(integer x) -> integer is\n"
+                                "    return x + 1;\n"
+                                "end\n"
+                                "routine f(integer n) -> integer is\n"
+                                "    var a: array[4] integer;\n"
+                                "    var x: integer is 0;\n"
+                                + branch + "    return x;\n"
+                                           "end\n");
+    auto routine = findRoutine(*program, "f");
+    IfConversion(program).apply(*routine);
+    auto node = std::dynamic_pointer_cast<parsing::If>(routine->m_body->m_items[2]);
+    EXPECT_TRUE(node != nullptr);
+    return node && node->m_branchless;
+}
+
+// whether the and/or f returns is short-circuited
+static bool shortCircuited(const std::string& condition)
+{
+    auto program = parseProgram("routine g(integer x) -> integer is\n"
+                                "    return x + 1;\n"
+                                "end\n"
+                                "routine f(integer n) -> boolean is\n"
+                                "    return " + condition + ";\n"
+                                "end\n");
+    auto routine = findRoutine(*program, "f");
+    IfConversion(program).apply(*routine);
+    auto ret = std::dynamic_pointer_cast<parsing::ReturnStatement>(routine->m_body->m_items.back());
+    auto logic = std::dynamic_pointer_cast<parsing::Logic>(ret->m_expr);
+    EXPECT_TRUE(logic != nullptr);
+    return logic && logic->m_short_circuit;
+}
+
+TEST(IfConversionTest, SelectsBetweenCheapArms)
+{
+    EXPECT_TRUE(converted("    if n > 0 then\n"
+                          "        x := n * 2;\n"
+                          "    else\n"
+                          "        x := 3 - n;\n"
+                          "    end\n"));
+    EXPECT_TRUE(converted("    if n > 0 then\n"
+                          "        x := n / 4;\n"
+                          "    end\n"));
+}
+
+TEST(IfConversionTest, LeavesArmsThatMayTrapOrCall)
+{
+    EXPECT_FALSE(converted("    if n > 0 then\n"
+                           "        x := 100 / n;\n"
+                           "    end\n"));
+    EXPECT_FALSE(converted("    if n > 0 then\n"
+                           "        x := 1;\n"
+                           "    else\n"
+                           "        x := g(n);\n"
+                           "    end\n"));
+    EXPECT_FALSE(converted("    if n >= 0 then\n"
+                           "        x := a[n];\n"
+                           "    end\n"));
+}
+
+TEST(IfConversionTest, LeavesArmsThatAreNotOneAssignment)
+{
+    EXPECT_FALSE(converted("    if n > 0 then\n"
+                           "        x := 1;\n"
+                           "        x := x + n;\n"
+                           "    end\n"));
+    EXPECT_FALSE(converted("    if n > 0 then\n"
+                           "        x := 1;\n"
+                           "    else\n"
+                           "        n := 2;\n"
+                           "    end\n"));
+    EXPECT_FALSE(converted("    if n > 0 then\n"
+                           "        x := ((n * n + n) * (n + 1)) * ((n - 1) * (n + 2));\n"
+                           "    end\n"));
+}
+
+TEST(IfConversionTest, ShortCircuitsOnlyWhatMayCallOrTrap)
+{
+    EXPECT_FALSE(shortCircuited("n > 0 and n < 10"));
+    EXPECT_FALSE(shortCircuited("n > 0 or n / 2 < 10"));
+    EXPECT_TRUE(shortCircuited("n > 0 and 100 / n > 1"));
+    EXPECT_TRUE(shortCircuited("n < 0 or g(n) > 1"));
+}
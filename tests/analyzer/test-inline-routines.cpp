@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "analyzer/evaluator.hpp"
+#include "analyzer/strategies/inline-routines.hpp"
+#include "program.hpp"
+
+using folding::Constant;
+
+// results of f for n in [-2, 5), f must be evaluable
+static std::vector<int> results(std::shared_ptr<parsing::Program> program)
+{
+    evaluation::Interpreter interpreter(program);
+    std::vector<int> values;
+    for (int n = -2; n < 5; ++n)
+    {
+        auto value = interpreter.call("f", { Constant::ofInteger(n) });
+        EXPECT_TRUE(value.has_value()) << interpreter.m_failure;
+        values.push_back(value ? value->m_int : 0);
+    }
+    return values;
+}
+
+// inlines over the whole program and checks that f computes the same
+static bool inlineCalls(std::shared_ptr<parsing::Program> program)
+{
+    auto before = results(program);
+    bool changed = InlineRoutines(program).apply().m_changed;
+    EXPECT_EQ(results(program), before);
+    return changed;
+}
+
+static bool calls(parsing::Program& program, const std::string& caller, const std::string& callee)
+{
+    auto names = analysis::calledNames(*findRoutine(program, caller)->m_body);
+    return std::find(names.begin(), names.end(), callee) != names.end();
+}
+
+TEST(InlineRoutinesTest, InlinesSmallCallees)
+{
+    auto program = parseProgram("routine square(integer x) -> integer is\n"
+                                "    return x * x;\n"
+                                "end\n"
+                                "routine f(integer n) -> integer is\n"
+                                "    var s: integer is 0;\n"
+                                "    for i in 0 .. 3 loop\n"
+                                "        s := s + square(n + i);\n"
+                                "    end\n"
+                                "    return square(s) + 1;\n"
+                                "end\n");
+    EXPECT_TRUE(inlineCalls(program));
+    EXPECT_FALSE(calls(*program, "f", "square"));
+}
+
+TEST(InlineRoutinesTest, LeavesRecursiveComponentsAlone)
+{
+    auto program = parseProgram("routine even(integer n) -> boolean is\n"
+                                "    if n <= 0 then\n"
+                                "        return true;\n"
+                                "    end\n"
+                                "    return odd(n - 1);\n"
+                                "end\n"
+                                "routine odd(integer n) -> boolean is\n"
+                                "    if n <= 0 then\n"
+                                "        return false;\n"
+                                "    end\n"
+                                "    return even(n - 1);\n"
+                                "end\n"
+                                "routine fact(integer n) -> integer is\n"
+                                "    if n <= 1 then\n"
+                                "        return 1;\n"
+                                "    end\n"
+                                "    return n * fact(n - 1);\n"
+                                "end\n"
+                                "routine f(integer n) -> integer is\n"
+                                "    if even(n) then\n"
+                                "        return fact(n);\n"
+                                "    end\n"
+                                "    return 0;\n"
+                                "end\n");
+    EXPECT_FALSE(inlineCalls(program));
+    EXPECT_TRUE(calls(*program, "f", "even"));
+    EXPECT_TRUE(calls(*program, "f", "fact"));
+    EXPECT_TRUE(calls(*program, "even", "odd"));
+    EXPECT_TRUE(calls(*program, "odd", "even"));
+}
+
+TEST(InlineRoutinesTest, LeavesLargeCalleesAlone)
+{
+    auto program = parseProgram("routine square(integer x) -> integer is\n"
+                                "    return x * x;\n"
+                                "end\n"
+                                "routine f(integer n) -> integer is\n"
+                                "    return square(n) + square(n + 1);\n"
+                                "end\n");
+    InlineRoutines pass(program);
+    pass.m_threshold = 1;
+    EXPECT_FALSE(pass.apply().m_changed);
+    EXPECT_TRUE(calls(*program, "f", "square"));
+}
@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+#include <limits>
+#include <memory>
+#include <string>
+
+#include "analyzer/intervals.hpp"
+#include "program.hpp"
+
+using intervals::Environment;
+using intervals::Interval;
+
+// the first statement of main
+static std::shared_ptr<parsing::ASTNode> firstStatement(const std::string& body)
+{
+    auto program = parseProgram("routine main() is\n" + body + "end\n");
+    return findRoutine(*program, "main")->m_body->m_items.front();
+}
+
+// the initial value of `var x: integer is <text>`
+static std::shared_ptr<parsing::Expression> expression(const std::string& text)
+{
+    auto var = std::dynamic_pointer_cast<parsing::PrimitiveVariable>(
+        firstStatement("    var x: integer is " + text + ";\n"));
+    return var->m_value;
+}
+
+TEST(IntervalsTest, EvaluatesArithmetic)
+{
+    Environment env { { "i", Interval { 0, 9 } } };
+
+    auto sum = intervals::evaluate(*expression("i + 1"), env);
+    ASSERT_TRUE(sum.has_value());
+    EXPECT_EQ(sum->m_low, 1);
+    EXPECT_EQ(sum->m_high, 10);
+
+    auto difference = intervals::evaluate(*expression("i - 10"), env);
+    ASSERT_TRUE(difference.has_value());
+    EXPECT_EQ(difference->m_low, -10);
+    EXPECT_EQ(difference->m_high, -1);
+
+    auto product = intervals::evaluate(*expression("(i - 5) * 3"), env);
+    ASSERT_TRUE(product.has_value());
+    EXPECT_EQ(product->m_low, -15);
+    EXPECT_EQ(product->m_high, 12);
+
+    auto remainder = intervals::evaluate(*expression("i % 4"), env);
+    ASSERT_TRUE(remainder.has_value());
+    EXPECT_EQ(remainder->m_low, 0);
+    EXPECT_EQ(remainder->m_high, 3);
+}
+
+TEST(IntervalsTest, GivesUpOnOverflow)
+{
+    Environment env { { "i", Interval { 0, 100000 } } };
+
+    EXPECT_FALSE(intervals::evaluate(*expression("i + 2147483640"), env).has_value());
+    EXPECT_FALSE(intervals::evaluate(*expression("i * i"), env).has_value());
+    EXPECT_FALSE(intervals::evaluate(*expression("(0 - 2147483640) - i"), env).has_value());
+
+    // the largest value that does not wrap around is still known
+    auto edge = intervals::evaluate(*expression("i + 2147383647"), env);
+    ASSERT_TRUE(edge.has_value());
+    EXPECT_EQ(edge->m_high, std::numeric_limits<int32_t>::max());
+}
+
+TEST(IntervalsTest, GivesUpOnUnknownOperands)
+{
+    Environment env { { "i", Interval { 0, 9 } } };
+
+    EXPECT_FALSE(intervals::evaluate(*expression("j + 1"), env).has_value());
+    // the divisor may be zero
+    EXPECT_FALSE(intervals::evaluate(*expression("10 / i"), env).has_value());
+    EXPECT_FALSE(intervals::evaluate(*expression("(i - 5) % 3"), env).has_value());
+}
+
+TEST(IntervalsTest, IteratorOfLoops)
+{
+    auto loop = std::dynamic_pointer_cast<parsing::For>(firstStatement("    for i in 2 .. 10 loop\n"
+                                                                       "        print(i);\n"
+                                                                       "    end\n"));
+    ASSERT_NE(loop, nullptr);
+    auto iterator = intervals::iteratorOf(*loop, {});
+    ASSERT_TRUE(iterator.has_value());
+    EXPECT_EQ(iterator->m_low, 2);
+    EXPECT_EQ(iterator->m_high, 9);
+
+    auto reverse = std::dynamic_pointer_cast<parsing::For>(firstStatement("    for i in reverse 2 .. 10 loop\n"
+                                                                          "        print(i);\n"
+                                                                          "    end\n"));
+    EXPECT_FALSE(intervals::iteratorOf(*reverse, {}).has_value());
+
+    auto assigned = std::dynamic_pointer_cast<parsing::For>(firstStatement("    for i in 2 .. 10 loop\n"
+                                                                           "        i := i + 1;\n"
+                                                                           "    end\n"));
+    EXPECT_FALSE(intervals::iteratorOf(*assigned, {}).has_value());
+}
+
+TEST(IntervalsTest, EmptyRangeGivesEmptyInterval)
+{
+    auto loop = std::dynamic_pointer_cast<parsing::For>(firstStatement("    for i in 5 .. 5 loop\n"
+                                                                       "        print(i);\n"
+                                                                       "    end\n"));
+    ASSERT_NE(loop, nullptr);
+    auto iterator = intervals::iteratorOf(*loop, {});
+    ASSERT_TRUE(iterator.has_value());
+    // the body never runs, no value is in the interval
+    EXPECT_GT(iterator->m_low, iterator->m_high);
+}
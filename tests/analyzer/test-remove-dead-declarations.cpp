@@ -0,0 +1,41 @@
+#include <gtest/gtest.h>
+#include <string>
+
+#include "analyzer/strategies/remove-dead-declarations.hpp"
+#include "program.hpp"
+
+TEST(RemoveDeadDeclarationsTest, RemovesUncalledRoutines)
+{
+    auto program = parseProgram("routine used() -> integer is\n"
+                                "    return 1;\n"
+                                "end\n"
+                                "\n"
+                                "routine unused() -> integer is\n"
+                                "    return 2;\n"
+                                "end\n"
+                                "\n"
+                                "routine main() is\n"
+                                "    print(used());\n"
+                                "end\n");
+    EXPECT_TRUE(RemoveDeadDeclarations(program).apply().m_changed);
+    EXPECT_NE(findRoutine(*program, "used"), nullptr);
+    EXPECT_EQ(findRoutine(*program, "unused"), nullptr);
+}
+
+TEST(RemoveDeadDeclarationsTest, KeepsRoutinesCalledInArraySizes)
+{
+    auto program = parseProgram("routine size(integer n) -> integer is\n"
+                                "    print(n);\n"
+                                "    return n * 2;\n"
+                                "end\n"
+                                "\n"
+                                "type Arr is array[size(3)] integer;\n"
+                                "\n"
+                                "routine main() is\n"
+                                "    var a: Arr;\n"
+                                "    a[1] := 5;\n"
+                                "    print(a[1]);\n"
+                                "end\n");
+    RemoveDeadDeclarations(program).apply();
+    EXPECT_NE(findRoutine(*program, "size"), nullptr);
+}
@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "analyzer/evaluator.hpp"
+#include "analyzer/strategies/specialize-routines.hpp"
+#include "program.hpp"
+
+using folding::Constant;
+
+// results of f for n in [-2, 5), f must be evaluable
+static std::vector<int> results(std::shared_ptr<parsing::Program> program)
+{
+    evaluation::Interpreter interpreter(program);
+    std::vector<int> values;
+    for (int n = -2; n < 5; ++n)
+    {
+        auto value = interpreter.call("f", { Constant::ofInteger(n) });
+        EXPECT_TRUE(value.has_value()) << interpreter.m_failure;
+        values.push_back(value ? value->m_int : 0);
+    }
+    return values;
+}
+
+// names of the routines in the program, in order
+static std::vector<std::string> routines(parsing::Program& program)
+{
+    std::vector<std::string> names;
+    for (auto& decl : program.m_declarations)
+    {
+        if (auto routine = std::dynamic_pointer_cast<parsing::Routine>(decl))
+        {
+            names.push_back(routine->m_name);
+        }
+    }
+    return names;
+}
+
+static const char* scale = "routine scale(integer k, integer x) -> integer is\n"
+                           "    if k > 3 then\n"
+                           "        return k * x;\n"
+                           "    end\n"
+                           "    return k + x;\n"
+                           "end\n";
+
+TEST(SpecializeRoutinesTest, ClonesForConstantArguments)
+{
+    auto program = parseProgram(std::string(scale)
+                                + "routine f(integer n) -> integer is\n"
+                                  "    return scale(3, n) + scale(4, n) * scale(3, n + 1);\n"
+                                  "end\n");
+    auto before = results(program);
+    EXPECT_TRUE(SpecializeRoutines(program).apply().m_changed);
+    EXPECT_EQ(results(program), before);
+
+    // calls with the same constants share a clone, placed after the original
+    std::vector<std::string> expected = { "scale", "scale<4,_>", "scale<3,_>", "f" };
+    auto names = routines(*program);
+    std::sort(names.begin() + 1, names.begin() + 3);
+    std::sort(expected.begin() + 1, expected.begin() + 3);
+    EXPECT_EQ(names, expected);
+    auto called = analysis::calledNames(*findRoutine(*program, "f")->m_body);
+    EXPECT_EQ(std::count(called.begin(), called.end(), "scale"), 0);
+}
+
+TEST(SpecializeRoutinesTest, KeepsToItsBudgets)
+{
+    auto source = std::string(scale)
+        + "routine f(integer n) -> integer is\n"
+          "    return scale(3, n) + scale(4, n);\n"
+          "end\n";
+
+    auto program = parseProgram(source);
+    SpecializeRoutines large(program);
+    large.m_max_size = 1;
+    EXPECT_FALSE(large.apply().m_changed);
+    EXPECT_EQ(routines(*program).size(), 2);
+
+    program = parseProgram(source);
+    SpecializeRoutines once(program);
+    once.m_max_per_routine = 1;
+    EXPECT_TRUE(once.apply().m_changed);
+    EXPECT_EQ(routines(*program).size(), 3);
+}
+
+TEST(SpecializeRoutinesTest, LeavesRealsAlone)
+{
+    auto program = parseProgram("routine half(real x) -> real is\n"
+                                "    return x / 2.0;\n"
+                                "end\n"
+                                "routine f(integer n) -> integer is\n"
+                                "    var r: real is half(0.1);\n"
+                                "    return n;\n"
+                                "end\n");
+    EXPECT_FALSE(SpecializeRoutines(program).apply().m_changed);
+    EXPECT_EQ(routines(*program).size(), 2);
+}
@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "analyzer/evaluator.hpp"
+#include "analyzer/strategies/strength-reduction.hpp"
+#include "program.hpp"
+
+using folding::Constant;
+
+// results of f for n in [-2, 5), f must be evaluable
+static std::vector<int> results(std::shared_ptr<parsing::Program> program)
+{
+    evaluation::Interpreter interpreter(program);
+    std::vector<int> values;
+    for (int n = -2; n < 5; ++n)
+    {
+        auto value = interpreter.call("f", { Constant::ofInteger(n) });
+        EXPECT_TRUE(value.has_value()) << interpreter.m_failure;
+        values.push_back(value ? value->m_int : 0);
+    }
+    return values;
+}
+
+// applies the pass to f and checks that f computes the same
+static bool reduce(std::shared_ptr<parsing::Program> program)
+{
+    auto before = results(program);
+    bool changed = StrengthReduction(program).apply(*findRoutine(*program, "f"));
+    EXPECT_EQ(results(program), before);
+    return changed;
+}
+
+TEST(StrengthReductionTest, ReducesProductsWithParametersAndLocals)
+{
+    auto program = parseProgram("routine f(integer n) -> integer is\n"
+                                "    var s: integer is 0;\n"
+                                "    var m: integer is n + 3;\n"
+                                "    for i in 2 .. 7 loop\n"
+                                "        s := s + i * n + m * i;\n"
+                                "    end\n"
+                                "    return s;\n"
+                                "end\n");
+    EXPECT_TRUE(reduce(program));
+}
+
+TEST(StrengthReductionTest, LeavesGlobalsAlone)
+{
+    // bump changes n between the iterations without assigning it in the loop
+    auto program = parseProgram("var n: integer is 1;\n"
+                                "routine bump() is\n"
+                                "    n := n + 10;\n"
+                                "end\n"
+                                "routine f(integer k) -> integer is\n"
+                                "    var s: integer is 0;\n"
+                                "    n := k;\n"
+                                "    for i in 0 .. 4 loop\n"
+                                "        s := s + i * n;\n"
+                                "        bump();\n"
+                                "    end\n"
+                                "    return s;\n"
+                                "end\n");
+    // the interpreter has no globals, nothing to compare with
+    EXPECT_FALSE(StrengthReduction(program).apply(*findRoutine(*program, "f")));
+}
+
+TEST(StrengthReductionTest, LeavesVariantStepsAlone)
+{
+    auto program = parseProgram("routine f(integer n) -> integer is\n"
+                                "    var s: integer is 0;\n"
+                                "    for i in 0 .. 4 loop\n"
+                                "        s := s + i * n;\n"
+                                "        n := n + 1;\n"
+                                "    end\n"
+                                "    return s;\n"
+                                "end\n");
+    EXPECT_FALSE(reduce(program));
+}
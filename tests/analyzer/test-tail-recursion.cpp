@@ -0,0 +1,53 @@
+#include <gtest/gtest.h>
+#include <string>
+
+#include "analyzer/evaluator.hpp"
+#include "analyzer/strategies/tail-recursion.hpp"
+#include "program.hpp"
+
+TEST(TailRecursionTest, EliminatesSelfCall)
+{
+    auto program = parseProgram("routine f(integer n, integer acc) -> integer is\n"
+                                "    if n <= 0 then\n"
+                                "        return acc;\n"
+                                "    end\n"
+                                "    return f(n - 1, acc + n);\n"
+                                "end\n");
+    auto f = findRoutine(*program, "f");
+    ASSERT_NE(f, nullptr);
+
+    EliminateTailRecursion tre(program);
+    EXPECT_TRUE(tre.apply(*f));
+    tail_calls::SelfReturns self_returns("f");
+    f->m_body->accept(self_returns);
+    EXPECT_FALSE(self_returns.m_found);
+
+    auto result = evaluation::Interpreter(program).call(
+        "f", { folding::Constant::ofInteger(3), folding::Constant::ofInteger(0) });
+    ASSERT_TRUE(result.has_value());
+    EXPECT_EQ(result->m_int, 6);
+}
+
+TEST(TailRecursionTest, KeepsShadowedParameter)
+{
+    auto program = parseProgram("routine f(integer n, integer acc) -> integer is\n"
+                                "    if n <= 0 then\n"
+                                "        return acc;\n"
+                                "    else\n"
+                                "        var acc: integer is 1000;\n"
+                                "        return f(n - 1, acc + n);\n"
+                                "    end\n"
+                                "end\n");
+    auto f = findRoutine(*program, "f");
+    ASSERT_NE(f, nullptr);
+
+    EliminateTailRecursion tre(program);
+    EXPECT_FALSE(tre.apply(*f));
+    ASSERT_EQ(tre.m_remarks.size(), 1);
+    EXPECT_EQ(tre.m_remarks.front(), "not eliminating tail calls of f: acc is redeclared");
+
+    auto result = evaluation::Interpreter(program).call(
+        "f", { folding::Constant::ofInteger(3), folding::Constant::ofInteger(0) });
+    ASSERT_TRUE(result.has_value());
+    EXPECT_EQ(result->m_int, 1001);
+}
@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "analyzer/evaluator.hpp"
+#include "analyzer/strategies/unswitch-loops.hpp"
+#include "program.hpp"
+
+using folding::Constant;
+
+// results of f for n in [-2, 5), f must be evaluable
+static std::vector<int> results(std::shared_ptr<parsing::Program> program)
+{
+    evaluation::Interpreter interpreter(program);
+    std::vector<int> values;
+    for (int n = -2; n < 5; ++n)
+    {
+        auto value = interpreter.call("f", { Constant::ofInteger(n) });
+        EXPECT_TRUE(value.has_value()) << interpreter.m_failure;
+        values.push_back(value ? value->m_int : 0);
+    }
+    return values;
+}
+
+// applies the pass to f and checks that f computes the same
+static bool unswitch(std::shared_ptr<parsing::Program> program, UnswitchLoops pass)
+{
+    auto before = results(program);
+    bool changed = pass.apply(*findRoutine(*program, "f"));
+    EXPECT_EQ(results(program), before);
+    return changed;
+}
+
+static bool unswitch(std::shared_ptr<parsing::Program> program)
+{
+    return unswitch(program, UnswitchLoops(program));
+}
+
+// f summing over a loop around `branch`
+static std::shared_ptr<parsing::Program> loopAround(const std::string& branch)
+{
+    return parseProgram("routine f(integer n) -> integer is\n"
+                        "    var s: integer is 0;\n"
+                        "    for i in 0 .. 6 loop\n"
+                        + branch + "    end\n"
+                                   "    return s;\n"
+                                   "end\n");
+}
+
+static const char* invariant = "        if n > 2 then\n"
+                               "            s := s + i;\n"
+                               "        else\n"
+                               "            s := s - i * 2;\n"
+                               "        end\n";
+
+TEST(UnswitchLoopsTest, HoistsInvariantTestsOutOfLoops)
+{
+    auto program = loopAround(invariant);
+    EXPECT_TRUE(unswitch(program));
+    auto& items = findRoutine(*program, "f")->m_body->m_items;
+    EXPECT_TRUE(std::dynamic_pointer_cast<parsing::If>(items[1]) != nullptr);
+
+    program = parseProgram("routine f(integer n) -> integer is\n"
+                           "    var s: integer is 0;\n"
+                           "    var k: integer is 5;\n"
+                           "    while k > 0 loop\n"
+                           "        if n >= 0 then\n"
+                           "            s := s + k;\n"
+                           "        end\n"
+                           "        k := k - 1;\n"
+                           "    end\n"
+                           "    return s;\n"
+                           "end\n");
+    EXPECT_TRUE(unswitch(program));
+}
+
+TEST(UnswitchLoopsTest, LeavesVariantAndTrappingConditions)
+{
+    EXPECT_FALSE(unswitch(loopAround("        if s > 2 then\n"
+                                     "            s := s + i;\n"
+                                     "        end\n")));
+    EXPECT_FALSE(unswitch(loopAround("        if i > n then\n"
+                                     "            s := s + i;\n"
+                                     "        end\n")));
+    // the loop may not run, the division then must not either
+    EXPECT_FALSE(unswitch(parseProgram("routine f(integer n) -> integer is\n"
+                                       "    var s: integer is 0;\n"
+                                       "    for i in 0 .. n loop\n"
+                                       "        if 12 / n > 2 then\n"
+                                       "            s := s + i;\n"
+                                       "        end\n"
+                                       "    end\n"
+                                       "    return s;\n"
+                                       "end\n")));
+}
+
+TEST(UnswitchLoopsTest, LeavesOversizedLoops)
+{
+    auto program = loopAround(invariant);
+    UnswitchLoops small_loops(program);
+    small_loops.m_max_loop_size = 4;
+    EXPECT_FALSE(unswitch(program, small_loops));
+
+    UnswitchLoops small_routines(program);
+    small_routines.m_max_routine_size = 20;
+    EXPECT_FALSE(unswitch(program, small_routines));
+}